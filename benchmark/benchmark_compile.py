@@ -0,0 +1,55 @@
+from pyquboc import Array, Constraint, Placeholder, SubH
+import logging
+import time
+import argparse
+from memory_profiler import memory_usage
+
+parser = argparse.ArgumentParser()
+
+logging.basicConfig(level=logging.INFO)
+logger = logging.getLogger("benchmark_compile")
+
+
+def nested(n, depth):
+    # Deeply nested model. Each level wraps the previous one in SubH and Constraint and scales it,
+    # so the expansion has to pass large polynomials up through many nodes.
+    x = Array.create('x', n, 'BINARY')
+    A = Placeholder("A")
+
+    H = sum(x[i] * x[(i + 1) % n] for i in range(n))
+    for d in range(depth):
+        H = SubH(2 * H + x[d % n], label="h{}".format(d))
+        H = H + A * Constraint((sum(x[(d + i) % n] for i in range(n // 2)) - 1) ** 2, label="c{}".format(d))
+
+    return H
+
+
+def compile_model(H, compact):
+    t0 = time.time()
+    model = H.compile(compact=compact)
+    model.to_qubo(index_label=True, feed_dict={"A": 2.0})
+    t1 = time.time()
+
+    return t1 - t0
+
+
+def measure(n, step, init_depth, max_depth, compact):
+    for depth in range(init_depth, max_depth + step, step):
+        H = nested(n, depth)
+
+        # Report the peak memory of the compile alone, so that the interpreter and the expression do not hide the
+        # intermediate polynomials that the expansion allocates and copies.
+        base_memory = memory_usage(-1, max_usage=True)
+        max_memory, compile_time = memory_usage((compile_model, (H, compact)), max_usage=True, retval=True)
+        logger.info("Memory usage is {} MB (+{} MB while compiling) for depth={}".format(max_memory, max_memory - base_memory, depth))
+        logger.info("Elapsed time is {} sec for depth={}".format(compile_time, depth))
+
+
+if __name__ == "__main__":
+    parser.add_argument('-n', '--n_variables', type=int, default=100)
+    parser.add_argument('-m', '--max_depth', type=int)
+    parser.add_argument('-i', '--init_depth', type=int)
+    parser.add_argument('-s', '--step', type=int)
+    parser.add_argument('-c', '--compact', action='store_true')
+    args = parser.parse_args()
+    measure(args.n_variables, args.step, args.init_depth, args.max_depth, args.compact)
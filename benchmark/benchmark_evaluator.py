@@ -0,0 +1,59 @@
+import numpy as np
+
+from pyquboc import Array, Constraint
+import logging
+import time
+import argparse
+
+parser = argparse.ArgumentParser()
+
+logging.basicConfig(level=logging.INFO)
+logger = logging.getLogger("benchmark_evaluator")
+
+
+def tsp(n_city, constraint):
+    # Same model as benchmark_tsp.py. Without constraint, the one-hot terms are plain terms and the evaluator has nothing to track.
+    x = Array.create('c', (n_city, n_city), 'BINARY')
+    wrap = (lambda h, label: Constraint(h, label=label)) if constraint else (lambda h, label: h)
+
+    H = 0.0
+    for i in range(n_city):
+        H += wrap((sum(x[i, j] for j in range(n_city)) - 1)**2, "time{}".format(i))
+    for j in range(n_city):
+        H += wrap((sum(x[i, j] for i in range(n_city)) - 1)**2, "city{}".format(j))
+    for i in range(n_city):
+        for j in range(n_city):
+            for k in range(n_city):
+                H += 10 * x[k, i] * x[(k + 1) % n_city, j]
+
+    return H.compile()
+
+
+def flip_rate(model, n_flip, query_interval):
+    rng = np.random.default_rng(0)
+    evaluator = model.evaluator(rng.integers(0, 2, len(model.variables), dtype=np.int8))
+    indexes = rng.integers(0, len(model.variables), n_flip)
+
+    t0 = time.time()
+    for step, i in enumerate(indexes):
+        evaluator.flip(int(i))
+        if query_interval and step % query_interval == 0:
+            evaluator.num_broken
+    t1 = time.time()
+
+    return n_flip / (t1 - t0)
+
+
+def measure(n_city, n_flip, query_interval):
+    for constraint in (False, True):
+        model = tsp(n_city, constraint)
+        logger.info("{} flips/sec for n_city={}, constraint={}, query_interval={}".format(
+            flip_rate(model, n_flip, query_interval), n_city, constraint, query_interval))
+
+
+if __name__ == "__main__":
+    parser.add_argument('-n', '--n_city', type=int, default=20)
+    parser.add_argument('-f', '--n_flip', type=int, default=100000)
+    parser.add_argument('-q', '--query_interval', type=int, default=0)
+    args = parser.parse_args()
+    measure(args.n_city, args.n_flip, args.query_interval)
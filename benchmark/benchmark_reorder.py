@@ -0,0 +1,77 @@
+import numpy as np
+
+from pyquboc import Binary
+from scipy.sparse import coo_matrix
+import logging
+import time
+import argparse
+
+parser = argparse.ArgumentParser()
+
+logging.basicConfig(level=logging.INFO)
+logger = logging.getLogger("benchmark_reorder")
+
+
+def lattice(n, seed=0):
+    # 2D lattice whose variables are created in random order, so the indexes assigned by compile are scattered.
+    rng = np.random.default_rng(seed)
+    x = {}
+    for k in rng.permutation(n * n):
+        x[k] = Binary("x{}".format(k))
+
+    edges = [(i * n + j, i * n + j + 1) for i in range(n) for j in range(n - 1)] + [(i * n + j, (i + 1) * n + j) for i in range(n - 1) for j in range(n)]
+    H = sum(float(rng.normal()) * x[a] * x[b] for a, b in (edges[i] for i in rng.permutation(len(edges)))) + sum(float(rng.normal()) * x[k] for k in range(n * n))
+
+    return H.compile()
+
+
+def to_matrix(model):
+    qubo, offset = model.to_qubo(index_label=True)
+    rows, columns = np.array(list(qubo.keys())).T
+    values = np.array(list(qubo.values()))
+    size = len(model.variables)
+
+    matrix = coo_matrix((values, (rows, columns)), shape=(size, size))
+
+    return (matrix + matrix.T).tocsr()
+
+
+def sweep_time(matrix, n_sweeps, n_repeats=5):
+    # A sampler sweep computes the local field of every variable from its neighbour list, which is a sparse matrix-vector product.
+    # The difference between orderings is small compared with the noise of a single run, so report the median of several runs.
+    times = []
+    for _ in range(n_repeats):
+        rng = np.random.default_rng(0)
+        x = rng.integers(0, 2, matrix.shape[0]).astype(np.float64)
+
+        t0 = time.time()
+        for _ in range(n_sweeps):
+            x = (matrix.dot(x) < 0).astype(np.float64)
+        t1 = time.time()
+
+        times.append(t1 - t0)
+
+    return float(np.median(times))
+
+
+def bandwidth(matrix):
+    coo = matrix.tocoo()
+    return int(np.max(np.abs(coo.row - coo.col)))
+
+
+def measure(n, n_sweeps):
+    model = lattice(n)
+
+    for method in (None, "bfs", "rcm"):
+        t0 = time.time()
+        reordered_model = model if method is None else model.reorder(method)[0]
+        t1 = time.time()
+        matrix = to_matrix(reordered_model)
+        logger.info("method={}: reorder {:.3f} sec, bandwidth {}, {} sweeps {:.3f} sec (median)".format(method, t1 - t0, bandwidth(matrix), n_sweeps, sweep_time(matrix, n_sweeps)))
+
+
+if __name__ == "__main__":
+    parser.add_argument('-n', '--n_size', type=int, default=300)
+    parser.add_argument('-s', '--n_sweeps', type=int, default=1000)
+    args = parser.parse_args()
+    measure(args.n_size, args.n_sweeps)
@@ -1,4 +1,7 @@
-from pyquboc import Array, Constraint, Placeholder
+import numpy as np
+
+from pyquboc import Array, Constraint, Placeholder, QuadraticForm
+from scipy.sparse import coo_matrix
 import logging
 import time
 import argparse
@@ -10,7 +13,7 @@ logging.basicConfig(level=logging.INFO)
 logger = logging.getLogger("benchmark_tsp")
 
 
-def tsp(n_city):
+def tsp(n_city, quadratic_form=False, compact=False):
     t0 = time.time()
     x = Array.create('c', (n_city, n_city), 'BINARY')
 
@@ -26,13 +29,22 @@ def tsp(n_city):
         city_const += Constraint((sum(x[i, j] for i in range(n_city)) - 1)**2, label="city{}".format(j))
 
     # distance of route
-    distance = 0.0
-    for i in range(n_city):
-        for j in range(n_city):
-            for k in range(n_city):
-                # we set the constant distance
-                d_ij = 10
-                distance += d_ij * x[k, i] * x[(k + 1) % n_city, j]
+    if quadratic_form:
+        # Build the same distance term as a coefficient matrix over the flattened variables.
+        k, i, j = np.meshgrid(np.arange(n_city), np.arange(n_city), np.arange(n_city), indexing='ij')
+        row = (k * n_city + i).ravel()
+        col = (((k + 1) % n_city) * n_city + j).ravel()
+        d = np.full(len(row), 10.0)
+        variables = [x[k, i] for k in range(n_city) for i in range(n_city)]
+        distance = QuadraticForm(coo_matrix((d, (row, col)), shape=(n_city ** 2, n_city ** 2)), variables)
+    else:
+        distance = 0.0
+        for i in range(n_city):
+            for j in range(n_city):
+                for k in range(n_city):
+                    # we set the constant distance
+                    d_ij = 10
+                    distance += d_ij * x[k, i] * x[(k + 1) % n_city, j]
 
     # Construct hamiltonian
     A = Placeholder("A")
@@ -40,16 +52,16 @@ def tsp(n_city):
 
     # Compile model
     t1 = time.time()
-    model = H.compile()
+    model = H.compile(compact=compact)
     qubo, offset = model.to_qubo(index_label=True, feed_dict={"A": 2.0})
     t2 = time.time()
 
     return t1 - t0, t2 - t1
 
 
-def measure(step, init_size, max_size):
+def measure(step, init_size, max_size, quadratic_form, compact):
     for n_city in range(init_size, max_size + step, step):
-        max_memory, (express_time, compile_time) = memory_usage((tsp, (n_city,)), max_usage=True, retval=True)
+        max_memory, (express_time, compile_time) = memory_usage((tsp, (n_city, quadratic_form, compact)), max_usage=True, retval=True)
         logger.info("Memory usage is {} MB for n_city={}".format(max_memory, n_city))
         logger.info("Elapsed time is {} sec (expression: {} sec, compile: {} sec), for n_city={}".format(express_time + compile_time, express_time, compile_time, n_city))
 
@@ -58,5 +70,7 @@ if __name__ == "__main__":
     parser.add_argument('-m', '--max_size', type=int)
     parser.add_argument('-i', '--init_size', type=int)
     parser.add_argument('-s', '--step', type=int)
+    parser.add_argument('-q', '--quadratic_form', action='store_true')
+    parser.add_argument('-c', '--compact', action='store_true')
     args = parser.parse_args()
-    measure(args.step, args.init_size, args.max_size)
+    measure(args.step, args.init_size, args.max_size, args.quadratic_form, args.compact)
@@ -1,16 +1,18 @@
-from cpp_pyquboc import Base, Binary, Spin, Placeholder, SubH, Constraint, WithPenalty, UserDefinedExpress, Num
+from cpp_pyquboc import Base, Binary, Spin, Placeholder, SubH, Constraint, WithPenalty, UserDefinedExpress, Num, QuadraticForm, LinearEquality, Polynomial, LogicGate, EncodedInteger, compile_many, parse_model, CompileLimitError, CompileTimeoutError, CompileCancelledError, ModelParseError
 
 from .array import Array
 from .logic import Not, And, Or, Xor
 from .logical_constraint import NotConst, AndConst, OrConst, XorConst
+from .linear_constraint import OneHot, KHot
 from .integer import Integer, IntegerWithPenalty, LogEncInteger, OneHotEncInteger, OrderEncInteger, UnaryEncInteger
 from .util import assert_qubo_equal
 
 __all__ = (
-    'Base', 'Binary', 'Spin', 'Placeholder', 'SubH', 'Constraint', 'WithPenalty', 'UserDefinedExpress', 'Num',
+    'Base', 'Binary', 'Spin', 'Placeholder', 'SubH', 'Constraint', 'WithPenalty', 'UserDefinedExpress', 'Num', 'QuadraticForm', 'LinearEquality', 'Polynomial', 'LogicGate', 'EncodedInteger', 'compile_many', 'parse_model', 'CompileLimitError', 'CompileTimeoutError', 'CompileCancelledError', 'ModelParseError',
     'Array',
     'Not', 'And', 'Or', 'Xor',
     'NotConst', 'AndConst', 'OrConst', 'XorConst',
+    'OneHot', 'KHot',
     'Integer', 'IntegerWithPenalty', 'LogEncInteger', 'OneHotEncInteger', 'OrderEncInteger', 'UnaryEncInteger',
     'assert_qubo_equal'
 )
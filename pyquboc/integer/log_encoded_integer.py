@@ -14,7 +14,7 @@
 
 import numpy as np
 
-from pyquboc import SubH
+from pyquboc import SubH, EncodedInteger
 from pyquboc.array import Array
 from pyquboc.integer import Integer
 
@@ -61,10 +61,7 @@ class LogEncInteger(Integer):
 
         self._num_variables = int(np.log2(span)) + 1
         self.array = Array.create(label, shape=self._num_variables, vartype='BINARY')
-        d = self._num_variables - 1
-        express = lower + sum(self.array[i] * 2 ** i for i in range(self._num_variables - 1))
-        express += (span - (2**d - 1)) * self.array[-1]
-        express = SubH(express, label)
+        express = SubH(EncodedInteger('log', self.array.bit_list, value_range), label)
 
         super().__init__(
             label=label,
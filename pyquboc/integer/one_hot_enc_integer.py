@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from pyquboc import Array, Constraint, SubH, Placeholder
+from pyquboc import Array, SubH, Placeholder, EncodedInteger, LinearEquality
 from pyquboc.integer.integer import IntegerWithPenalty
 
 
@@ -59,9 +59,9 @@ class OneHotEncInteger(IntegerWithPenalty):
 
         self._num_variables = (upper - lower + 1)
         self.array = Array.create(label, shape=self._num_variables, vartype='BINARY')
-        self.constraint = Constraint((sum(self.array) - 1) ** 2, label=label + "_const", condition=lambda x: x == 0)
+        self.constraint = LinearEquality([1.0] * self._num_variables, self.array.bit_list, 1.0, label + "_const")
 
-        express = SubH(lower + sum(i * x for i, x in enumerate(self.array)), label=label)
+        express = SubH(EncodedInteger('one_hot', self.array.bit_list, value_range), label=label)
         penalty = self.constraint * strength
 
         super().__init__(
@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from pyquboc import Placeholder, Constraint, SubH
+from pyquboc import Placeholder, Constraint, SubH, LogicGate, EncodedInteger
 from pyquboc.array import Array
 from pyquboc.integer import IntegerWithPenalty
 
@@ -68,10 +68,10 @@ class OrderEncInteger(IntegerWithPenalty):
             a = self.array[i]
             b = self.array[i + 1]
             const_label = label + "_order_" + str(i)
-            self.constraint += Constraint(b - a * b,
+            self.constraint += Constraint(LogicGate('imply_const', [b, a]),
                                           const_label, condition=lambda x: x == 0)
 
-        express = SubH(lower + sum(self.array), label=label)
+        express = SubH(EncodedInteger('order', self.array.bit_list, value_range), label=label)
         penalty = self.constraint * strength
 
         super().__init__(
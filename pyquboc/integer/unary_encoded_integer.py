@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from pyquboc import SubH
+from pyquboc import SubH, EncodedInteger
 from pyquboc.array import Array
 from pyquboc.integer import Integer
 
@@ -59,7 +59,7 @@ class UnaryEncInteger(Integer):
         self.upper = upper
         self._num_variables = (upper - lower)
         self.array = Array.create(label, shape=self._num_variables, vartype='BINARY')
-        express = SubH(lower + sum(self.array), label)
+        express = SubH(EncodedInteger('unary', self.array.bit_list, value_range), label)
 
         super().__init__(
             label=label,
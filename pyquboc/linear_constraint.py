@@ -0,0 +1,54 @@
+from cpp_pyquboc import LinearEquality
+
+
+class OneHot(LinearEquality):
+    """Constraint: exactly one of the variables is 1.
+
+    This is equivalent to ``Constraint((sum(variables) - 1) ** 2, label)``, but it is expanded analytically,
+    and :meth:`decode_sample` checks it with the linear form.
+
+    Args:
+        variables (list[:class:`Express`]): binary variables
+
+        label (str): label to identify the constraint
+
+    Examples:
+        >>> from pyquboc import OneHot, Array
+        >>> x = Array.create('x', shape=3, vartype='BINARY')
+        >>> model = OneHot(x, 'one_hot').compile()
+        >>> model.energy({'x[0]': 1, 'x[1]': 0, 'x[2]': 0}, vartype='BINARY')
+        0.0
+        >>> model.energy({'x[0]': 1, 'x[1]': 1, 'x[2]': 0}, vartype='BINARY')
+        1.0
+    """
+
+    def __init__(self, variables, label):
+        variables = list(variables)
+        super().__init__([1.0] * len(variables), variables, 1.0, label)
+
+
+class KHot(LinearEquality):
+    """Constraint: exactly k of the variables are 1.
+
+    This is equivalent to ``Constraint((sum(variables) - k) ** 2, label)``.
+
+    Args:
+        variables (list[:class:`Express`]): binary variables
+
+        k (int): number of variables to be 1
+
+        label (str): label to identify the constraint
+
+    Examples:
+        >>> from pyquboc import KHot, Array
+        >>> x = Array.create('x', shape=3, vartype='BINARY')
+        >>> model = KHot(x, 2, 'two_hot').compile()
+        >>> model.energy({'x[0]': 1, 'x[1]': 1, 'x[2]': 0}, vartype='BINARY')
+        0.0
+        >>> model.energy({'x[0]': 1, 'x[1]': 1, 'x[2]': 1}, vartype='BINARY')
+        1.0
+    """
+
+    def __init__(self, variables, k, label):
+        variables = list(variables)
+        super().__init__([1.0] * len(variables), variables, float(k), label)
@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from cpp_pyquboc import UserDefinedExpress
+from cpp_pyquboc import UserDefinedExpress, LogicGate
 
 
 class Not(UserDefinedExpress):
@@ -33,8 +33,7 @@ class Not(UserDefinedExpress):
     """
 
     def __init__(self, bit):
-        hamiltonian = 1 - bit
-        super().__init__(hamiltonian)
+        super().__init__(LogicGate('not', [bit]))
 
 
 class And(UserDefinedExpress):
@@ -60,8 +59,7 @@ class And(UserDefinedExpress):
     """
 
     def __init__(self, bit_a, bit_b):
-        hamiltonian = bit_a * bit_b
-        super().__init__(hamiltonian)
+        super().__init__(LogicGate('and', [bit_a, bit_b]))
 
 
 class Or(UserDefinedExpress):
@@ -87,8 +85,7 @@ class Or(UserDefinedExpress):
     """
 
     def __init__(self, bit_a, bit_b):
-        hamiltonian = Not(And(Not(bit_a), Not(bit_b)))
-        super().__init__(hamiltonian)
+        super().__init__(LogicGate('or', [bit_a, bit_b]))
 
 
 class Xor(UserDefinedExpress):
@@ -114,7 +111,4 @@ class Xor(UserDefinedExpress):
     """
 
     def __init__(self, bit_a, bit_b):
-        nand_ab = Not(And(bit_a, bit_b))
-        or_ab = Or(bit_a, bit_b)
-        hamiltonian = And(nand_ab, or_ab)
-        super().__init__(hamiltonian)
+        super().__init__(LogicGate('xor', [bit_a, bit_b]))
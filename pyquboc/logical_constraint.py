@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from cpp_pyquboc import SubH, Binary
+from cpp_pyquboc import SubH, Binary, LogicGate
 
 
 class NotConst(SubH):
@@ -41,8 +41,7 @@ class NotConst(SubH):
     """
 
     def __init__(self, a, b, label):
-        express = 2 * a * b - a - b + 1
-        super().__init__(express, label)
+        super().__init__(LogicGate('not_const', [a, b]), label)
 
 
 class AndConst(SubH):
@@ -73,8 +72,7 @@ class AndConst(SubH):
     """
 
     def __init__(self, a, b, c, label):
-        express = a * b - 2 * (a + b) * c + 3 * c
-        super().__init__(express, label)
+        super().__init__(LogicGate('and_const', [a, b, c]), label)
 
 
 class OrConst(SubH):
@@ -105,8 +103,7 @@ class OrConst(SubH):
     """
 
     def __init__(self, a, b, c, label):
-        express = a * b + (a + b) * (1 - 2 * c) + c
-        super().__init__(express, label)
+        super().__init__(LogicGate('or_const', [a, b, c]), label)
 
 
 class XorConst(SubH):
@@ -138,6 +135,4 @@ class XorConst(SubH):
 
     def __init__(self, a, b, c, label):
         aux = Binary("aux_" + label)
-        express = 2 * a * b - 2 * (a + b) * c - 4 * (a + b) * aux + 4 * aux * c + a + b + c + 4 * aux
-
-        super().__init__(express, label)
+        super().__init__(LogicGate('xor_const', [a, b, c, aux]), label)
@@ -45,6 +45,7 @@ class CMakeBuild(build_ext):
             "-DPYTHON_EXECUTABLE={}".format(sys.executable),
             "-DPYQUBOC_VERSION_INFO={}".format(self.distribution.get_version()),
             "-DCMAKE_BUILD_TYPE={}".format(cfg),  # not used on MSVC, but no harm
+            "-DPYQUBOC_BUILD_CLI=OFF",  # the wheel only needs the Python module
         ]
         build_args = []
 
@@ -1,18 +1,27 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <numeric>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include <boost/functional/hash.hpp>
 
+#include "symbol_table.hpp"
+
 namespace pyquboc {
   enum class expression_type {
     add_operator,
     mul_operator,
+    pow_operator,
     binary_variable,
     spin_variable,
     place_holder_variable,
@@ -20,7 +29,12 @@ namespace pyquboc {
     constraint,
     with_penalty,
     user_defined_expression,
-    numeric_literal
+    numeric_literal,
+    quadratic_form,
+    linear_equality,
+    coo_polynomial,
+    logic_gate,
+    encoded_integer
   };
 
   class expression {
@@ -154,25 +168,69 @@ namespace pyquboc {
     }
   };
 
+  class pow_operator final : public expression {
+    std::shared_ptr<const expression> _base;
+    int _exponent;
+
+  public:
+    pow_operator(const std::shared_ptr<const expression>& base, int exponent) noexcept : _base(base), _exponent(exponent) {
+      ;
+    }
+
+    const auto& base() const noexcept {
+      return _base;
+    }
+
+    auto exponent() const noexcept {
+      return _exponent;
+    }
+
+    pyquboc::expression_type expression_type() const noexcept override {
+      return expression_type::pow_operator;
+    }
+
+    std::string to_string() const noexcept override {
+      return "(" + _base->to_string() + " ** " + std::to_string(_exponent) + ")";
+    }
+
+    std::size_t hash() const noexcept override {
+      auto result = static_cast<std::size_t>(0);
+
+      boost::hash_combine(result, "**");
+      boost::hash_combine(result, std::hash<expression>()(*_base));
+      boost::hash_combine(result, _exponent);
+
+      return result;
+    }
+
+    bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
+      return expression::equals(other) && _exponent == std::static_pointer_cast<const pow_operator>(other)->_exponent && _base->equals(std::static_pointer_cast<const pow_operator>(other)->_base);
+    }
+  };
+
   class variable : public expression {
-    std::string _name;
+    int _id; // 名前はシンボル・テーブルに保存して、ここではIDだけを持ちます。
 
   protected:
-    variable(const std::string& name) noexcept : _name(name) {
+    variable(const std::string& name) noexcept : _id(symbol_table::instance().id(name)) {
       ;
     }
 
   public:
-    const auto& name() const noexcept {
-      return _name;
+    auto id() const noexcept {
+      return _id;
+    }
+
+    auto name() const noexcept {
+      return std::string(symbol_table::instance().name(_id));
     }
 
     std::size_t hash() const noexcept override {
-      return std::hash<std::string>()(_name);
+      return std::hash<std::string_view>()(symbol_table::instance().name(_id));
     }
 
     bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
-      return expression::equals(other) && _name == std::static_pointer_cast<const variable>(other)->_name;
+      return expression::equals(other) && _id == std::static_pointer_cast<const variable>(other)->_id;
     }
   };
 
@@ -401,6 +459,560 @@ namespace pyquboc {
     }
   };
 
+  class quadratic_form final : public expression {
+    std::vector<std::shared_ptr<const expression>> _variables;
+    std::vector<int> _rows;
+    std::vector<int> _columns;
+    std::vector<double> _coefficients;
+    std::vector<double> _linear;
+    double _offset;
+
+  public:
+    quadratic_form(const std::vector<std::shared_ptr<const expression>>& variables, const std::vector<int>& rows, const std::vector<int>& columns, const std::vector<double>& coefficients, const std::vector<double>& linear, double offset) noexcept : _variables(variables), _rows(rows), _columns(columns), _coefficients(coefficients), _linear(linear), _offset(offset) {
+      ;
+    }
+
+    const auto& variables() const noexcept {
+      return _variables;
+    }
+
+    const auto& rows() const noexcept {
+      return _rows;
+    }
+
+    const auto& columns() const noexcept {
+      return _columns;
+    }
+
+    const auto& coefficients() const noexcept {
+      return _coefficients;
+    }
+
+    const auto& linear() const noexcept {
+      return _linear;
+    }
+
+    auto offset() const noexcept {
+      return _offset;
+    }
+
+    pyquboc::expression_type expression_type() const noexcept override {
+      return expression_type::quadratic_form;
+    }
+
+    std::string to_string() const noexcept override {
+      return "QuadraticForm([" +
+             std::accumulate(std::begin(_variables), std::end(_variables), std::string(), [](const auto& acc, const auto& variable) {
+               return acc + (std::size(acc) > 0 ? ", " : "") + variable->to_string();
+             }) +
+             "], nnz=" + std::to_string(std::size(_coefficients)) + ", offset=" + std::to_string(_offset) + ")";
+    }
+
+    std::size_t hash() const noexcept override {
+      auto result = static_cast<std::size_t>(0);
+
+      boost::hash_combine(result, "quadratic_form");
+
+      for (const auto& variable : _variables) {
+        boost::hash_combine(result, std::hash<expression>()(*variable));
+      }
+
+      boost::hash_combine(result, boost::hash_range(std::begin(_rows), std::end(_rows)));
+      boost::hash_combine(result, boost::hash_range(std::begin(_columns), std::end(_columns)));
+      boost::hash_combine(result, boost::hash_range(std::begin(_coefficients), std::end(_coefficients)));
+      boost::hash_combine(result, boost::hash_range(std::begin(_linear), std::end(_linear)));
+      boost::hash_combine(result, _offset);
+
+      return result;
+    }
+
+    bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
+      if (!expression::equals(other)) {
+        return false;
+      }
+
+      const auto& other_quadratic_form = std::static_pointer_cast<const quadratic_form>(other);
+
+      if (std::size(_variables) != std::size(other_quadratic_form->_variables)) {
+        return false;
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(_variables)); ++i) {
+        if (!_variables[i]->equals(other_quadratic_form->_variables[i])) {
+          return false;
+        }
+      }
+
+      return _rows == other_quadratic_form->_rows && _columns == other_quadratic_form->_columns && _coefficients == other_quadratic_form->_coefficients && _linear == other_quadratic_form->_linear && _offset == other_quadratic_form->_offset;
+    }
+  };
+
+  // 係数が整数でなければ、満たしていても左辺と右辺は浮動小数点の誤差の分だけずれるので、差の絶対値がtolerance以下なら満たしているとします。
+
+  class linear_equality final : public variable {
+    std::vector<double> _coefficients;
+    std::vector<std::shared_ptr<const expression>> _variables;
+    double _rhs;
+    double _tolerance;
+
+  public:
+    linear_equality(const std::vector<double>& coefficients, const std::vector<std::shared_ptr<const expression>>& variables, double rhs, const std::string& name, double tolerance = 1e-9) noexcept : variable(name), _coefficients(coefficients), _variables(variables), _rhs(rhs), _tolerance(tolerance) {
+      ;
+    }
+
+    const auto& coefficients() const noexcept {
+      return _coefficients;
+    }
+
+    const auto& variables() const noexcept {
+      return _variables;
+    }
+
+    auto rhs() const noexcept {
+      return _rhs;
+    }
+
+    auto tolerance() const noexcept {
+      return _tolerance;
+    }
+
+    // 制約のエネルギーは差の2乗なので、toleranceの2乗と比べます。
+
+    auto condition() const {
+      return std::function<bool(double)>([tolerance = _tolerance](double x) { return x <= tolerance * tolerance; });
+    }
+
+    pyquboc::expression_type expression_type() const noexcept override {
+      return expression_type::linear_equality;
+    }
+
+    std::string to_string() const noexcept override {
+      auto result = std::string();
+
+      for (auto i = 0; i < static_cast<int>(std::size(_variables)); ++i) {
+        result += (std::size(result) > 0 ? " + " : "") + std::to_string(_coefficients[i]) + " * " + _variables[i]->to_string();
+      }
+
+      return "LinearEquality(" + result + " == " + std::to_string(_rhs) + ", '" + name() + "')";
+    }
+
+    std::size_t hash() const noexcept override {
+      auto result = variable::hash();
+
+      boost::hash_combine(result, "linear_equality");
+      boost::hash_combine(result, boost::hash_range(std::begin(_coefficients), std::end(_coefficients)));
+
+      for (const auto& variable : _variables) {
+        boost::hash_combine(result, std::hash<expression>()(*variable));
+      }
+
+      boost::hash_combine(result, _rhs);
+
+      return result;
+    }
+
+    bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
+      if (!variable::equals(other)) {
+        return false;
+      }
+
+      const auto& other_linear_equality = std::static_pointer_cast<const linear_equality>(other);
+
+      if (_coefficients != other_linear_equality->_coefficients || _rhs != other_linear_equality->_rhs || std::size(_variables) != std::size(other_linear_equality->_variables)) {
+        return false;
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(_variables)); ++i) {
+        if (!_variables[i]->equals(other_linear_equality->_variables[i])) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+  };
+
+  // 数値で与えられた多項式（HUBO）。i番目の項は、variables[indexes[indptr[i]]]からvariables[indexes[indptr[i + 1] - 1]]までの積にcoefficients[i]を掛けたものです（scipyのCSRと同じ形式）。
+  // 項ごとにmul_operatorやadd_operatorを作ると、数百万のノードを作って展開でまた潰すことになるので、配列のまま保持して展開で直接多項式に追加します。
+
+  class coo_polynomial final : public expression {
+    std::vector<std::shared_ptr<const expression>> _variables;
+    std::vector<std::int64_t> _indptr;
+    std::vector<int> _indexes;
+    std::vector<double> _coefficients;
+    double _offset;
+
+  public:
+    coo_polynomial(std::vector<std::shared_ptr<const expression>> variables, std::vector<std::int64_t> indptr, std::vector<int> indexes, std::vector<double> coefficients, double offset) noexcept : _variables(std::move(variables)), _indptr(std::move(indptr)), _indexes(std::move(indexes)), _coefficients(std::move(coefficients)), _offset(offset) {
+      ;
+    }
+
+    const auto& variables() const noexcept {
+      return _variables;
+    }
+
+    const auto& indptr() const noexcept {
+      return _indptr;
+    }
+
+    const auto& indexes() const noexcept {
+      return _indexes;
+    }
+
+    const auto& coefficients() const noexcept {
+      return _coefficients;
+    }
+
+    auto offset() const noexcept {
+      return _offset;
+    }
+
+    pyquboc::expression_type expression_type() const noexcept override {
+      return expression_type::coo_polynomial;
+    }
+
+    std::string to_string() const noexcept override {
+      return "Polynomial([" +
+             std::accumulate(std::begin(_variables), std::end(_variables), std::string(), [](const auto& acc, const auto& variable) {
+               return acc + (std::size(acc) > 0 ? ", " : "") + variable->to_string();
+             }) +
+             "], nnz=" + std::to_string(std::size(_coefficients)) + ", offset=" + std::to_string(_offset) + ")";
+    }
+
+    std::size_t hash() const noexcept override {
+      auto result = static_cast<std::size_t>(0);
+
+      boost::hash_combine(result, "coo_polynomial");
+
+      for (const auto& variable : _variables) {
+        boost::hash_combine(result, std::hash<expression>()(*variable));
+      }
+
+      boost::hash_combine(result, boost::hash_range(std::begin(_indptr), std::end(_indptr)));
+      boost::hash_combine(result, boost::hash_range(std::begin(_indexes), std::end(_indexes)));
+      boost::hash_combine(result, boost::hash_range(std::begin(_coefficients), std::end(_coefficients)));
+      boost::hash_combine(result, _offset);
+
+      return result;
+    }
+
+    bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
+      if (!expression::equals(other)) {
+        return false;
+      }
+
+      const auto& other_coo_polynomial = std::static_pointer_cast<const coo_polynomial>(other);
+
+      if (std::size(_variables) != std::size(other_coo_polynomial->_variables)) {
+        return false;
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(_variables)); ++i) {
+        if (!_variables[i]->equals(other_coo_polynomial->_variables[i])) {
+          return false;
+        }
+      }
+
+      return _indptr == other_coo_polynomial->_indptr && _indexes == other_coo_polynomial->_indexes && _coefficients == other_coo_polynomial->_coefficients && _offset == other_coo_polynomial->_offset;
+    }
+  };
+
+  // 論理ゲートと論理制約。展開すると、オペランドの積の線形結合（係数は固定）になります。
+  // Pythonで`Base`の演算を組み合わせると、ゲートごとにpybindをまたぐ一時オブジェクトがたくさんできて遅いので、ノード1つで表現します。
+  // 係数は、Pythonで組み立てていた式（logic.pyとlogical_constraint.py）を展開したものそのままです。Binary以外のオペランドでも、結果は変わりません。
+
+  enum class gate {
+    not_gate,
+    and_gate,
+    or_gate,
+    xor_gate,
+    not_constraint,   // Not(a) = b
+    and_constraint,   // And(a, b) = c
+    or_constraint,    // Or(a, b) = c
+    xor_constraint,   // Xor(a, b) = c（4番目のオペランドは補助変数）
+    imply_constraint  // a -> b（OrderEncIntegerの順序制約）
+  };
+
+  struct gate_term final {
+    std::vector<int> indexes; // オペランドのインデックス。空なら定数項です。
+    double coefficient;
+  };
+
+  inline auto to_gate(const std::string& name) {
+    static const auto gates = std::vector<std::pair<std::string, gate>>{{"not", gate::not_gate}, {"and", gate::and_gate}, {"or", gate::or_gate}, {"xor", gate::xor_gate}, {"not_const", gate::not_constraint}, {"and_const", gate::and_constraint}, {"or_const", gate::or_constraint}, {"xor_const", gate::xor_constraint}, {"imply_const", gate::imply_constraint}};
+
+    const auto it = std::find_if(std::begin(gates), std::end(gates), [&](const auto& pair) {
+      return pair.first == name;
+    });
+
+    if (it == std::end(gates)) {
+      throw std::runtime_error("invalid gate: " + name + ".");
+    }
+
+    return it->second;
+  }
+
+  class logic_gate final : public expression {
+    pyquboc::gate _gate;
+    std::vector<std::shared_ptr<const expression>> _operands;
+
+  public:
+    logic_gate(pyquboc::gate gate, std::vector<std::shared_ptr<const expression>> operands) noexcept : _gate(gate), _operands(std::move(operands)) {
+      ;
+    }
+
+    static auto arity(pyquboc::gate gate) noexcept {
+      switch (gate) {
+      case gate::not_gate:
+        return 1;
+      case gate::and_gate:
+      case gate::or_gate:
+      case gate::xor_gate:
+      case gate::not_constraint:
+      case gate::imply_constraint:
+        return 2;
+      case gate::and_constraint:
+      case gate::or_constraint:
+        return 3;
+      default:
+        return 4;
+      }
+    }
+
+    auto gate() const noexcept {
+      return _gate;
+    }
+
+    const auto& operands() const noexcept {
+      return _operands;
+    }
+
+    const std::vector<gate_term>& terms() const noexcept {
+      static const auto not_gate = std::vector<gate_term>{{{}, 1}, {{0}, -1}};                                                                                // 1 - a
+      static const auto and_gate = std::vector<gate_term>{{{0, 1}, 1}};                                                                                       // a * b
+      static const auto or_gate = std::vector<gate_term>{{{0}, 1}, {{1}, 1}, {{0, 1}, -1}};                                                                   // 1 - (1 - a) * (1 - b)
+      static const auto xor_gate = std::vector<gate_term>{{{0}, 1}, {{1}, 1}, {{0, 1}, -1}, {{0, 0, 1}, -1}, {{0, 1, 1}, -1}, {{0, 0, 1, 1}, 1}};             // (1 - a * b) * (a + b - a * b)
+      static const auto not_constraint = std::vector<gate_term>{{{0, 1}, 2}, {{0}, -1}, {{1}, -1}, {{}, 1}};                                                  // 2ab - a - b + 1
+      static const auto and_constraint = std::vector<gate_term>{{{0, 1}, 1}, {{0, 2}, -2}, {{1, 2}, -2}, {{2}, 3}};                                           // ab - 2(a + b)c + 3c
+      static const auto or_constraint = std::vector<gate_term>{{{0, 1}, 1}, {{0}, 1}, {{1}, 1}, {{0, 2}, -2}, {{1, 2}, -2}, {{2}, 1}};                        // ab + (a + b)(1 - 2c) + c
+      static const auto xor_constraint = std::vector<gate_term>{{{0, 1}, 2}, {{0, 2}, -2}, {{1, 2}, -2}, {{0, 3}, -4}, {{1, 3}, -4}, {{2, 3}, 4}, {{0}, 1}, {{1}, 1}, {{2}, 1}, {{3}, 4}}; // 2ab - 2(a + b)c - 4(a + b)aux + 4c * aux + a + b + c + 4aux
+      static const auto imply_constraint = std::vector<gate_term>{{{0}, 1}, {{0, 1}, -1}};                                                                    // a - ab
+
+      switch (_gate) {
+      case gate::not_gate:
+        return not_gate;
+      case gate::and_gate:
+        return and_gate;
+      case gate::or_gate:
+        return or_gate;
+      case gate::xor_gate:
+        return xor_gate;
+      case gate::not_constraint:
+        return not_constraint;
+      case gate::and_constraint:
+        return and_constraint;
+      case gate::or_constraint:
+        return or_constraint;
+      case gate::xor_constraint:
+        return xor_constraint;
+      default:
+        return imply_constraint;
+      }
+    }
+
+    pyquboc::expression_type expression_type() const noexcept override {
+      return expression_type::logic_gate;
+    }
+
+    std::string to_string() const noexcept override {
+      static const auto names = std::vector<std::string>{"Not", "And", "Or", "Xor", "NotConst", "AndConst", "OrConst", "XorConst", "ImplyConst"};
+
+      return names[static_cast<int>(_gate)] + "(" +
+             std::accumulate(std::begin(_operands), std::end(_operands), std::string(), [](const auto& acc, const auto& operand) {
+               return acc + (std::size(acc) > 0 ? ", " : "") + operand->to_string();
+             }) +
+             ")";
+    }
+
+    std::size_t hash() const noexcept override {
+      auto result = static_cast<std::size_t>(0);
+
+      boost::hash_combine(result, "logic_gate");
+      boost::hash_combine(result, static_cast<int>(_gate));
+
+      for (const auto& operand : _operands) {
+        boost::hash_combine(result, std::hash<expression>()(*operand));
+      }
+
+      return result;
+    }
+
+    bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
+      if (!expression::equals(other)) {
+        return false;
+      }
+
+      const auto& other_logic_gate = std::static_pointer_cast<const logic_gate>(other);
+
+      if (_gate != other_logic_gate->_gate || std::size(_operands) != std::size(other_logic_gate->_operands)) {
+        return false;
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(_operands)); ++i) {
+        if (!_operands[i]->equals(other_logic_gate->_operands[i])) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+  };
+
+  // 整数のエンコーディング。lower + sum(weights[i] * variables[i])で、重みはエンコーディングと値の範囲から決まります。
+
+  enum class encoding {
+    log,     // 2^iで、最後の変数は上限を超えないように調整します。
+    one_hot, // i
+    order,   // 1
+    unary    // 1
+  };
+
+  inline auto to_encoding(const std::string& name) {
+    if (name == "log") {
+      return encoding::log;
+    }
+
+    if (name == "one_hot") {
+      return encoding::one_hot;
+    }
+
+    if (name == "order") {
+      return encoding::order;
+    }
+
+    if (name == "unary") {
+      return encoding::unary;
+    }
+
+    throw std::runtime_error("`encoding` should be 'log', 'one_hot', 'order' or 'unary'.");
+  }
+
+  class encoded_integer final : public expression {
+    pyquboc::encoding _encoding;
+    std::vector<std::shared_ptr<const expression>> _variables;
+    int _lower;
+    int _upper;
+    std::vector<double> _weights;
+
+  public:
+    encoded_integer(pyquboc::encoding encoding, std::vector<std::shared_ptr<const expression>> variables, int lower, int upper) noexcept : _encoding(encoding), _variables(std::move(variables)), _lower(lower), _upper(upper), _weights(variable_count(encoding, lower, upper)) {
+      const auto span = static_cast<std::int64_t>(upper) - lower;
+
+      for (auto i = 0; i < static_cast<int>(std::size(_weights)); ++i) {
+        switch (encoding) {
+        case encoding::log:
+          _weights[i] = i < static_cast<int>(std::size(_weights)) - 1 ? static_cast<double>(std::int64_t{1} << i) : static_cast<double>(span - ((std::int64_t{1} << i) - 1));
+          break;
+        case encoding::one_hot:
+          _weights[i] = i;
+          break;
+        default:
+          _weights[i] = 1;
+        }
+      }
+    }
+
+    static int variable_count(pyquboc::encoding encoding, int lower, int upper) noexcept {
+      const auto span = static_cast<std::int64_t>(upper) - lower;
+
+      switch (encoding) {
+      case encoding::log: {
+        auto result = 0;
+
+        for (auto rest = span; rest > 0; rest >>= 1) { // int(log2(span)) + 1
+          ++result;
+        }
+
+        return result;
+      }
+      case encoding::one_hot:
+        return static_cast<int>(span + 1);
+      default:
+        return static_cast<int>(span);
+      }
+    }
+
+    auto encoding() const noexcept {
+      return _encoding;
+    }
+
+    const auto& variables() const noexcept {
+      return _variables;
+    }
+
+    auto lower() const noexcept {
+      return _lower;
+    }
+
+    auto upper() const noexcept {
+      return _upper;
+    }
+
+    const auto& weights() const noexcept {
+      return _weights;
+    }
+
+    pyquboc::expression_type expression_type() const noexcept override {
+      return expression_type::encoded_integer;
+    }
+
+    std::string to_string() const noexcept override {
+      static const auto names = std::vector<std::string>{"log", "one_hot", "order", "unary"};
+
+      return "EncodedInteger('" + names[static_cast<int>(_encoding)] + "', [" +
+             std::accumulate(std::begin(_variables), std::end(_variables), std::string(), [](const auto& acc, const auto& variable) {
+               return acc + (std::size(acc) > 0 ? ", " : "") + variable->to_string();
+             }) +
+             "], value_range=(" + std::to_string(_lower) + ", " + std::to_string(_upper) + "))";
+    }
+
+    std::size_t hash() const noexcept override {
+      auto result = static_cast<std::size_t>(0);
+
+      boost::hash_combine(result, "encoded_integer");
+      boost::hash_combine(result, static_cast<int>(_encoding));
+
+      for (const auto& variable : _variables) {
+        boost::hash_combine(result, std::hash<expression>()(*variable));
+      }
+
+      boost::hash_combine(result, _lower);
+      boost::hash_combine(result, _upper);
+
+      return result;
+    }
+
+    bool equals(const std::shared_ptr<const expression>& other) const noexcept override {
+      if (!expression::equals(other)) {
+        return false;
+      }
+
+      const auto& other_encoded_integer = std::static_pointer_cast<const encoded_integer>(other);
+
+      if (_encoding != other_encoded_integer->_encoding || _lower != other_encoded_integer->_lower || _upper != other_encoded_integer->_upper || std::size(_variables) != std::size(other_encoded_integer->_variables)) {
+        return false;
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(_variables)); ++i) {
+        if (!_variables[i]->equals(other_encoded_integer->_variables[i])) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+  };
+
   inline std::shared_ptr<const expression> operator+(const std::shared_ptr<const expression>& lhs, const std::shared_ptr<const expression>& rhs) noexcept {
     if (lhs->expression_type() == expression_type::numeric_literal && rhs->expression_type() == expression_type::numeric_literal) {
       return std::make_shared<numeric_literal>(std::static_pointer_cast<const numeric_literal>(lhs)->value() + std::static_pointer_cast<const numeric_literal>(rhs)->value());
@@ -433,38 +1045,70 @@ namespace pyquboc {
     return std::make_shared<const mul_operator>(lhs, rhs);
   }
 
-  template <typename Result, typename Functor>
-  Result visit(Functor& functor, const std::shared_ptr<const expression>& expression) noexcept {
+  inline std::shared_ptr<const expression> pow(const std::shared_ptr<const expression>& base, int exponent) noexcept {
+    if (base->expression_type() == expression_type::numeric_literal) {
+      return std::make_shared<numeric_literal>(std::pow(std::static_pointer_cast<const numeric_literal>(base)->value(), exponent));
+    }
+
+    if (exponent == 1) {
+      return base;
+    }
+
+    return std::make_shared<const pow_operator>(base, exponent);
+  }
+
+  // argumentsは、そのままfunctorに渡します（展開先の多項式など）。
+
+  template <typename Result, typename Functor, typename... Arguments>
+  Result visit(Functor& functor, const std::shared_ptr<const expression>& expression, Arguments&&... arguments) {
     switch (expression->expression_type()) {
     case expression_type::add_operator:
-      return functor(std::static_pointer_cast<const add_operator>(expression));
+      return functor(std::static_pointer_cast<const add_operator>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::mul_operator:
-      return functor(std::static_pointer_cast<const mul_operator>(expression));
+      return functor(std::static_pointer_cast<const mul_operator>(expression), std::forward<Arguments>(arguments)...);
+
+    case expression_type::pow_operator:
+      return functor(std::static_pointer_cast<const pow_operator>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::binary_variable:
-      return functor(std::static_pointer_cast<const binary_variable>(expression));
+      return functor(std::static_pointer_cast<const binary_variable>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::spin_variable:
-      return functor(std::static_pointer_cast<const spin_variable>(expression));
+      return functor(std::static_pointer_cast<const spin_variable>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::place_holder_variable:
-      return functor(std::static_pointer_cast<const placeholder_variable>(expression));
+      return functor(std::static_pointer_cast<const placeholder_variable>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::sub_hamiltonian:
-      return functor(std::static_pointer_cast<const sub_hamiltonian>(expression));
+      return functor(std::static_pointer_cast<const sub_hamiltonian>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::constraint:
-      return functor(std::static_pointer_cast<const constraint>(expression));
+      return functor(std::static_pointer_cast<const constraint>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::with_penalty:
-      return functor(std::static_pointer_cast<const with_penalty>(expression));
+      return functor(std::static_pointer_cast<const with_penalty>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::user_defined_expression:
-      return functor(std::static_pointer_cast<const user_defined_expression>(expression));
+      return functor(std::static_pointer_cast<const user_defined_expression>(expression), std::forward<Arguments>(arguments)...);
 
     case expression_type::numeric_literal:
-      return functor(std::static_pointer_cast<const numeric_literal>(expression));
+      return functor(std::static_pointer_cast<const numeric_literal>(expression), std::forward<Arguments>(arguments)...);
+
+    case expression_type::quadratic_form:
+      return functor(std::static_pointer_cast<const quadratic_form>(expression), std::forward<Arguments>(arguments)...);
+
+    case expression_type::linear_equality:
+      return functor(std::static_pointer_cast<const linear_equality>(expression), std::forward<Arguments>(arguments)...);
+
+    case expression_type::coo_polynomial:
+      return functor(std::static_pointer_cast<const coo_polynomial>(expression), std::forward<Arguments>(arguments)...);
+
+    case expression_type::logic_gate:
+      return functor(std::static_pointer_cast<const logic_gate>(expression), std::forward<Arguments>(arguments)...);
+
+    case expression_type::encoded_integer:
+      return functor(std::static_pointer_cast<const encoded_integer>(expression), std::forward<Arguments>(arguments)...);
 
     default:
       throw std::runtime_error("invalid expression type."); // ここには絶対に来ないはず。
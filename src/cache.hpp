@@ -0,0 +1,487 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <robin_hood.h>
+
+#include "abstract_syntax_tree.hpp"
+#include "compiler.hpp"
+#include "model.hpp"
+#include "serialization.hpp"
+
+namespace pyquboc {
+  // Fingerprint.
+
+  // 式の構造から、128bitのハッシュを計算します。expression::hash()はstd::hashを使っていて実行のたびに同じ値になるとは限らないので、キャッシュのキーには使えません。
+  // 同じノードが何度も出てくる場合は、一度だけ計算します。
+
+  class stable_hasher final {
+    std::uint64_t _hash_1;
+    std::uint64_t _hash_2;
+
+  public:
+    stable_hasher() noexcept : _hash_1(0xcbf29ce484222325), _hash_2(0x9e3779b97f4a7c15) {
+      ;
+    }
+
+    auto add(const void* data, std::size_t size) noexcept {
+      const auto bytes = static_cast<const unsigned char*>(data);
+
+      for (auto i = std::size_t{0}; i < size; ++i) {
+        _hash_1 = (_hash_1 ^ bytes[i]) * 0x100000001b3;                                         // FNV-1a
+        _hash_2 = ((_hash_2 ^ bytes[i]) << 5 | (_hash_2 ^ bytes[i]) >> 59) * 0x9e3779b97f4a7c15; // 2つ目は、FNVとは別の混ぜ方にします。
+      }
+    }
+
+    template <typename T>
+    auto add(const T& value) noexcept {
+      static_assert(std::is_trivially_copyable_v<T>);
+
+      add(&value, sizeof(T));
+    }
+
+    auto add(const std::string& value) noexcept {
+      add(static_cast<std::uint64_t>(std::size(value)));
+      add(std::data(value), std::size(value));
+    }
+
+    template <typename T>
+    auto add(const std::vector<T>& values) noexcept {
+      add(static_cast<std::uint64_t>(std::size(values)));
+      add(std::data(values), std::size(values) * sizeof(T));
+    }
+
+    auto digest() const noexcept {
+      return std::pair{_hash_1, _hash_2};
+    }
+
+    auto hex_digest() const noexcept {
+      auto stream = std::ostringstream();
+
+      stream << std::hex << std::setfill('0') << std::setw(16) << _hash_1 << std::setw(16) << _hash_2;
+
+      return stream.str();
+    }
+  };
+
+  class fingerprint final {
+    using digest = std::pair<std::uint64_t, std::uint64_t>;
+
+    robin_hood::unordered_map<const expression*, digest> _digests;
+
+    auto add(stable_hasher& hasher, const std::shared_ptr<const expression>& expression) noexcept {
+      const auto [hash_1, hash_2] = (*this)(expression);
+
+      hasher.add(hash_1);
+      hasher.add(hash_2);
+    }
+
+    static auto hasher(const std::shared_ptr<const expression>& expression) noexcept {
+      auto result = stable_hasher();
+
+      result.add(static_cast<std::uint8_t>(expression->expression_type()));
+
+      return result;
+    }
+
+  public:
+    digest operator()(const std::shared_ptr<const expression>& expression) noexcept {
+      const auto it = _digests.find(expression.get());
+
+      if (it != std::end(_digests)) {
+        return it->second;
+      }
+
+      const auto result = visit<digest>(*this, expression);
+
+      _digests.emplace(expression.get(), result);
+
+      return result;
+    }
+
+    digest operator()(const std::shared_ptr<const add_operator>& add_operator) noexcept {
+      auto result = hasher(add_operator);
+
+      result.add(static_cast<std::uint64_t>(std::size(add_operator->children())));
+
+      for (const auto& child : add_operator->children()) {
+        add(result, child);
+      }
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const mul_operator>& mul_operator) noexcept {
+      auto result = hasher(mul_operator);
+
+      add(result, mul_operator->lhs());
+      add(result, mul_operator->rhs());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const pow_operator>& pow_operator) noexcept {
+      auto result = hasher(pow_operator);
+
+      add(result, pow_operator->base());
+      result.add(static_cast<std::int32_t>(pow_operator->exponent()));
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const binary_variable>& binary_variable) noexcept {
+      auto result = hasher(binary_variable);
+
+      result.add(binary_variable->name());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const spin_variable>& spin_variable) noexcept {
+      auto result = hasher(spin_variable);
+
+      result.add(spin_variable->name());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const placeholder_variable>& place_holder_variable) noexcept {
+      auto result = hasher(place_holder_variable);
+
+      result.add(place_holder_variable->name());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const sub_hamiltonian>& sub_hamiltonian) noexcept {
+      auto result = hasher(sub_hamiltonian);
+
+      result.add(sub_hamiltonian->name());
+      add(result, sub_hamiltonian->expression());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const constraint>& constraint) noexcept {
+      auto result = hasher(constraint);
+
+      result.add(constraint->name()); // conditionは関数なのでハッシュできません。conditionはモデルの多項式には影響しないので、読み込むときに付け直します。
+      add(result, constraint->expression());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const with_penalty>& with_penalty) noexcept {
+      auto result = hasher(with_penalty);
+
+      result.add(with_penalty->name());
+      add(result, with_penalty->expression());
+      add(result, with_penalty->penalty());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) noexcept {
+      auto result = hasher(user_defined_expression);
+
+      add(result, user_defined_expression->expression());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const numeric_literal>& numeric_literal) noexcept {
+      auto result = hasher(numeric_literal);
+
+      result.add(numeric_literal->value());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const quadratic_form>& quadratic_form) noexcept {
+      auto result = hasher(quadratic_form);
+
+      result.add(static_cast<std::uint64_t>(std::size(quadratic_form->variables())));
+
+      for (const auto& variable : quadratic_form->variables()) {
+        add(result, variable);
+      }
+
+      result.add(quadratic_form->rows());
+      result.add(quadratic_form->columns());
+      result.add(quadratic_form->coefficients());
+      result.add(quadratic_form->linear());
+      result.add(quadratic_form->offset());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const linear_equality>& linear_equality) noexcept {
+      auto result = hasher(linear_equality);
+
+      result.add(linear_equality->name());
+      result.add(linear_equality->coefficients());
+      result.add(static_cast<std::uint64_t>(std::size(linear_equality->variables())));
+
+      for (const auto& variable : linear_equality->variables()) {
+        add(result, variable);
+      }
+
+      result.add(linear_equality->rhs());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const coo_polynomial>& coo_polynomial) noexcept {
+      auto result = hasher(coo_polynomial);
+
+      result.add(static_cast<std::uint64_t>(std::size(coo_polynomial->variables())));
+
+      for (const auto& variable : coo_polynomial->variables()) {
+        add(result, variable);
+      }
+
+      result.add(coo_polynomial->indptr());
+      result.add(coo_polynomial->indexes());
+      result.add(coo_polynomial->coefficients());
+      result.add(coo_polynomial->offset());
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const logic_gate>& logic_gate) noexcept {
+      auto result = hasher(logic_gate);
+
+      result.add(static_cast<std::uint8_t>(logic_gate->gate()));
+      result.add(static_cast<std::uint64_t>(std::size(logic_gate->operands())));
+
+      for (const auto& operand : logic_gate->operands()) {
+        add(result, operand);
+      }
+
+      return result.digest();
+    }
+
+    digest operator()(const std::shared_ptr<const encoded_integer>& encoded_integer) noexcept {
+      auto result = hasher(encoded_integer);
+
+      result.add(static_cast<std::uint8_t>(encoded_integer->encoding()));
+      result.add(static_cast<std::uint64_t>(std::size(encoded_integer->variables())));
+
+      for (const auto& variable : encoded_integer->variables()) {
+        add(result, variable);
+      }
+
+      result.add(static_cast<std::int32_t>(encoded_integer->lower()));
+      result.add(static_cast<std::int32_t>(encoded_integer->upper()));
+
+      return result.digest();
+    }
+  };
+
+  // キャッシュから読み込んだモデルに付け直すために、ConstraintとLinearEqualityのconditionをラベルごとに集めます。展開と同じで、同じラベルの場合は最初のものを使います。
+
+  class collect_conditions final {
+    robin_hood::unordered_map<std::string, std::function<bool(double)>> _conditions;
+    robin_hood::unordered_map<const expression*, bool> _visited;
+
+    auto collect(const std::shared_ptr<const expression>& expression) noexcept {
+      if (_visited.emplace(expression.get(), true).second) {
+        visit<void>(*this, expression);
+      }
+    }
+
+  public:
+    auto operator()(const std::shared_ptr<const expression>& expression) noexcept {
+      _conditions = {};
+      _visited = {};
+
+      collect(expression);
+
+      _visited = {};
+
+      return std::move(_conditions);
+    }
+
+    auto operator()(const std::shared_ptr<const add_operator>& add_operator) noexcept {
+      for (const auto& child : add_operator->children()) {
+        collect(child);
+      }
+    }
+
+    auto operator()(const std::shared_ptr<const mul_operator>& mul_operator) noexcept {
+      collect(mul_operator->lhs());
+      collect(mul_operator->rhs());
+    }
+
+    auto operator()(const std::shared_ptr<const pow_operator>& pow_operator) noexcept {
+      collect(pow_operator->base());
+    }
+
+    auto operator()(const std::shared_ptr<const binary_variable>&) noexcept {
+      ;
+    }
+
+    auto operator()(const std::shared_ptr<const spin_variable>&) noexcept {
+      ;
+    }
+
+    auto operator()(const std::shared_ptr<const placeholder_variable>&) noexcept {
+      ;
+    }
+
+    auto operator()(const std::shared_ptr<const sub_hamiltonian>& sub_hamiltonian) noexcept {
+      collect(sub_hamiltonian->expression());
+    }
+
+    auto operator()(const std::shared_ptr<const constraint>& constraint) noexcept {
+      collect(constraint->expression());
+
+      _conditions.emplace(constraint->name(), constraint->condition()); // 展開では子の後で記録するので、それに合わせます。
+    }
+
+    auto operator()(const std::shared_ptr<const with_penalty>& with_penalty) noexcept {
+      collect(with_penalty->expression());
+      collect(with_penalty->penalty());
+    }
+
+    auto operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) noexcept {
+      collect(user_defined_expression->expression());
+    }
+
+    auto operator()(const std::shared_ptr<const numeric_literal>&) noexcept {
+      ;
+    }
+
+    auto operator()(const std::shared_ptr<const quadratic_form>& quadratic_form) noexcept {
+      for (const auto& variable : quadratic_form->variables()) {
+        collect(variable);
+      }
+    }
+
+    auto operator()(const std::shared_ptr<const linear_equality>& linear_equality) noexcept {
+      for (const auto& variable : linear_equality->variables()) {
+        collect(variable);
+      }
+
+      _conditions.emplace(linear_equality->name(), linear_equality->condition());
+    }
+
+    auto operator()(const std::shared_ptr<const coo_polynomial>& coo_polynomial) noexcept {
+      for (const auto& variable : coo_polynomial->variables()) {
+        collect(variable);
+      }
+    }
+
+    auto operator()(const std::shared_ptr<const logic_gate>& logic_gate) noexcept {
+      for (const auto& operand : logic_gate->operands()) {
+        collect(operand);
+      }
+    }
+
+    auto operator()(const std::shared_ptr<const encoded_integer>& encoded_integer) noexcept {
+      for (const auto& variable : encoded_integer->variables()) {
+        collect(variable);
+      }
+    }
+  };
+
+  // Compile with cache.
+
+  // キャッシュのファイル名は、式の構造とコンパイルの引数とライブラリのバージョンのハッシュです。
+  // 書き込みは一時ファイルに書いてからリネームするので、複数のプロセスが同時に使っても、書きかけのファイルを読むことはありません。
+
+  inline auto cache_key(const std::shared_ptr<const expression>& expression, double strength, pyquboc::quadratization quadratization, bool quadratize, pyquboc::domain domain, const std::string& version) noexcept {
+    const auto [hash_1, hash_2] = fingerprint()(expression);
+
+    auto hasher = stable_hasher();
+
+    hasher.add(hash_1);
+    hasher.add(hash_2);
+    hasher.add(strength);
+    hasher.add(static_cast<std::uint8_t>(quadratization));
+    hasher.add(static_cast<std::uint8_t>(quadratize));
+    hasher.add(static_cast<std::uint8_t>(domain));
+    hasher.add(version);
+    hasher.add(serialization_format_version);
+
+    return hasher.hex_digest();
+  }
+
+  inline model compile_with_cache(const std::shared_ptr<const expression>& expression, double strength, pyquboc::quadratization quadratization, bool compact, bool quadratize, pyquboc::domain domain, const std::string& cache_directory, const std::string& version, const compile_options& options = {}) {
+    const auto key = cache_key(expression, strength, quadratization, quadratize, domain, version);
+    const auto path = std::filesystem::path(cache_directory) / (key + ".model");
+
+    const auto conditions = collect_conditions()(expression);
+    const auto condition = [&](const std::string& name) -> std::function<bool(double)> {
+      const auto it = conditions.find(name);
+
+      return it != std::end(conditions) ? it->second : [](double x) { return x == 0; };
+    };
+
+    if (auto stream = std::ifstream(path, std::ios::binary)) {
+      try {
+        auto result = load_model(stream, condition);
+
+        if (compact) {
+          result.compact();
+        }
+
+        return result;
+      } catch (const std::exception&) {
+        ; // 壊れていたり形式が古かったりする場合は、コンパイルしなおして上書きします。
+      }
+    }
+
+    auto result = compile(expression, strength, quadratization, false, quadratize, domain, options);
+
+    const auto temporary_path = [&] {
+      auto stream = std::ostringstream();
+
+      stream << key << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << "." << std::random_device()() << ".tmp";
+
+      return std::filesystem::path(cache_directory) / stream.str();
+    }();
+
+    try {
+      std::filesystem::create_directories(cache_directory);
+
+      {
+        auto stream = std::ofstream(temporary_path, std::ios::binary);
+
+        save_model(result, stream);
+
+        stream.close(); // 書き込みに失敗した（ディスクが一杯など）ファイルを、キャッシュとして公開しないように、閉じてから調べます。
+
+        if (!stream) {
+          throw std::runtime_error("failed to write '" + temporary_path.string() + "'.");
+        }
+      }
+
+      std::filesystem::rename(temporary_path, path);
+    } catch (const std::exception&) {
+      auto error_code = std::error_code();
+
+      std::filesystem::remove(temporary_path, error_code); // キャッシュに書き込めなくても、コンパイル結果は返します。
+    }
+
+    if (compact) {
+      result.compact();
+    }
+
+    return result;
+  }
+}
@@ -1,136 +1,726 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <numeric>
 #include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <robin_hood.h>
 
 #include "abstract_syntax_tree.hpp"
 #include "model.hpp"
+#include "thread_pool.hpp"
 
 namespace pyquboc {
+  // Compile options.
+
+  // 多項式の1項あたりのメモリの見積もり（バイト）です。項、係数の式、ハッシュ表の分で、計測した値を丸めています。3次以上の項は、変数のインデックスを別に確保します。
+
+  inline auto estimated_term_bytes(int degree) noexcept {
+    return degree <= 2 ? 144.0 : 160.0 + 4.0 * degree;
+  }
+
+  enum class compile_phase {
+    expand,     // 式を多項式に展開しています。
+    quadratize, // 2次に変換しています。
+    build       // モデルを作っています。
+  };
+
+  inline auto to_string(compile_phase phase) noexcept {
+    switch (phase) {
+    case compile_phase::expand:
+      return "expand";
+
+    case compile_phase::quadratize:
+      return "quadratize";
+
+    default:
+      return "build";
+    }
+  }
+
+  struct compile_progress final {
+    compile_phase phase;
+    double fraction; // その段階の進み具合（0〜1）です。だいたいの値ですけど、同じ段階の中では減りません。
+    std::size_t term_count; // 作成中の多項式の項の数です。
+    std::size_t variable_count;
+    double elapsed; // コンパイルを始めてからの秒数です。
+  };
+
+  // time_limitを過ぎた場合の例外と、cancelledで中断した場合の例外です。
+
+  class compile_timeout_error final : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  class compile_cancelled_error final : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // 巨大な式でメモリを使い果たさないように、展開中の多項式の大きさを制限します。max_memoryは、estimated_term_bytesで項の数に換算します。
+  // 時間のかかるコンパイル向けに、制限時間（秒）と、進捗の通知（progress_interval秒ごと）と、中断（cancelledをtrueにするか、interruptで例外を投げる）もできます。
+  // progressとinterruptは、コンパイルしているスレッドから呼び出されます。例外を投げると、コンパイルを中断してその例外を投げ直します。
+
+  struct compile_options final {
+    std::size_t max_terms = std::numeric_limits<std::size_t>::max();
+    std::size_t max_memory = std::numeric_limits<std::size_t>::max();
+    std::optional<double> time_limit = std::nullopt; // -Ofastでは無限大を扱えないので、制限なしはstd::nulloptで表します。
+    std::function<void(const compile_progress&)> progress = nullptr;
+    double progress_interval = 0.1;
+    std::function<void()> interrupt = nullptr; // Ctrl-Cを調べるなど、interrupt_interval秒ごとに呼び出します。
+    double interrupt_interval = 0.01;
+    std::shared_ptr<const std::atomic<bool>> cancelled = nullptr;
+
+    auto max_term_count() const noexcept {
+      return std::min(max_terms, static_cast<std::size_t>(static_cast<double>(max_memory) / estimated_term_bytes(2)));
+    }
+
+    auto to_string() const {
+      return "max_terms=" + (max_terms != std::numeric_limits<std::size_t>::max() ? std::to_string(max_terms) : "None") + ", max_memory=" + (max_memory != std::numeric_limits<std::size_t>::max() ? std::to_string(max_memory) : "None");
+    }
+  };
+
+  // Compile monitor.
+
+  // コンパイルの展開や2次への変換のループの中から呼び出されて、項の数や時間の制限、中断を調べたり、進捗を通知したりします。コンパイル1回ごとに作ります。
+  // 進捗は、ループのi / n番目を処理している間は、今の範囲をn等分したi番目の範囲にいるとして計算します（part）。入れ子になっても大丈夫です。
+  // 時間を使うオプションがなければ、時計は読みません。Pythonのcompileは、Ctrl-Cを調べるためにいつもinterruptを設定するので、pollでは時計をclock_interval回に1回だけ読みます。
+
+  class compile_monitor final {
+    using clock = std::chrono::steady_clock;
+
+    static constexpr auto clock_interval = 16;
+
+    const compile_options& _options;
+    std::size_t _max_term_count;
+    bool _timed;
+    int _polls; // 前に時計を読んでからのpollの回数。
+    clock::time_point _start;
+    clock::time_point _next_progress;
+    clock::time_point _next_interrupt;
+    const pyquboc::variables* _variables;
+    std::size_t _variable_count;
+    compile_phase _phase;
+    double _range_begin;
+    double _range_width;
+    double _position;
+    std::size_t _term_count;
+
+    static auto after(clock::time_point time_point, double seconds) noexcept {
+      return seconds < std::chrono::duration<double>(clock::time_point::max() - time_point).count() ? time_point + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds)) : clock::time_point::max();
+    }
+
+    auto report(clock::time_point now) {
+      _next_progress = after(now, _options.progress_interval);
+
+      _options.progress(compile_progress{_phase, _position, _term_count, _variables ? std::size(*_variables) : _variable_count, std::chrono::duration<double>(now - _start).count()});
+    }
+
+  public:
+    compile_monitor(const compile_options& options) noexcept : _options(options), _max_term_count(options.max_term_count()), _timed(options.time_limit || options.progress || options.interrupt), _polls(0), _start(clock::now()), _next_progress(_start), _next_interrupt(_start), _variables(nullptr), _variable_count(0), _phase(compile_phase::expand), _range_begin(0), _range_width(1), _position(0), _term_count(0) {
+      ;
+    }
+
+    compile_monitor(const compile_monitor&) = delete;
+    compile_monitor& operator=(const compile_monitor&) = delete;
+
+    const auto& options() const noexcept {
+      return _options;
+    }
+
+    // 変数の数を数えるvariablesです。nullptrにした後は、最後に数えた変数の数を通知します。
+
+    auto variables(const pyquboc::variables* variables) noexcept {
+      if (_variables) {
+        _variable_count = std::size(*_variables);
+      }
+
+      _variables = variables;
+    }
+
+    // 段階が変わったら呼び出します。進捗は、間隔に関係なく通知します。
+
+    auto phase(compile_phase phase, std::size_t term_count) {
+      _phase = phase;
+      _range_begin = 0;
+      _range_width = 1;
+      _position = 0;
+      _term_count = term_count;
+
+      if (_options.progress) {
+        report(clock::now());
+      }
+    }
+
+    // 最後の段階が終わったら呼び出します。
+
+    auto finish(std::size_t term_count) {
+      _position = 1;
+      _term_count = term_count;
+
+      if (_options.progress) {
+        report(clock::now());
+      }
+    }
+
+    // 今の範囲を、n等分したi番目の範囲でfunctionを実行します。
+
+    template <typename Function>
+    auto part(std::size_t i, std::size_t n, Function&& function) {
+      const auto range_begin = _range_begin;
+      const auto range_width = _range_width;
+
+      _range_begin = range_begin + range_width * i / n;
+      _range_width = range_width / n;
+      _position = std::max(_position, _range_begin);
+
+      function();
+
+      _range_begin = range_begin;
+      _range_width = range_width;
+      _position = std::max(_position, range_begin + range_width * (i + 1) / n);
+    }
+
+    // 次のpollで進捗を通知するかどうかです。進み具合の計算に時間がかかる場合に、使ってください。
+
+    auto progress_due() const noexcept {
+      return _options.progress && clock::now() >= _next_progress;
+    }
+
+    // 繰り返しの回数がわからないループ向けに、今の範囲の中での進み具合を直接設定します。
+
+    auto advance(double fraction) noexcept {
+      _position = std::max(_position, _range_begin + _range_width * std::clamp(fraction, 0.0, 1.0));
+    }
+
+    // 項の数の制限は調べずに、中断と時間の制限を調べて、進捗を通知します。2次への変換では、補助変数の分だけ項が増えるのは仕方がないので、こちらを使います。
+
+    auto poll(std::size_t term_count) {
+      _term_count = term_count;
+
+      if (_options.cancelled && _options.cancelled->load(std::memory_order_relaxed)) {
+        throw compile_cancelled_error("compile was cancelled.");
+      }
+
+      if (!_timed || ++_polls < clock_interval) {
+        return;
+      }
+
+      _polls = 0;
+
+      const auto now = clock::now();
+
+      if (_options.time_limit && std::chrono::duration<double>(now - _start).count() > *_options.time_limit) {
+        auto stream = std::ostringstream();
+
+        stream << "compile was aborted because it did not finish within the time limit (time_limit=" << *_options.time_limit << ").";
+
+        throw compile_timeout_error(stream.str());
+      }
+
+      if (_options.interrupt && now >= _next_interrupt) {
+        _next_interrupt = after(now, _options.interrupt_interval);
+
+        _options.interrupt();
+      }
+
+      if (_options.progress && now >= _next_progress) {
+        report(now);
+      }
+    }
+
+    // 展開の途中で呼び出して、項の数の制限も調べます。
+
+    auto operator()(std::size_t term_count) {
+      check_term_count(term_count, _max_term_count);
+      poll(term_count);
+    }
+
+    auto operator()(const polynomial& polynomial) {
+      (*this)(std::size(polynomial));
+    }
+  };
+
   // Expand to polynomial.
 
-  // TODO: ペナルティを最後ではなく途中で足し合わせられるか検討する。もし途中で足し合わせられるなら、戻り値が一つになって嬉しい。
+  // 展開の結果は、戻り値ではなく引数の多項式（polynomialとpenalty）に足し込みます。scaleは、そのノードに掛けられている係数です。
+  // こうすれば、子ノードの多項式をコピーしたりマージしたりしなくて済みます。ペナルティは、掛け算されてもscale倍しません。
 
   class expand final {
-    robin_hood::unordered_map<std::string, polynomial> _sub_hamiltonians;
-    robin_hood::unordered_map<std::string, std::pair<polynomial, std::function<bool(double)>>> _constraints;
+    robin_hood::unordered_map<std::string, std::shared_ptr<const polynomial>> _sub_hamiltonians;
+    robin_hood::unordered_map<std::string, constraint_polynomial> _constraints;
+    robin_hood::unordered_map<const expression*, std::pair<std::shared_ptr<const polynomial>, std::shared_ptr<const polynomial>>> _labeled_polynomials; // 同じノードが何度も出てきた場合は、展開結果を使い回します。
     variables* _variables;
+    pyquboc::domain _domain;
+    compile_monitor& _monitor;
+    std::shared_ptr<const expression> _one;
+
+    static auto is_constant(const std::shared_ptr<const expression>& expression) noexcept {
+      return expression->expression_type() == expression_type::numeric_literal || expression->expression_type() == expression_type::place_holder_variable;
+    }
+
+    // SubHやConstraintは、多項式を別に作って記録して、それをscale倍して足し込みます。
+
+    template <typename Expand>
+    auto expand_labeled(const std::shared_ptr<const expression>& expression, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const pyquboc::expression>& scale, Expand&& expand) {
+      auto it = _labeled_polynomials.find(expression.get());
+
+      if (it == std::end(_labeled_polynomials)) {
+        auto labeled_polynomial = std::make_shared<pyquboc::polynomial>();
+        auto labeled_penalty = std::make_shared<pyquboc::polynomial>();
+
+        expand(labeled_polynomial, *labeled_penalty);
+
+        it = _labeled_polynomials.emplace(expression.get(), std::pair{labeled_polynomial, labeled_penalty}).first;
+      }
+
+      add_terms(polynomial, *it->second.first, scale);
+      add_terms(penalty, *it->second.second, _one);
+    }
+
+    // variablesの積の線形結合（Polynomialや論理ゲート、整数のエンコーディング）を展開します。termは、i番目の項の(変数のインデックスの先頭, 末尾, 係数)を返します。
+    // 変数は一度だけ展開します。BinaryやSpinのように係数1の単項式になる変数なら、項ごとに積を直接作れます。
+
+    template <typename Term>
+    auto expand_products(const std::vector<std::shared_ptr<const expression>>& variables, int term_count, Term&& term, double offset, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      const auto variable_polynomials = [&] {
+        auto result = std::vector<pyquboc::polynomial>(std::size(variables));
+
+        for (auto i = 0; i < static_cast<int>(std::size(variables)); ++i) {
+          visit<void>(*this, variables[i], result[i], penalty, _one);
+        }
+
+        return result;
+      }();
+
+      const auto is_monomial = std::all_of(std::begin(variable_polynomials), std::end(variable_polynomials), [](const auto& variable_polynomial) {
+        return std::size(variable_polynomial) == 1 && std::begin(variable_polynomial)->second->expression_type() == expression_type::numeric_literal && std::static_pointer_cast<const numeric_literal>(std::begin(variable_polynomial)->second)->value() == 1;
+      });
+
+      const auto is_numeric_scale = scale->expression_type() == expression_type::numeric_literal;
+      const auto scale_value = is_numeric_scale ? std::static_pointer_cast<const numeric_literal>(scale)->value() : 0.0;
+
+      const auto coefficient = [&](double value) -> std::shared_ptr<const expression> {
+        if (is_numeric_scale) {
+          return std::make_shared<numeric_literal>(value * scale_value); // scaleが数値なら、項ごとのノードは1つで済みます。
+        }
+
+        return std::make_shared<numeric_literal>(value) * scale;
+      };
+
+      polynomial.reserve(std::min(std::size(polynomial) + term_count, _monitor.options().max_term_count()));
+
+      for (auto i = 0; i < term_count; ++i) {
+        const auto [begin, end, value] = term(i);
+
+        _monitor.advance(static_cast<double>(i) / term_count);
+
+        if (value == 0) {
+          continue;
+        }
+
+        if (is_monomial) {
+          auto product_indexes = pyquboc::indexes{};
+
+          for (auto it = begin; it != end; ++it) {
+            const auto& variable_indexes = std::begin(variable_polynomials[*it])->first.indexes();
+
+            product_indexes.insert(std::end(product_indexes), std::begin(variable_indexes), std::end(variable_indexes));
+          }
+
+          std::sort(std::begin(product_indexes), std::end(product_indexes));
+
+          if (_domain == domain::binary) {
+            product_indexes.erase(std::unique(std::begin(product_indexes), std::end(product_indexes)), std::end(product_indexes)); // x * x = x
+          } else {
+            auto last = std::begin(product_indexes);
+
+            for (auto it = std::begin(product_indexes); it != std::end(product_indexes); ++it) {
+              if (std::next(it) != std::end(product_indexes) && *std::next(it) == *it) { // s * s = 1
+                ++it;
+                continue;
+              }
+
+              *last++ = *it;
+            }
+
+            product_indexes.erase(last, std::end(product_indexes));
+          }
+
+          add_term(polynomial, pyquboc::product(product_indexes), coefficient(value));
+        } else {
+          auto term_polynomial = pyquboc::polynomial{{pyquboc::product{}, _one}};
+
+          for (auto it = begin; it != end; ++it) {
+            term_polynomial = multiply(term_polynomial, variable_polynomials[*it], _domain, _monitor);
+          }
+
+          add_terms(polynomial, term_polynomial, coefficient(value));
+        }
+
+        _monitor(polynomial);
+      }
+
+      if (offset != 0) {
+        add_term(polynomial, pyquboc::product{}, coefficient(offset));
+      }
+    }
 
   public:
-    auto operator()(const std::shared_ptr<const expression>& expression, variables* variables) noexcept {
+    expand(pyquboc::domain domain, compile_monitor& monitor) noexcept : _sub_hamiltonians{}, _constraints{}, _labeled_polynomials{}, _variables(nullptr), _domain(domain), _monitor(monitor), _one(std::make_shared<numeric_literal>(1)) {
+      ;
+    }
+
+    auto operator()(const std::shared_ptr<const expression>& expression, variables* variables) {
       _sub_hamiltonians = {};
       _constraints = {};
+      _labeled_polynomials = {};
       _variables = variables;
 
-      auto [polynomial, penalty] = visit<std::tuple<pyquboc::polynomial, pyquboc::polynomial>>(*this, expression);
+      auto polynomial = pyquboc::polynomial{};
+      auto penalty = pyquboc::polynomial{};
+
+      visit<void>(*this, expression, polynomial, penalty, _one);
+
+      for (const auto& [product, coefficient] : penalty) {
+        add_term(polynomial, product, coefficient);
+      }
+
+      _monitor(polynomial);
+
+      _labeled_polynomials = {};
 
-      return std::tuple{polynomial + penalty, _sub_hamiltonians, _constraints};
+      return std::tuple{std::move(polynomial), std::move(_sub_hamiltonians), std::move(_constraints)};
     }
 
-    auto operator()(const std::shared_ptr<const add_operator>& add_operator) noexcept {
-      // 汚いコードでごめんなさい。パフォーマンスのためなので、ご容赦を。
+    auto operator()(const std::shared_ptr<const add_operator>& add_operator, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      const auto& children = add_operator->children();
+
+      for (auto i = std::size_t{0}; i < std::size(children); ++i) {
+        _monitor.part(i, std::size(children), [&] {
+          visit<void>(*this, children[i], polynomial, penalty, scale);
+        });
+
+        _monitor(polynomial);
+      }
+    }
+
+    auto operator()(const std::shared_ptr<const mul_operator>& mul_operator, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      // 数値やPlaceholderとの掛け算は、scaleに畳み込みます。一時的な多項式を作らなくて済みます。
+
+      if (is_constant(mul_operator->lhs())) {
+        visit<void>(*this, mul_operator->rhs(), polynomial, penalty, scale * mul_operator->lhs());
+        return;
+      }
+
+      if (is_constant(mul_operator->rhs())) {
+        visit<void>(*this, mul_operator->lhs(), polynomial, penalty, scale * mul_operator->rhs());
+        return;
+      }
+
+      auto l_polynomial = pyquboc::polynomial{};
+      auto r_polynomial = pyquboc::polynomial{};
+
+      _monitor.part(0, 2, [&] {
+        visit<void>(*this, mul_operator->lhs(), l_polynomial, penalty, scale);
+        visit<void>(*this, mul_operator->rhs(), r_polynomial, penalty, _one);
+      });
 
-      const auto& merge = [](auto& polyominal, const auto& other) {
-        for (const auto& [product, coefficient] : other) {
-          const auto [it, emplaced] = polyominal.emplace(product, coefficient);
+      _monitor.part(1, 2, [&] {
+        auto row = 0;
+        auto count = 0;
 
-          if (!emplaced) {
-            it->second = it->second + coefficient;
+        for (const auto& [product_1, coefficient_1] : l_polynomial) {
+          for (const auto& [product_2, coefficient_2] : r_polynomial) {
+            add_term(polynomial, multiply(product_1, product_2, _domain), coefficient_1 * coefficient_2);
+
+            if (++count == checkpoint_interval) {
+              count = 0;
+              _monitor(polynomial);
+            }
           }
+
+          _monitor.advance(static_cast<double>(++row) / std::size(l_polynomial));
         }
-      };
 
-      auto polynomial = pyquboc::polynomial{};
-      auto penalty = pyquboc::polynomial{};
+        _monitor(polynomial);
+      });
+    }
+
+    auto operator()(const std::shared_ptr<const pow_operator>& pow_operator, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      auto base_polynomial = pyquboc::polynomial{};
+      auto base_penalty = pyquboc::polynomial{};
+
+      _monitor.part(0, 2, [&] {
+        visit<void>(*this, pow_operator->base(), base_polynomial, base_penalty, _one);
+      });
+
+      _monitor.part(1, 2, [&] {
+        add_terms(polynomial, pow(base_polynomial, pow_operator->exponent(), _domain, _monitor), scale);
+      });
+
+      add_terms(penalty, base_penalty, std::make_shared<numeric_literal>(pow_operator->exponent())); // 以前はmul_operatorを繰り返していたので、ペナルティはexponent回足されていました。互換性のために、それに合わせます。
+
+      _monitor(polynomial);
+    }
+
+    auto operator()(const std::shared_ptr<const binary_variable>& binary_variable, polynomial& polynomial, pyquboc::polynomial&, const std::shared_ptr<const expression>& scale) {
+      if (_domain == domain::spin) { // x = (s + 1) / 2
+        add_term(polynomial, {_variables->index(binary_variable->id())}, std::make_shared<numeric_literal>(0.5) * scale);
+        add_term(polynomial, {}, std::make_shared<numeric_literal>(0.5) * scale);
+        return;
+      }
 
-      for (const auto& child: add_operator->children()) {
-        const auto [child_polynomial, child_penalty] = visit<std::tuple<pyquboc::polynomial, pyquboc::polynomial>>(*this, child);
+      add_term(polynomial, {_variables->index(binary_variable->id())}, scale);
+    }
 
-        merge(polynomial, child_polynomial);
-        merge(penalty, child_penalty);
+    auto operator()(const std::shared_ptr<const spin_variable>& spin_variable, polynomial& polynomial, pyquboc::polynomial&, const std::shared_ptr<const expression>& scale) {
+      if (_domain == domain::spin) {
+        add_term(polynomial, {_variables->index(spin_variable->id())}, scale);
+        return;
       }
 
-      return std::tuple{polynomial, penalty};
+      add_term(polynomial, {_variables->index(spin_variable->id())}, std::make_shared<numeric_literal>(2) * scale); // s = 2x - 1
+      add_term(polynomial, {}, std::make_shared<numeric_literal>(-1) * scale);
+    }
+
+    auto operator()(const std::shared_ptr<const placeholder_variable>& place_holder_variable, polynomial& polynomial, pyquboc::polynomial&, const std::shared_ptr<const expression>& scale) {
+      add_term(polynomial, {}, place_holder_variable * scale);
+    }
+
+    auto operator()(const std::shared_ptr<const sub_hamiltonian>& sub_hamiltonian, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      expand_labeled(sub_hamiltonian, polynomial, penalty, scale, [&](const auto& labeled_polynomial, auto& labeled_penalty) {
+        visit<void>(*this, sub_hamiltonian->expression(), *labeled_polynomial, labeled_penalty, _one);
+
+        _sub_hamiltonians.emplace(sub_hamiltonian->name(), labeled_polynomial);
+      });
     }
 
-    auto operator()(const std::shared_ptr<const mul_operator>& mul_operator) noexcept {
-      const auto [l_polynomial, l_penalty] = visit<std::tuple<polynomial, polynomial>>(*this, mul_operator->lhs());
-      const auto [r_polynomial, r_penalty] = visit<std::tuple<polynomial, polynomial>>(*this, mul_operator->rhs());
+    auto operator()(const std::shared_ptr<const constraint>& constraint, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      expand_labeled(constraint, polynomial, penalty, scale, [&](const auto& labeled_polynomial, auto& labeled_penalty) {
+        visit<void>(*this, constraint->expression(), *labeled_polynomial, labeled_penalty, _one);
 
-      return std::tuple{l_polynomial * r_polynomial, l_penalty + r_penalty};
+        _constraints.emplace(constraint->name(), constraint_polynomial(labeled_polynomial, constraint->condition()));
+      });
     }
 
-    auto operator()(const std::shared_ptr<const binary_variable>& binary_variable) noexcept {
-      return std::tuple{polynomial{{{_variables->index(binary_variable->name())}, std::make_shared<numeric_literal>(1)}}, polynomial{}};
+    auto operator()(const std::shared_ptr<const with_penalty>& with_penalty, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      visit<void>(*this, with_penalty->expression(), polynomial, penalty, scale);
+      visit<void>(*this, with_penalty->penalty(), penalty, penalty, _one); // ペナルティの式は、多項式もペナルティもペナルティに足し込みます。
     }
 
-    auto operator()(const std::shared_ptr<const spin_variable>& spin_variable) noexcept {
-      return std::tuple{polynomial{{{_variables->index(spin_variable->name())}, std::make_shared<numeric_literal>(2)}, {{}, std::make_shared<numeric_literal>(-1)}}, polynomial{}};
+    auto operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      visit<void>(*this, user_defined_expression->expression(), polynomial, penalty, scale);
     }
 
-    auto operator()(const std::shared_ptr<const placeholder_variable>& place_holder_variable) noexcept {
-      return std::tuple{polynomial{{{}, place_holder_variable}}, polynomial{}};
+    auto operator()(const std::shared_ptr<const numeric_literal>& numeric_literal, polynomial& polynomial, pyquboc::polynomial&, const std::shared_ptr<const expression>& scale) {
+      add_term(polynomial, {}, numeric_literal * scale);
     }
 
-    auto operator()(const std::shared_ptr<const sub_hamiltonian>& sub_hamiltonian) noexcept {
-      const auto [polynomial, penalty] = visit<std::tuple<pyquboc::polynomial, pyquboc::polynomial>>(*this, sub_hamiltonian->expression());
+    auto operator()(const std::shared_ptr<const linear_equality>& linear_equality, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      // (Σc_i x_i - rhs)^2を、掛け算せずに解析的に展開します。
+
+      expand_labeled(linear_equality, polynomial, penalty, scale, [&](const auto& squared_polynomial, auto& labeled_penalty) {
+        auto linear_polynomial = std::make_shared<pyquboc::polynomial>(pyquboc::polynomial{{{}, std::make_shared<numeric_literal>(-linear_equality->rhs())}});
+
+        for (auto i = 0; i < static_cast<int>(std::size(linear_equality->variables())); ++i) {
+          visit<void>(*this, linear_equality->variables()[i], *linear_polynomial, labeled_penalty, std::make_shared<numeric_literal>(linear_equality->coefficients()[i]));
+        }
+
+        const auto is_linear = std::all_of(std::begin(*linear_polynomial), std::end(*linear_polynomial), [](const auto& term) {
+          return std::size(term.first.indexes()) <= 1 && term.second->expression_type() == expression_type::numeric_literal;
+        });
+
+        if (!is_linear) {
+          *squared_polynomial = multiply(*linear_polynomial, *linear_polynomial, _domain, _monitor); // 変数が1次式でなかったり係数にPlaceholderが含まれたりする場合は、普通に掛け算します。
+        } else {
+          auto constant = 0.0;
+          auto linear = std::vector<std::pair<int, double>>{};
+
+          for (const auto& [product, coefficient] : *linear_polynomial) {
+            const auto value = std::static_pointer_cast<const numeric_literal>(coefficient)->value();
 
-      _sub_hamiltonians.emplace(sub_hamiltonian->name(), polynomial);
+            if (std::size(product.indexes()) == 0) {
+              constant = value;
+            } else if (value != 0) {
+              linear.emplace_back(product.indexes()[0], value);
+            }
+          }
+
+          std::sort(std::begin(linear), std::end(linear));
+
+          check_term_count(std::size(linear) * (std::size(linear) + 1) / 2 + 1, _monitor.options().max_term_count()); // 確保する前に調べます。
+
+          squared_polynomial->reserve(std::size(linear) * (std::size(linear) + 1) / 2 + 1);
+
+          squared_polynomial->emplace(pyquboc::product{}, std::make_shared<numeric_literal>(constant * constant + (_domain == domain::spin ? std::accumulate(std::begin(linear), std::end(linear), 0.0, [](const auto& acc, const auto& term) { return acc + term.second * term.second; }) : 0.0))); // s * s = 1なので。
+
+          for (auto i = 0; i < static_cast<int>(std::size(linear)); ++i) {
+            const auto& [index_1, coefficient_1] = linear[i];
+
+            squared_polynomial->emplace(pyquboc::product{index_1}, std::make_shared<numeric_literal>((_domain == domain::binary ? coefficient_1 * coefficient_1 : 0.0) + 2 * coefficient_1 * constant)); // binaryならx * x = xなので1次の項に、spinならs * s = 1なので定数項（上）に入れます。
 
-      return std::tuple{polynomial, penalty};
+            for (auto j = i + 1; j < static_cast<int>(std::size(linear)); ++j) {
+              const auto& [index_2, coefficient_2] = linear[j];
+
+              squared_polynomial->emplace(pyquboc::product{index_1, index_2}, std::make_shared<numeric_literal>(2 * coefficient_1 * coefficient_2));
+            }
+          }
+        }
+
+        _constraints.emplace(linear_equality->name(), constraint_polynomial(linear_polynomial, linear_equality->condition(), true));
+      });
     }
 
-    auto operator()(const std::shared_ptr<const constraint>& constraint) noexcept {
-      const auto [polynomial, penalty] = visit<std::tuple<pyquboc::polynomial, pyquboc::polynomial>>(*this, constraint->expression());
+    auto operator()(const std::shared_ptr<const quadratic_form>& quadratic_form, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      // 係数行列の非ゼロ要素ごとにmul_operatorを作って展開するのは遅いので、変数を一度だけ展開して、項を直接多項式に追加します。
+
+      const auto multiply = [](const std::shared_ptr<const expression>& coefficient_1, const std::shared_ptr<const expression>& coefficient_2, double value) -> std::shared_ptr<const expression> {
+        if (coefficient_1->expression_type() == expression_type::numeric_literal && coefficient_2->expression_type() == expression_type::numeric_literal) {
+          return std::make_shared<numeric_literal>(std::static_pointer_cast<const numeric_literal>(coefficient_1)->value() * std::static_pointer_cast<const numeric_literal>(coefficient_2)->value() * value);
+        }
+
+        return coefficient_1 * coefficient_2 * std::make_shared<numeric_literal>(value);
+      };
+
+      const auto variable_polynomials = [&] {
+        auto result = std::vector<pyquboc::polynomial>(std::size(quadratic_form->variables()));
+
+        for (auto i = 0; i < static_cast<int>(std::size(quadratic_form->variables())); ++i) {
+          visit<void>(*this, quadratic_form->variables()[i], result[i], penalty, _one);
+        }
+
+        return result;
+      }();
+
+      for (auto i = 0; i < static_cast<int>(std::size(quadratic_form->coefficients())); ++i) {
+        _monitor.advance(static_cast<double>(i) / std::size(quadratic_form->coefficients()));
+
+        for (const auto& [product_1, coefficient_1] : variable_polynomials[quadratic_form->rows()[i]]) {
+          for (const auto& [product_2, coefficient_2] : variable_polynomials[quadratic_form->columns()[i]]) {
+            add_term(polynomial, pyquboc::multiply(product_1, product_2, _domain), multiply(coefficient_1, coefficient_2, quadratic_form->coefficients()[i]) * scale);
+          }
+        }
+
+        _monitor(polynomial);
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(quadratic_form->linear())); ++i) {
+        if (quadratic_form->linear()[i] == 0) {
+          continue;
+        }
 
-      _constraints.emplace(constraint->name(), std::pair{polynomial, constraint->condition()});
+        for (const auto& [product, coefficient] : variable_polynomials[i]) {
+          add_term(polynomial, product, multiply(coefficient, _one, quadratic_form->linear()[i]) * scale);
+        }
+      }
 
-      return std::tuple{polynomial, penalty};
+      if (quadratic_form->offset() != 0) {
+        add_term(polynomial, pyquboc::product{}, std::make_shared<numeric_literal>(quadratic_form->offset()) * scale);
+      }
     }
 
-    auto operator()(const std::shared_ptr<const with_penalty>& with_penalty) noexcept {
-      const auto [e_polynomial, e_penalty] = visit<std::tuple<polynomial, polynomial>>(*this, with_penalty->expression());
-      const auto [p_polynomial, p_penalty] = visit<std::tuple<polynomial, polynomial>>(*this, with_penalty->penalty());
+    auto operator()(const std::shared_ptr<const coo_polynomial>& coo_polynomial, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      const auto& indptr = coo_polynomial->indptr();
+      const auto& indexes = coo_polynomial->indexes();
+      const auto& coefficients = coo_polynomial->coefficients();
 
-      return std::tuple{e_polynomial, e_penalty + p_penalty + p_polynomial};
+      expand_products(
+          coo_polynomial->variables(), static_cast<int>(std::size(coefficients)), [&](int i) {
+            return std::tuple{std::data(indexes) + indptr[i], std::data(indexes) + indptr[i + 1], coefficients[i]};
+          },
+          coo_polynomial->offset(), polynomial, penalty, scale);
     }
 
-    auto operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) noexcept {
-      return visit<std::tuple<polynomial, polynomial>>(*this, user_defined_expression->expression());
+    auto operator()(const std::shared_ptr<const logic_gate>& logic_gate, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      const auto& terms = logic_gate->terms();
+
+      expand_products(
+          logic_gate->operands(), static_cast<int>(std::size(terms)), [&](int i) {
+            return std::tuple{std::data(terms[i].indexes), std::data(terms[i].indexes) + std::size(terms[i].indexes), terms[i].coefficient};
+          },
+          0.0, polynomial, penalty, scale);
     }
 
-    auto operator()(const std::shared_ptr<const numeric_literal>& numeric_literal) noexcept {
-      return std::tuple{polynomial{{{}, numeric_literal}}, polynomial{}};
+    auto operator()(const std::shared_ptr<const encoded_integer>& encoded_integer, polynomial& polynomial, pyquboc::polynomial& penalty, const std::shared_ptr<const expression>& scale) {
+      const auto& weights = encoded_integer->weights();
+      const auto indexes = [&] {
+        auto result = std::vector<int>(std::size(weights));
+
+        std::iota(std::begin(result), std::end(result), 0);
+
+        return result;
+      }();
+
+      expand_products(
+          encoded_integer->variables(), static_cast<int>(std::size(weights)), [&](int i) {
+            return std::tuple{std::data(indexes) + i, std::data(indexes) + i + 1, weights[i]};
+          },
+          encoded_integer->lower(), polynomial, penalty, scale);
     }
   };
 
   // Convert to quadratic polynomial.
 
-  inline std::optional<std::pair<int, int>> find_replacing_pair(const pyquboc::polynomial& polynomial) noexcept {
+  enum class quadratization {
+    greedy,        // 最も多く出現する変数のペアを、補助変数に置き換えていきます。
+    negative_term, // 係数が負の項は、ペナルティなしで補助変数1個で2次にします（Freedman）。残りはgreedyで。
+    pair_cover     // greedyにペアを選んだ後で不要なペアを取り除いて、補助変数を減らします。残りはgreedyで。
+  };
+
+  inline auto to_quadratization(const std::string& name) {
+    if (name == "greedy") {
+      return quadratization::greedy;
+    }
+
+    if (name == "negative_term") {
+      return quadratization::negative_term;
+    }
+
+    if (name == "pair_cover") {
+      return quadratization::pair_cover;
+    }
+
+    throw std::runtime_error("`quadratization` should be 'greedy', 'negative_term' or 'pair_cover'.");
+  }
+
+  // ペアは(first << 32) | secondをキーにして、ハッシュ表で数えます。出現回数が同じなら、以前のstd::mapのmax_elementと同じように、小さいペアを選びます。
+
+  inline std::optional<std::pair<int, int>> find_replacing_pair(const pyquboc::polynomial& polynomial, compile_monitor* monitor = nullptr) {
     auto counts = [&] {
-      auto result = std::map<std::pair<int, int>, int>{};
+      auto result = robin_hood::unordered_map<std::uint64_t, int>{};
+      auto count = 0;
 
       for (const auto& [product, _] : polynomial) {
         if (std::size(product.indexes()) <= 2) {
           continue;
         }
 
+        if (monitor && ++count == checkpoint_interval) { // 項が多いと、1回数えるだけでも時間がかかります。
+          count = 0;
+          monitor->poll(std::size(polynomial));
+        }
+
         for (auto it_1 = std::begin(product.indexes()); it_1 != std::prev(std::end(product.indexes())); ++it_1) {
           for (auto it_2 = std::next(it_1); it_2 != std::end(product.indexes()); ++it_2) {
-            const auto [it, emplaced] = result.emplace(std::pair{*it_1, *it_2}, 1);
-
-            if (!emplaced) {
-              it->second++;
-            }
+            ++result[static_cast<std::uint64_t>(*it_1) << 32 | static_cast<std::uint32_t>(*it_2)];
           }
         }
       }
@@ -143,81 +733,793 @@ namespace pyquboc {
     }
 
     const auto it = std::max_element(std::begin(counts), std::end(counts), [](const auto& count_1, const auto& count_2) {
-      return count_1.second < count_2.second;
+      return count_1.second < count_2.second || (count_1.second == count_2.second && count_1.first > count_2.first);
     });
 
-    return it->first;
+    return std::pair{static_cast<int>(it->first >> 32), static_cast<int>(it->first & 0xffffffff)};
   }
 
-  inline auto convert_to_quadratic(const pyquboc::polynomial& polynomial, double strength, variables* variables) noexcept {
-    auto result = polynomial;
+  inline void replace_pair(pyquboc::polynomial& polynomial, const std::pair<int, int>& replacing_pair, int replacing_pair_index, double strength) noexcept {
+    const auto emplace_term = [](pyquboc::polynomial& polynomial, const pyquboc::product& product, const std::shared_ptr<const expression>& coefficient) {
+      const auto [it, emplaced] = polynomial.emplace(product, coefficient);
 
-    for (;;) {
-      const auto replacing_pair = find_replacing_pair(result);
-
-      if (!replacing_pair) {
-        break;
+      if (!emplaced) {
+        it->second = it->second + coefficient;
       }
+    };
 
-      const auto replacing_pair_index = variables->index(variables->name(replacing_pair->first) + " * " + variables->name(replacing_pair->second));
+    // replace.
 
-      // replace.
+    const auto replacing_products = [&] {
+      auto result = std::vector<pyquboc::product>{};
 
-      for (;;) {
-        auto it = std::find_if(std::begin(result), std::end(result), [&](const auto& term) {
-          return std::binary_search(std::begin(term.first.indexes()), std::end(term.first.indexes()), replacing_pair->first) && std::binary_search(std::begin(term.first.indexes()), std::end(term.first.indexes()), replacing_pair->second);
-        });
-
-        if (it == std::end(result)) {
-          break;
+      for (const auto& [product, _] : polynomial) {
+        if (std::binary_search(std::begin(product.indexes()), std::end(product.indexes()), replacing_pair.first) && std::binary_search(std::begin(product.indexes()), std::end(product.indexes()), replacing_pair.second)) {
+          result.emplace_back(product);
         }
+      }
 
-        const auto indexes = [&] {
-          auto result = pyquboc::indexes{};
+      return result;
+    }();
 
-          std::copy_if(std::begin(it->first.indexes()), std::end(it->first.indexes()), std::back_inserter(result), [&](const auto& index) {
-            return index != replacing_pair->first && index != replacing_pair->second;
-          });
+    for (const auto& replacing_product : replacing_products) {
+      const auto it = polynomial.find(replacing_product);
 
-          result.emplace_back(replacing_pair_index);
+      const auto indexes = [&] {
+        auto result = pyquboc::indexes{};
 
-          return result;
-        }();
-        const auto expression = it->second;
+        std::copy_if(std::begin(it->first.indexes()), std::end(it->first.indexes()), std::back_inserter(result), [&](const auto& index) {
+          return index != replacing_pair.first && index != replacing_pair.second;
+        });
+
+        result.emplace_back(replacing_pair_index); // 補助変数のインデックスは最大なので、ソートされたままになります。
+
+        return result;
+      }();
+      const auto expression = it->second;
+
+      polynomial.erase(it);
+      emplace_term(polynomial, product(indexes), expression);
+    }
+
+    // insert.
 
-        result.erase(it);
-        result.emplace(product(indexes), expression);
+    // clang-format off
+    emplace_term(polynomial, product{replacing_pair_index                        }, std::make_shared<numeric_literal>(strength *  3));
+    emplace_term(polynomial, product{replacing_pair.first,  replacing_pair_index }, std::make_shared<numeric_literal>(strength * -2));
+    emplace_term(polynomial, product{replacing_pair.second, replacing_pair_index }, std::make_shared<numeric_literal>(strength * -2));
+    emplace_term(polynomial, product{replacing_pair.first,  replacing_pair.second}, std::make_shared<numeric_literal>(strength *  1));
+    // clang-format on
+  }
+
+  // monitorを指定した場合は、ループごとに中断や制限を調べます。進捗は、3次以上の項の余分な次数の合計が、どれだけ減ったかです。
+
+  inline void quadratize_greedy(pyquboc::polynomial& polynomial, double strength, variables* variables, compile_monitor* monitor = nullptr) {
+    const auto excess_degree = [&] {
+      auto result = 0.0;
+
+      for (const auto& [product, _] : polynomial) {
+        result += std::max(static_cast<int>(std::size(product.indexes())) - 2, 0);
       }
 
-      // insert.
+      return result;
+    };
 
-      const auto emplace_term = [](pyquboc::polynomial& polynomial, const pyquboc::product& product, const std::shared_ptr<const expression>& coefficient) {
-        const auto [it, emplaced] = polynomial.emplace(product, coefficient);
+    const auto initial_excess_degree = monitor && monitor->options().progress ? excess_degree() : 0.0;
 
-        if (!emplaced) {
-          it->second = it->second + coefficient;
+    for (;;) {
+      if (monitor) {
+        if (initial_excess_degree > 0 && monitor->progress_due()) { // 余分な次数は、通知するときだけ数えます。
+          monitor->advance(1 - excess_degree() / initial_excess_degree);
         }
-      };
 
-      // clang-format off
-      emplace_term(result, product{replacing_pair_index                          }, std::make_shared<numeric_literal>(strength *  3));
-      emplace_term(result, product{replacing_pair->first,  replacing_pair_index  }, std::make_shared<numeric_literal>(strength * -2));
-      emplace_term(result, product{replacing_pair->second, replacing_pair_index  }, std::make_shared<numeric_literal>(strength * -2));
-      emplace_term(result, product{replacing_pair->first,  replacing_pair->second}, std::make_shared<numeric_literal>(strength *  1));
-      // clang-format on
+        monitor->poll(std::size(polynomial));
+      }
+
+      const auto replacing_pair = find_replacing_pair(polynomial, monitor);
+
+      if (!replacing_pair) {
+        break;
+      }
+
+      replace_pair(polynomial, *replacing_pair, variables->index(variables->name(replacing_pair->first) + " * " + variables->name(replacing_pair->second)), strength);
+    }
+  }
+
+  // 係数aが負の項は、a * x_1 * ... * x_d = min_w a * w * (x_1 + ... + x_d - (d - 1))で2次にできます。補助変数は項ごとに1個必要ですけど、ペナルティの強さは不要です。
+  // 係数がPlaceholderを含む場合は符号がわからないので、greedyに任せます。
+
+  inline void quadratize_negative_terms(pyquboc::polynomial& polynomial, variables* variables, compile_monitor* monitor = nullptr) {
+    const auto emplace_term = [](pyquboc::polynomial& polynomial, const pyquboc::product& product, double coefficient) {
+      const auto [it, emplaced] = polynomial.emplace(product, std::make_shared<numeric_literal>(coefficient));
+
+      if (!emplaced) {
+        it->second = it->second + std::make_shared<numeric_literal>(coefficient);
+      }
+    };
+
+    const auto negative_terms = [&] {
+      auto result = std::vector<std::pair<pyquboc::product, double>>{};
+
+      for (const auto& [product, coefficient] : polynomial) {
+        if (std::size(product.indexes()) <= 2 || coefficient->expression_type() != expression_type::numeric_literal || std::static_pointer_cast<const numeric_literal>(coefficient)->value() >= 0) {
+          continue;
+        }
+
+        result.emplace_back(product, std::static_pointer_cast<const numeric_literal>(coefficient)->value());
+      }
+
+      return result;
+    }();
+
+    for (auto i = std::size_t{0}; i < std::size(negative_terms); ++i) {
+      const auto& [product, coefficient] = negative_terms[i];
+
+      if (monitor) {
+        monitor->advance(static_cast<double>(i) / std::size(negative_terms));
+        monitor->poll(std::size(polynomial));
+      }
+
+      polynomial.erase(product);
+
+      const auto auxiliary_index = variables->index("aux(" +
+                                                    std::accumulate(std::begin(product.indexes()), std::end(product.indexes()), std::string(), [&](const auto& acc, const auto& index) {
+                                                      return acc + (std::size(acc) > 0 ? " * " : "") + variables->name(index);
+                                                    }) +
+                                                    ")");
+
+      for (const auto& index : product.indexes()) {
+        emplace_term(polynomial, pyquboc::product{index, auxiliary_index}, coefficient);
+      }
+
+      emplace_term(polynomial, pyquboc::product{auxiliary_index}, -coefficient * (static_cast<int>(std::size(product.indexes())) - 1));
+    }
+  }
+
+  // ペアを被覆集合とみなして、補助変数の数を減らします。
+  // 1. greedyに、出現数が最大のペアを選びます。出現数が同じなら、次数3の項を2次にできる数が多いペアを選びます（次数3を優先するよりも、こちらの方が補助変数は少なくなりました）。
+  // 2. 選んだペアを後ろから順に外してみて、外してもすべての項が2次になるならそのペアは不要なので削除します。
+  // 3. 残ったペアで、実際に置き換えます。
+
+  inline void quadratize_pair_cover(pyquboc::polynomial& polynomial, double strength, variables* variables, compile_monitor* monitor = nullptr) {
+    const auto terms = [&] {
+      auto result = std::vector<std::vector<int>>{};
+
+      for (const auto& [product, _] : polynomial) {
+        if (std::size(product.indexes()) <= 2) {
+          continue;
+        }
+
+        result.emplace_back(std::begin(product.indexes()), std::end(product.indexes()));
+      }
+
+      return result;
+    }();
+
+    const auto first_auxiliary_index = static_cast<int>(variables->size()); // 仮の補助変数のインデックスは、ここから始めます。
+
+    const auto checkpoint = [&](double fraction) { // 選択、削除、置き換えで、進捗を3等分します。
+      if (monitor) {
+        monitor->advance(fraction);
+        monitor->poll(std::size(polynomial));
+      }
+    };
+
+    const auto replace = [](std::vector<int>& term, const std::pair<int, int>& pair, int pair_index) {
+      if (!std::binary_search(std::begin(term), std::end(term), pair.first) || !std::binary_search(std::begin(term), std::end(term), pair.second)) {
+        return false;
+      }
+
+      term.erase(std::remove_if(std::begin(term), std::end(term), [&](const auto& index) { return index == pair.first || index == pair.second; }), std::end(term));
+      term.emplace_back(pair_index);
+
+      return true;
+    };
+
+    // 1. select.
+
+    const auto pairs = [&] {
+      auto result = std::vector<std::pair<int, int>>{};
+      auto working_terms = terms;
+
+      for (;;) {
+        auto scores = std::map<std::pair<int, int>, std::pair<int, int>>{};
+        auto remaining_term_count = 0;
+
+        for (const auto& term : working_terms) {
+          if (std::size(term) <= 2) {
+            continue;
+          }
+
+          ++remaining_term_count;
+
+          for (auto it_1 = std::begin(term); it_1 != std::prev(std::end(term)); ++it_1) {
+            for (auto it_2 = std::next(it_1); it_2 != std::end(term); ++it_2) {
+              auto& score = scores[std::pair{*it_1, *it_2}];
+
+              score.first++;
+              score.second += std::size(term) == 3;
+            }
+          }
+        }
+
+        if (std::size(scores) == 0) {
+          break;
+        }
+
+        checkpoint((1 - static_cast<double>(remaining_term_count) / std::size(working_terms)) / 3);
+
+        const auto pair = std::max_element(std::begin(scores), std::end(scores), [](const auto& score_1, const auto& score_2) { // (出現数, 次数3の項の数)の辞書順です。
+                            return score_1.second < score_2.second;
+                          })->first;
+
+        for (auto& term : working_terms) {
+          replace(term, pair, first_auxiliary_index + static_cast<int>(std::size(result)));
+        }
+
+        result.emplace_back(pair);
+      }
+
+      return result;
+    }();
+
+    // 2. prune.
+
+    auto enabled = std::vector<bool>(std::size(pairs), true);
+
+    const auto simulate = [&](const std::vector<int>& term) {
+      auto result = term;
+      auto used_pairs = std::vector<int>{};
+
+      for (auto i = 0; i < static_cast<int>(std::size(pairs)); ++i) {
+        if (enabled[i] && replace(result, pairs[i], first_auxiliary_index + i)) {
+          used_pairs.emplace_back(i);
+        }
+      }
+
+      return std::pair{std::size(result) <= 2, used_pairs};
+    };
+
+    auto term_usages = std::vector<std::vector<int>>(std::size(terms));
+    auto pair_usages = std::vector<std::set<int>>(std::size(pairs));
+
+    for (auto i = 0; i < static_cast<int>(std::size(terms)); ++i) {
+      term_usages[i] = simulate(terms[i]).second;
+
+      for (const auto& pair : term_usages[i]) {
+        pair_usages[pair].emplace(i);
+      }
+    }
+
+    for (auto changed = true; changed;) {
+      changed = false;
+
+      for (auto i = static_cast<int>(std::size(pairs)) - 1; i >= 0; --i) {
+        checkpoint((1 + static_cast<double>(std::size(pairs) - i) / std::size(pairs)) / 3);
+
+        if (!enabled[i]) {
+          continue;
+        }
+
+        enabled[i] = false;
+
+        const auto affected_terms = std::vector<int>(std::begin(pair_usages[i]), std::end(pair_usages[i]));
+
+        if (!std::all_of(std::begin(affected_terms), std::end(affected_terms), [&](const auto& term) { return simulate(terms[term]).first; })) {
+          enabled[i] = true;
+          continue;
+        }
+
+        for (const auto& term : affected_terms) {
+          for (const auto& pair : term_usages[term]) {
+            pair_usages[pair].erase(term);
+          }
+
+          term_usages[term] = simulate(terms[term]).second;
+
+          for (const auto& pair : term_usages[term]) {
+            pair_usages[pair].emplace(term);
+          }
+        }
+
+        changed = true;
+      }
+    }
+
+    // 3. replace.
+
+    auto indexes = std::vector<int>(std::size(pairs));
+
+    const auto to_index = [&](int index) {
+      return index < first_auxiliary_index ? index : indexes[index - first_auxiliary_index];
+    };
+
+    for (auto i = 0; i < static_cast<int>(std::size(pairs)); ++i) {
+      checkpoint((2 + static_cast<double>(i) / std::size(pairs)) / 3);
+
+      if (!enabled[i]) {
+        continue;
+      }
+
+      const auto pair = std::pair{to_index(pairs[i].first), to_index(pairs[i].second)};
+
+      indexes[i] = variables->index(variables->name(pair.first) + " * " + variables->name(pair.second));
+
+      replace_pair(polynomial, pair, indexes[i], strength);
+    }
+  }
+
+  inline auto convert_to_quadratic(pyquboc::polynomial polynomial, double strength, variables* variables, pyquboc::quadratization quadratization = quadratization::greedy, compile_monitor* monitor = nullptr) { // 引数はコピーせずにムーブしてもらって、そのまま書き換えます。
+    auto result = std::move(polynomial);
+
+    const auto part = [&](std::size_t i, std::size_t n, const auto& function) {
+      if (!monitor) {
+        function();
+        return;
+      }
+
+      monitor->part(i, n, function);
+    };
+
+    if (quadratization == quadratization::greedy) {
+      quadratize_greedy(result, strength, variables, monitor);
+      return result;
     }
 
+    part(0, 2, [&] {
+      if (quadratization == quadratization::negative_term) {
+        quadratize_negative_terms(result, variables, monitor);
+      } else {
+        quadratize_pair_cover(result, strength, variables, monitor);
+      }
+    });
+
+    part(1, 2, [&] { quadratize_greedy(result, strength, variables, monitor); }); // 残った項は、greedyで2次にします。
+
     return result;
   }
 
   // Compile.
 
-  inline auto compile(const std::shared_ptr<const expression>& expression, double strength) noexcept {
+  // spinの多項式を、s = 2x - 1でbinaryの多項式に変換します。変数のインデックスは変わりません。
+
+  inline auto to_binary(const polynomial& polynomial, compile_monitor& monitor) {
+    auto result = pyquboc::polynomial{};
+
+    for (const auto& [product, coefficient] : polynomial) {
+      auto terms = std::vector<std::pair<pyquboc::indexes, double>>{{{}, 1.0}}; // 変数を1つずつ(2x - 1)に置き換えて、係数は数値のまま展開します。
+
+      for (const auto& index : product.indexes()) {
+        const auto size = std::size(terms);
+
+        for (auto i = std::size_t{0}; i < size; ++i) {
+          auto indexes = terms[i].first;
+
+          indexes.emplace_back(index); // productのインデックスは昇順なので、末尾に追加すれば昇順のままです。
+
+          terms.emplace_back(std::move(indexes), terms[i].second * 2);
+          terms[i].second = -terms[i].second;
+        }
+      }
+
+      for (const auto& [indexes, factor] : terms) {
+        add_term(result, pyquboc::product(indexes), coefficient * std::make_shared<numeric_literal>(factor));
+      }
+
+      monitor(result);
+    }
+
+    return result;
+  }
+
+  // 中間の多項式は、次の段階にムーブして使い終わったらすぐに解放します。compactがtrueの場合は、モデルのコンテナを要素数に合わせて縮めます。
+  // quadratizeがfalseの場合は2次に変換しないので、高次の多項式をそのまま扱えるソルバー向けのモデルになります。
+  // domainがspinの場合は、スピン変数のまま展開します（s * s = 1）。ただし、2次への変換はbinaryでしかできないので、3次以上の項が残る場合は展開した多項式をbinaryに変換します。
+
+  inline model compile(const std::shared_ptr<const expression>& expression, double strength, pyquboc::quadratization quadratization, bool compact, bool quadratize, pyquboc::domain domain, compile_monitor& monitor) {
     auto variables = pyquboc::variables();
 
-    const auto [polynomial, sub_hamiltonians, constraints] = expand()(expression, &variables);
-    const auto quadratic_polynomial = convert_to_quadratic(polynomial, strength, &variables);
+    monitor.variables(&variables);
+    monitor.phase(compile_phase::expand, 0);
+
+    auto [polynomial, sub_hamiltonians, constraints] = expand(domain, monitor)(expression, &variables);
+
+    if (domain == domain::spin && quadratize && std::any_of(std::begin(polynomial), std::end(polynomial), [](const auto& term) { return std::size(term.first.indexes()) > 2; })) {
+      polynomial = to_binary(polynomial, monitor);
+
+      for (auto& [name, sub_hamiltonian] : sub_hamiltonians) {
+        sub_hamiltonian = std::make_shared<const pyquboc::polynomial>(to_binary(*sub_hamiltonian, monitor));
+      }
+
+      for (auto& [name, constraint] : constraints) {
+        constraint = constraint_polynomial(std::make_shared<const pyquboc::polynomial>(to_binary(constraint.polynomial(), monitor)), constraint.condition(), constraint.squared()); // 1次式は、変換しても1次式です。
+      }
+
+      domain = domain::binary;
+    }
+
+    const auto variable_count = std::size(variables);
+
+    if (quadratize && domain == domain::binary) {
+      monitor.phase(compile_phase::quadratize, std::size(polynomial));
 
-    return model(quadratic_polynomial, sub_hamiltonians, constraints, variables);
+      polynomial = convert_to_quadratic(std::move(polynomial), strength, &variables, quadratization, &monitor);
+    }
+
+    monitor.phase(compile_phase::build, std::size(polynomial));
+
+    const auto auxiliary_variable_count = static_cast<int>(std::size(variables) - variable_count);
+    const auto term_count = std::size(polynomial);
+
+    monitor.variables(nullptr); // variablesは、モデルにムーブします。
+
+    auto result = model(std::move(polynomial), std::move(sub_hamiltonians), std::move(constraints), std::move(variables), auxiliary_variable_count, domain);
+
+    if (compact) {
+      result.compact();
+    }
+
+    monitor.finish(term_count);
+
+    return result;
+  }
+
+  inline model compile(const std::shared_ptr<const expression>& expression, double strength, pyquboc::quadratization quadratization = quadratization::greedy, bool compact = false, bool quadratize = true, pyquboc::domain domain = domain::binary, const compile_options& options = {}) {
+    auto monitor = compile_monitor(options);
+
+    try {
+      return compile(expression, strength, quadratization, compact, quadratize, domain, monitor);
+    } catch (const term_limit_error& error) {
+      throw term_limit_error(std::string("compile was aborted because ") + error.what() + " (" + options.to_string() + "). check the size with estimate_compile() before compiling.");
+    }
+  }
+
+  // Compile many.
+
+  // 独立した複数の式を、thread_count個のスレッドで並列にコンパイルします。thread_countが0以下なら、CPUのコア数を使います。
+  // 変数のIDの割り当て（symbol_table）はスレッド・セーフで、それ以外の状態は式ごとに別なので、そのまま並列にできます。
+
+  inline auto compile_many(const std::vector<std::shared_ptr<const expression>>& expressions, double strength, pyquboc::quadratization quadratization = quadratization::greedy, bool compact = false, bool quadratize = true, pyquboc::domain domain = domain::binary, int thread_count = 0) {
+    auto models = std::vector<std::optional<model>>(std::size(expressions));
+
+    parallel_for(static_cast<int>(std::size(expressions)), thread_count, [&](int i) {
+      models[i] = compile(expressions[i], strength, quadratization, compact, quadratize, domain);
+    });
+
+    auto result = std::vector<model>{};
+
+    result.reserve(std::size(models));
+
+    for (auto& model : models) {
+      result.emplace_back(std::move(*model));
+    }
+
+    return result;
+  }
+
+  // Estimate compile.
+
+  // 展開せずに式をたどって、コンパイル結果の大きさの上限を見積もります。巨大な式をコンパイルして、メモリを使い果たさないように事前に調べるために使います。
+  // 掛け算の項の数は、項の数の積と、変数の数と次数から決まる単項式の数の小さい方です。項の数は桁あふれしないように、doubleで数えます。
+  // -Ofast（-ffinite-math-only）では無限大を扱えないので、計算はdoubleの最大値で飽和させて、飽和した見積もりはstd::nulloptにします。
+
+  struct compile_estimate final {
+    std::optional<double> term_count;               // 展開した多項式の項の数の上限。doubleで表せないほど大きい場合は、std::nulloptです。
+    int degree;                                     // 次数の上限。
+    std::size_t variable_count;                     // 変数の数（補助変数は含みません）。
+    std::optional<double> auxiliary_variable_count; // 2次に変換するときの補助変数の数の上限。
+    std::optional<double> memory;                   // 展開で確保するメモリの見積もり（バイト）。途中で作る多項式も含めます。
+  };
+
+  // 0以上の値の、飽和する足し算と掛け算です。
+
+  inline auto saturated_add(double x, double y) noexcept {
+    return x < std::numeric_limits<double>::max() - y ? x + y : std::numeric_limits<double>::max();
+  }
+
+  inline auto saturated_multiply(double x, double y) noexcept {
+    return y <= 1 || x < std::numeric_limits<double>::max() / y ? x * y : std::numeric_limits<double>::max();
+  }
+
+  inline auto bounded(double value) noexcept {
+    return value < std::numeric_limits<double>::max() ? std::optional<double>{value} : std::nullopt;
+  }
+
+  class estimate final {
+    struct bound final {
+      double term_count;
+      int degree;
+      double variable_count; // 部分式に含まれる変数の数の上限。
+      double memory;         // 部分式の展開の途中で作る多項式のメモリ。
+    };
+
+    robin_hood::unordered_map<const expression*, bound> _bounds;
+    robin_hood::unordered_map<int, bool> _variables;
+    pyquboc::domain _domain;
+
+    static auto is_constant(const std::shared_ptr<const expression>& expression) noexcept {
+      return expression->expression_type() == expression_type::numeric_literal || expression->expression_type() == expression_type::place_holder_variable;
+    }
+
+    // 変数の数がvariable_count、次数がdegree以下の単項式の数です。
+
+    static auto monomial_count(double variable_count, int degree) noexcept {
+      auto result = 1.0;
+      auto combination = 1.0;
+
+      for (auto i = 1; i <= degree && i <= variable_count; ++i) {
+        combination = saturated_multiply(combination, variable_count - i + 1);
+
+        if (combination == std::numeric_limits<double>::max()) {
+          return combination;
+        }
+
+        combination /= i;
+        result = saturated_add(result, combination);
+      }
+
+      return result;
+    }
+
+    static auto make_bound(double term_count, double degree, double variable_count, double memory) noexcept {
+      const auto result_degree = static_cast<int>(std::min({degree, variable_count, static_cast<double>(std::numeric_limits<int>::max())})); // x * x = xなので、次数は変数の数を超えません。次数はintで桁あふれしないように、doubleで受け取ります。
+
+      return bound{std::min(term_count, monomial_count(variable_count, result_degree)), result_degree, variable_count, memory};
+    }
+
+    static auto bytes(const bound& bound) noexcept {
+      return saturated_multiply(bound.term_count, estimated_term_bytes(bound.degree));
+    }
+
+    // 同じノードは一度だけ見積もります。展開で結果を使い回すSubHやConstraintは、2回目以降はメモリを使いません。
+
+    auto get(const std::shared_ptr<const expression>& expression) {
+      const auto it = _bounds.find(expression.get());
+
+      if (it != std::end(_bounds)) {
+        const auto is_labeled = expression->expression_type() == expression_type::sub_hamiltonian || expression->expression_type() == expression_type::constraint || expression->expression_type() == expression_type::linear_equality;
+
+        return is_labeled ? bound{it->second.term_count, it->second.degree, it->second.variable_count, 0} : it->second;
+      }
+
+      const auto result = visit<bound>(*this, expression);
+
+      _bounds.emplace(expression.get(), result);
+
+      return result;
+    }
+
+    // variablesの積の線形結合（Polynomialや論理ゲート、整数のエンコーディング）を見積もります。termは、i番目の項の(変数のインデックスの先頭, 末尾)を返します。
+
+    template <typename Term>
+    auto estimate_products(const std::vector<std::shared_ptr<const expression>>& variables, int term_count, Term&& term) {
+      auto variable_bounds = std::vector<bound>{};
+
+      for (const auto& variable : variables) {
+        variable_bounds.emplace_back(get(variable));
+      }
+
+      auto result_term_count = 1.0; // 定数項。
+      auto degree = 0.0;
+
+      for (auto i = 0; i < term_count; ++i) {
+        const auto [begin, end] = term(i);
+
+        auto term_term_count = 1.0;
+        auto term_degree = 0.0;
+
+        for (auto it = begin; it != end; ++it) {
+          term_term_count = saturated_multiply(term_term_count, variable_bounds[*it].term_count);
+          term_degree += variable_bounds[*it].degree;
+        }
+
+        result_term_count = saturated_add(result_term_count, term_term_count);
+        degree = std::max(degree, term_degree);
+      }
+
+      return make_bound(
+          result_term_count, degree,
+          std::accumulate(std::begin(variable_bounds), std::end(variable_bounds), 0.0, [](const auto& acc, const auto& bound) { return saturated_add(acc, bound.variable_count); }),
+          std::accumulate(std::begin(variable_bounds), std::end(variable_bounds), 0.0, [](const auto& acc, const auto& bound) { return saturated_add(saturated_add(acc, bound.memory), bytes(bound)); }));
+    }
+
+  public:
+    estimate(pyquboc::domain domain = domain::binary) noexcept : _bounds{}, _variables{}, _domain(domain) {
+      ;
+    }
+
+    auto operator()(const std::shared_ptr<const expression>& expression, bool quadratize) {
+      _bounds = {};
+      _variables = {};
+
+      const auto result = get(expression);
+
+      // 補助変数1個で、次数が3以上の項のどれかの次数が1下がるので、補助変数の数は項の数 * (次数 - 2)以下です。1個につき、4項のペナルティを足します。
+
+      const auto auxiliary_variable_count = quadratize && _domain == domain::binary && result.degree > 2 ? saturated_multiply(result.term_count, result.degree - 2) : 0.0;
+
+      return compile_estimate{bounded(result.term_count), result.degree, std::size(_variables), bounded(auxiliary_variable_count), bounded(saturated_add(saturated_add(result.memory, bytes(result)), saturated_multiply(auxiliary_variable_count, 4 * estimated_term_bytes(2))))};
+    }
+
+    auto operator()(const std::shared_ptr<const add_operator>& add_operator) {
+      auto result = bound{0, 0, 0, 0};
+
+      for (const auto& child : add_operator->children()) {
+        const auto child_bound = get(child);
+
+        result = bound{saturated_add(result.term_count, child_bound.term_count), std::max(result.degree, child_bound.degree), saturated_add(result.variable_count, child_bound.variable_count), saturated_add(result.memory, child_bound.memory)};
+      }
+
+      return make_bound(result.term_count, result.degree, result.variable_count, result.memory);
+    }
+
+    auto operator()(const std::shared_ptr<const mul_operator>& mul_operator) {
+      if (is_constant(mul_operator->lhs())) { // 展開と同じで、数値やPlaceholderとの掛け算は係数になるだけです。
+        return get(mul_operator->rhs());
+      }
+
+      if (is_constant(mul_operator->rhs())) {
+        return get(mul_operator->lhs());
+      }
+
+      const auto l_bound = get(mul_operator->lhs());
+      const auto r_bound = get(mul_operator->rhs());
+
+      return make_bound(saturated_multiply(l_bound.term_count, r_bound.term_count), static_cast<double>(l_bound.degree) + r_bound.degree, saturated_add(l_bound.variable_count, r_bound.variable_count), saturated_add(saturated_add(l_bound.memory, r_bound.memory), saturated_add(bytes(l_bound), bytes(r_bound))));
+    }
+
+    auto operator()(const std::shared_ptr<const pow_operator>& pow_operator) {
+      const auto base_bound = get(pow_operator->base());
+
+      const auto term_count = [&] {
+        auto result = 1.0;
+
+        for (auto i = 0; i < pow_operator->exponent() && result < std::numeric_limits<double>::max(); ++i) {
+          result = saturated_multiply(result, base_bound.term_count);
+        }
+
+        return result;
+      }();
+
+      const auto result = make_bound(term_count, static_cast<double>(base_bound.degree) * pow_operator->exponent(), base_bound.variable_count, 0);
+
+      return bound{result.term_count, result.degree, result.variable_count, saturated_add(saturated_add(base_bound.memory, bytes(base_bound)), saturated_multiply(bytes(result), 2))}; // 繰り返し二乗法で、結果と2乗を作ります。
+    }
+
+    auto operator()(const std::shared_ptr<const binary_variable>& binary_variable) {
+      _variables.emplace(binary_variable->id(), true);
+
+      return bound{_domain == domain::binary ? 1.0 : 2.0, 1, 1, 0}; // x = (s + 1) / 2
+    }
+
+    auto operator()(const std::shared_ptr<const spin_variable>& spin_variable) {
+      _variables.emplace(spin_variable->id(), true);
+
+      return bound{_domain == domain::spin ? 1.0 : 2.0, 1, 1, 0}; // s = 2x - 1
+    }
+
+    auto operator()(const std::shared_ptr<const placeholder_variable>&) noexcept {
+      return bound{1, 0, 0, 0};
+    }
+
+    auto operator()(const std::shared_ptr<const sub_hamiltonian>& sub_hamiltonian) {
+      const auto result = get(sub_hamiltonian->expression());
+
+      return bound{result.term_count, result.degree, result.variable_count, saturated_add(result.memory, bytes(result))}; // 展開した多項式を、モデルに残します。
+    }
+
+    auto operator()(const std::shared_ptr<const constraint>& constraint) {
+      const auto result = get(constraint->expression());
+
+      return bound{result.term_count, result.degree, result.variable_count, saturated_add(result.memory, bytes(result))};
+    }
+
+    auto operator()(const std::shared_ptr<const with_penalty>& with_penalty) {
+      const auto expression_bound = get(with_penalty->expression());
+      const auto penalty_bound = get(with_penalty->penalty());
+
+      return make_bound(saturated_add(expression_bound.term_count, penalty_bound.term_count), std::max(expression_bound.degree, penalty_bound.degree), saturated_add(expression_bound.variable_count, penalty_bound.variable_count), saturated_add(expression_bound.memory, penalty_bound.memory));
+    }
+
+    auto operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) {
+      return get(user_defined_expression->expression());
+    }
+
+    auto operator()(const std::shared_ptr<const numeric_literal>&) noexcept {
+      return bound{1, 0, 0, 0};
+    }
+
+    auto operator()(const std::shared_ptr<const quadratic_form>& quadratic_form) {
+      const auto& rows = quadratic_form->rows();
+      const auto& columns = quadratic_form->columns();
+      const auto& linear = quadratic_form->linear();
+
+      const auto indexes = [&] {
+        auto result = std::vector<int>{};
+
+        for (auto i = 0; i < static_cast<int>(std::size(quadratic_form->coefficients())); ++i) {
+          result.emplace_back(rows[i]);
+          result.emplace_back(columns[i]);
+        }
+
+        for (auto i = 0; i < static_cast<int>(std::size(linear)); ++i) {
+          result.emplace_back(i);
+        }
+
+        return result;
+      }();
+
+      const auto quadratic_term_count = static_cast<int>(std::size(quadratic_form->coefficients()));
+
+      return estimate_products(quadratic_form->variables(), quadratic_term_count + static_cast<int>(std::size(linear)), [&](int i) {
+        return i < quadratic_term_count ? std::pair{std::data(indexes) + i * 2, std::data(indexes) + i * 2 + 2} : std::pair{std::data(indexes) + quadratic_term_count * 2 + (i - quadratic_term_count), std::data(indexes) + quadratic_term_count * 2 + (i - quadratic_term_count) + 1};
+      });
+    }
+
+    auto operator()(const std::shared_ptr<const linear_equality>& linear_equality) {
+      const auto indexes = [&] {
+        auto result = std::vector<int>(std::size(linear_equality->variables()));
+
+        std::iota(std::begin(result), std::end(result), 0);
+
+        return result;
+      }();
+
+      const auto linear_bound = estimate_products(linear_equality->variables(), static_cast<int>(std::size(indexes)), [&](int i) {
+        return std::pair{std::data(indexes) + i, std::data(indexes) + i + 1};
+      });
+
+      const auto result = make_bound(saturated_multiply(linear_bound.term_count, linear_bound.term_count), static_cast<double>(linear_bound.degree) * 2, linear_bound.variable_count, 0);
+
+      return bound{result.term_count, result.degree, result.variable_count, saturated_add(saturated_add(linear_bound.memory, bytes(linear_bound)), bytes(result))}; // 1次式と2乗した多項式を、モデルに残します。
+    }
+
+    auto operator()(const std::shared_ptr<const coo_polynomial>& coo_polynomial) {
+      const auto& indptr = coo_polynomial->indptr();
+      const auto& indexes = coo_polynomial->indexes();
+
+      return estimate_products(coo_polynomial->variables(), static_cast<int>(std::size(coo_polynomial->coefficients())), [&](int i) {
+        return std::pair{std::data(indexes) + indptr[i], std::data(indexes) + indptr[i + 1]};
+      });
+    }
+
+    auto operator()(const std::shared_ptr<const logic_gate>& logic_gate) {
+      const auto& terms = logic_gate->terms();
+
+      return estimate_products(logic_gate->operands(), static_cast<int>(std::size(terms)), [&](int i) {
+        return std::pair{std::data(terms[i].indexes), std::data(terms[i].indexes) + std::size(terms[i].indexes)};
+      });
+    }
+
+    auto operator()(const std::shared_ptr<const encoded_integer>& encoded_integer) {
+      const auto indexes = [&] {
+        auto result = std::vector<int>(std::size(encoded_integer->weights()));
+
+        std::iota(std::begin(result), std::end(result), 0);
+
+        return result;
+      }();
+
+      return estimate_products(encoded_integer->variables(), static_cast<int>(std::size(indexes)), [&](int i) {
+        return std::pair{std::data(indexes) + i, std::data(indexes) + i + 1};
+      });
+    }
+  };
+
+  // spinで展開して3次以上の項が残る場合は、compileと同じでbinaryに変換するので、その分も見積もります。項の数は、max_termsに使えるように両方の大きい方にします。
+
+  inline auto estimate_compile(const std::shared_ptr<const expression>& expression, bool quadratize = true, pyquboc::domain domain = domain::binary) {
+    const auto result = estimate(domain)(expression, quadratize);
+
+    if (domain == domain::spin && quadratize && result.degree > 2) {
+      auto binary_result = estimate(domain::binary)(expression, quadratize);
+
+      binary_result.term_count = binary_result.term_count && result.term_count ? std::optional<double>{std::max(*binary_result.term_count, *result.term_count)} : std::nullopt;
+      binary_result.memory = binary_result.memory && result.memory ? bounded(saturated_add(*binary_result.memory, *result.memory)) : std::nullopt;
+
+      return binary_result;
+    }
+
+    return result;
   }
 }
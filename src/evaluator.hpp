@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "model.hpp"
+
+namespace pyquboc {
+  // Term index.
+
+  // 係数を評価済みの項を、変数ごとにCSR形式で引けるようにしたものです。presolveで固定した変数は係数に掛けてしまって、反転しても何も変わらないようにします（decode_sampleも、固定した値を使います）。
+
+  class term_index final {
+  public:
+    struct term final {
+      std::size_t begin; // indexesの範囲。
+      std::size_t end;
+      double coefficient;
+      int group; // 項が属する多項式（Constraintなど）のインデックス。
+    };
+
+  private:
+    std::vector<std::optional<int>> _fixed_values;
+    std::vector<term> _terms;
+    std::vector<int> _indexes;
+    std::vector<std::size_t> _variable_indptr;
+    std::vector<int> _variable_terms;
+
+  public:
+    term_index(const model& model, std::size_t variable_count) noexcept : _fixed_values(variable_count), _terms{}, _indexes{}, _variable_indptr{}, _variable_terms{} {
+      for (const auto& [index, value] : model.fixed_values()) {
+        _fixed_values[index] = value;
+      }
+    }
+
+    auto add(const polynomial& polynomial, const pyquboc::evaluate& evaluate, int group) {
+      for (const auto& [product, coefficient] : polynomial) {
+        const auto begin = std::size(_indexes);
+
+        auto coefficient_value = evaluate(coefficient);
+
+        for (const auto& index : product.indexes()) {
+          if (_fixed_values[index]) {
+            coefficient_value *= *_fixed_values[index];
+            continue;
+          }
+
+          _indexes.emplace_back(index);
+        }
+
+        _terms.emplace_back(term{begin, std::size(_indexes), coefficient_value, group});
+      }
+    }
+
+    // 項を追加し終わったら呼び出して、変数ごとの項のリストを作ります。定数項は、どの変数のリストにも入りません。
+
+    auto build() {
+      _variable_indptr = std::vector<std::size_t>(std::size(_fixed_values) + 1, 0);
+
+      for (const auto& index : _indexes) {
+        ++_variable_indptr[index + 1];
+      }
+
+      std::partial_sum(std::begin(_variable_indptr), std::end(_variable_indptr), std::begin(_variable_indptr));
+
+      _variable_terms = std::vector<int>(std::size(_indexes));
+
+      auto positions = std::vector<std::size_t>(std::begin(_variable_indptr), std::prev(std::end(_variable_indptr)));
+
+      for (auto i = 0; i < static_cast<int>(std::size(_terms)); ++i) {
+        for (auto j = _terms[i].begin; j < _terms[i].end; ++j) {
+          _variable_terms[positions[_indexes[j]]++] = i;
+        }
+      }
+    }
+
+    const auto& terms() const noexcept {
+      return _terms;
+    }
+
+    auto index(std::size_t position) const noexcept {
+      return _indexes[position];
+    }
+
+    // 変数を含む項を、順にfunctionに渡します。
+
+    template <typename Function>
+    auto for_each_term(int index, Function&& function) const noexcept {
+      for (auto i = _variable_indptr[index]; i < _variable_indptr[index + 1]; ++i) {
+        function(_terms[_variable_terms[i]]);
+      }
+    }
+
+    auto product(const term& term, const std::vector<int>& values, int except_1 = -1, int except_2 = -1) const noexcept {
+      auto result = term.coefficient;
+
+      for (auto i = term.begin; i < term.end; ++i) {
+        if (_indexes[i] != except_1 && _indexes[i] != except_2) {
+          result *= values[_indexes[i]];
+        }
+      }
+
+      return result;
+    }
+  };
+
+  inline auto flipped_value(pyquboc::domain domain, int value) noexcept {
+    return domain == domain::binary ? 1 - value : -value;
+  }
+
+  // Constraint tracker.
+
+  // 変数を反転したときに、Constraintのエネルギーと充足しているかを差分で更新します。変数からConstraintへの転置インデックス（model::variable_constraints）を使って、conditionは値が変わったConstraintだけで評価します。
+  // 充足していないConstraintの数は、O(1)で取得できます。値はモデルの定義域（BINARYなら0と1、SPINなら-1と1）です。スレッド・セーフではありません。
+  // conditionはPythonの関数かもしれないので、反転のたびに評価したくない場合は、flip()のかわりにupdate()で値だけを更新して、問い合わせの前にrefresh()を呼んでください。
+
+  class constraint_tracker final {
+    pyquboc::domain _domain;
+    std::vector<int> _values;
+    term_index _terms;
+    std::vector<std::string> _names;
+    std::vector<std::function<bool(double)>> _conditions;
+    std::vector<bool> _squared;
+    std::vector<double> _constraint_values; // squaredなConstraintは、2乗する前の値です。
+    std::vector<bool> _satisfied;
+    std::vector<std::size_t> _constraint_indptr; // model::variable_constraintsの写しです。モデルより長生きしても大丈夫なように、コピーしておきます。
+    std::vector<int> _variable_constraints;
+    int _broken_count;
+    std::vector<bool> _stale; // update()で値が変わって、conditionをまだ評価していないConstraintです。
+    std::vector<int> _stale_constraints;
+    mutable std::vector<double> _differences; // Constraintごとの値の変化量を溜める作業領域。使い終わったら0に戻します。
+
+    auto energy(int constraint, double value) const noexcept {
+      return _squared[constraint] ? value * value : value;
+    }
+
+    auto satisfied(int constraint, double value) const {
+      return _conditions[constraint](energy(constraint, value));
+    }
+
+    auto add_differences(int index) const noexcept {
+      const auto difference = flipped_value(_domain, _values[index]) - _values[index];
+
+      _terms.for_each_term(index, [&](const auto& term) {
+        _differences[term.group] += _terms.product(term, _values, index) * difference;
+      });
+    }
+
+    auto reset() {
+      std::fill(std::begin(_constraint_values), std::end(_constraint_values), 0.0);
+
+      for (const auto& term : _terms.terms()) {
+        _constraint_values[term.group] += _terms.product(term, _values);
+      }
+
+      _broken_count = 0;
+
+      std::fill(std::begin(_stale), std::end(_stale), false);
+      _stale_constraints.clear();
+
+      for (auto i = 0; i < static_cast<int>(std::size(_names)); ++i) {
+        _satisfied[i] = satisfied(i, _constraint_values[i]);
+        _broken_count += !_satisfied[i];
+      }
+    }
+
+  public:
+    constraint_tracker(const pyquboc::model& model, std::vector<int> values, const std::unordered_map<std::string, double>& feed_dict) : _domain(model.domain()), _values(std::move(values)), _terms(model, std::size(_values)), _names(model.constraint_names()), _conditions{}, _squared{}, _constraint_values(std::size(_names)), _satisfied(std::size(_names)), _constraint_indptr{0}, _variable_constraints{}, _broken_count(0), _stale(std::size(_names)), _stale_constraints{}, _differences(std::size(_names)) {
+      const auto evaluate = pyquboc::evaluate(feed_dict);
+
+      for (auto i = 0; i < static_cast<int>(std::size(_names)); ++i) {
+        const auto& constraint = model.constraint_polynomials().at(_names[i]);
+
+        _terms.add(constraint.polynomial(), evaluate, i);
+
+        _conditions.emplace_back(constraint.condition());
+        _squared.emplace_back(constraint.squared());
+      }
+
+      _terms.build();
+
+      for (auto i = 0; i < static_cast<int>(std::size(_values)); ++i) {
+        const auto [begin, end] = model.variable_constraints(i);
+
+        _variable_constraints.insert(std::end(_variable_constraints), begin, end);
+        _constraint_indptr.emplace_back(std::size(_variable_constraints));
+      }
+
+      reset();
+    }
+
+    auto recompute() {
+      reset();
+    }
+
+    // 変数を反転して、充足していないConstraintの数の変化量を返します。
+
+    auto flip(int index) {
+      add_differences(index);
+
+      const auto previous_broken_count = _broken_count;
+
+      for (auto it = std::begin(_variable_constraints) + _constraint_indptr[index]; it != std::begin(_variable_constraints) + _constraint_indptr[index + 1]; ++it) {
+        _constraint_values[*it] += _differences[*it];
+        _differences[*it] = 0;
+
+        const auto constraint_satisfied = satisfied(*it, _constraint_values[*it]);
+
+        _broken_count += static_cast<int>(_satisfied[*it]) - static_cast<int>(constraint_satisfied);
+        _satisfied[*it] = constraint_satisfied;
+      }
+
+      _values[index] = flipped_value(_domain, _values[index]);
+
+      return _broken_count - previous_broken_count;
+    }
+
+    // 変数を反転して、Constraintの値だけを更新します。conditionは、refresh()まで評価しません。
+
+    auto update(int index) {
+      add_differences(index);
+
+      for (auto it = std::begin(_variable_constraints) + _constraint_indptr[index]; it != std::begin(_variable_constraints) + _constraint_indptr[index + 1]; ++it) {
+        _constraint_values[*it] += _differences[*it];
+        _differences[*it] = 0;
+
+        if (!_stale[*it]) {
+          _stale[*it] = true;
+          _stale_constraints.emplace_back(*it);
+        }
+      }
+
+      _values[index] = flipped_value(_domain, _values[index]);
+    }
+
+    // update()で値が変わったConstraintのconditionを評価して、充足しているかを更新します。
+
+    auto refresh() {
+      for (const auto constraint : _stale_constraints) {
+        const auto constraint_satisfied = satisfied(constraint, _constraint_values[constraint]);
+
+        _broken_count += static_cast<int>(_satisfied[constraint]) - static_cast<int>(constraint_satisfied);
+        _satisfied[constraint] = constraint_satisfied;
+        _stale[constraint] = false;
+      }
+
+      _stale_constraints.clear();
+    }
+
+    // 変数を反転したら充足していないConstraintの数がどれだけ変わるかを、状態を変えずに返します。
+
+    auto broken_count_delta(int index) const {
+      add_differences(index);
+
+      auto result = 0;
+
+      for (auto it = std::begin(_variable_constraints) + _constraint_indptr[index]; it != std::begin(_variable_constraints) + _constraint_indptr[index + 1]; ++it) {
+        result += static_cast<int>(_satisfied[*it]) - static_cast<int>(satisfied(*it, _constraint_values[*it] + _differences[*it]));
+        _differences[*it] = 0;
+      }
+
+      return result;
+    }
+
+    auto size() const noexcept {
+      return std::size(_values);
+    }
+
+    const auto& values() const noexcept {
+      return _values;
+    }
+
+    auto broken_count() const noexcept {
+      return _broken_count;
+    }
+
+    auto broken() const {
+      auto result = std::vector<std::string>{};
+
+      for (auto i = 0; i < static_cast<int>(std::size(_names)); ++i) {
+        if (!_satisfied[i]) {
+          result.emplace_back(_names[i]);
+        }
+      }
+
+      return result;
+    }
+
+    auto constraints(bool only_broken) const {
+      auto result = std::unordered_map<std::string, std::pair<bool, double>>{};
+
+      for (auto i = 0; i < static_cast<int>(std::size(_names)); ++i) {
+        if (only_broken && _satisfied[i]) {
+          continue;
+        }
+
+        result.emplace(_names[i], std::pair{static_cast<bool>(_satisfied[i]), energy(i, _constraint_values[i])});
+      }
+
+      return result;
+    }
+  };
+
+  // Evaluator.
+
+  // Pythonで書いたサンプラー向けに、現在の状態から1変数を反転したときのエネルギーの変化量を、O(次数)で求めて更新します。
+  // 局所場（変数の値を変えたときに変わる項の係数の和）と、反転したときの変化量（delta）を持ち続けます。3次以上の項があっても大丈夫です。Constraintは、constraint_trackerで追跡します。
+  // 反転のたびに更新するのはConstraintの値だけで、conditionは充足しているかを問い合わせたときに評価します。なので、flip()がPythonの関数を呼ぶことはありません。
+  // 値はモデルの定義域（BINARYなら0と1、SPINなら-1と1）です。スレッド・セーフではありません。
+
+  class evaluator final {
+    pyquboc::domain _domain;
+    std::vector<int> _values;
+    term_index _terms;
+    std::vector<double> _fields;
+    std::vector<double> _deltas;
+    double _energy;
+    constraint_tracker _tracker;
+
+    auto reset() noexcept {
+      std::fill(std::begin(_fields), std::end(_fields), 0.0);
+
+      _energy = 0;
+
+      for (const auto& term : _terms.terms()) {
+        _energy += _terms.product(term, _values);
+
+        for (auto i = term.begin; i < term.end; ++i) {
+          _fields[_terms.index(i)] += _terms.product(term, _values, _terms.index(i));
+        }
+      }
+
+      for (auto i = 0; i < static_cast<int>(std::size(_values)); ++i) {
+        _deltas[i] = _fields[i] * (flipped_value(_domain, _values[i]) - _values[i]);
+      }
+    }
+
+  public:
+    evaluator(const model& model, std::vector<int> values, const std::unordered_map<std::string, double>& feed_dict) : _domain(model.domain()), _values(values), _terms(model, std::size(values)), _fields(std::size(values)), _deltas(std::size(values)), _energy(0), _tracker(model, std::move(values), feed_dict) {
+      _terms.add(model.terms(), pyquboc::evaluate(feed_dict), 0);
+      _terms.build();
+
+      reset();
+    }
+
+    auto size() const noexcept {
+      return std::size(_values);
+    }
+
+    auto energy() const noexcept {
+      return _energy;
+    }
+
+    const auto& values() const noexcept {
+      return _values;
+    }
+
+    const auto& deltas() const noexcept {
+      return _deltas;
+    }
+
+    auto delta(int index) const noexcept {
+      return _deltas[index];
+    }
+
+    auto broken_count() {
+      _tracker.refresh();
+
+      return _tracker.broken_count();
+    }
+
+    // 変数を反転して、エネルギーの変化量を返します。
+
+    auto flip(int index) {
+      const auto result = _deltas[index];
+      const auto difference = flipped_value(_domain, _values[index]) - _values[index];
+
+      _terms.for_each_term(index, [&](const auto& term) {
+        for (auto i = term.begin; i < term.end; ++i) { // 同じ項の他の変数の局所場が、変わります。
+          const auto other = _terms.index(i);
+
+          if (other == index) {
+            continue;
+          }
+
+          const auto field_difference = _terms.product(term, _values, index, other) * difference;
+
+          _fields[other] += field_difference;
+          _deltas[other] += field_difference * (flipped_value(_domain, _values[other]) - _values[other]);
+        }
+      });
+
+      _values[index] += difference;
+      _deltas[index] = -result;
+      _energy += result;
+
+      _tracker.update(index);
+
+      return result;
+    }
+
+    // 浮動小数点数の誤差が溜まらないように、ときどき呼び出して計算しなおしてください。
+
+    auto recompute() {
+      reset();
+      _tracker.recompute();
+    }
+
+    auto constraints(bool only_broken) {
+      _tracker.refresh();
+
+      return _tracker.constraints(only_broken);
+    }
+  };
+}
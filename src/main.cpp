@@ -1,8 +1,17 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <vector>
 
+#include <pybind11/eigen.h>
 #include <pybind11/functional.h>
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
@@ -11,13 +20,229 @@
 #include <vartypes.hpp>
 
 #include "abstract_syntax_tree.hpp"
+#include "cache.hpp"
 #include "compiler.hpp"
+#include "evaluator.hpp"
+#include "parser.hpp"
+#include "thread_pool.hpp"
+
+#define STRINGIFY(x) #x
+#define MACRO_STRINGIFY(x) STRINGIFY(x)
+
+#ifdef VERSION_INFO
+constexpr auto version = MACRO_STRINGIFY(VERSION_INFO);
+#else
+constexpr auto version = "dev";
+#endif
 
 namespace py = pybind11;
 using namespace py::literals;
 
+// Pythonのオブジェクトに触らない処理は、GILを解放して実行します。他のスレッドが、同時にモデルを使えるように。
+
+template <typename Function>
+auto without_gil(Function&& function) {
+  py::gil_scoped_release release;
+
+  return function();
+}
+
+// コンパイルは、Pythonのオブジェクトに触らないのでGILを解放して実行します（Constraintのconditionのコピーでは、pybind11がGILを取り直します）。
+// コンパイル中の式を、他のスレッドで`+=`して書き換えないでください。
+
+auto compile_expression(const std::shared_ptr<const pyquboc::expression>& expression, double strength, pyquboc::quadratization quadratization, bool compact, bool quadratize, pyquboc::domain domain, const std::optional<std::string>& cache_dir, const pyquboc::compile_options& options) {
+  if (cache_dir) {
+    return pyquboc::compile_with_cache(expression, strength, quadratization, compact, quadratize, domain, *cache_dir, version, options);
+  }
+
+  return pyquboc::compile(expression, strength, quadratization, compact, quadratize, domain, options);
+}
+
+// max_terms、max_memory、time_limitは、Noneなら制限しません。
+// progressは、コンパイルしているスレッドからGILを取って、progress_interval秒ごとに進捗のdictを引数にして呼び出します。例外を投げると、コンパイルを中断します。
+
+auto to_compile_options(const std::optional<std::size_t>& max_terms, const std::optional<std::size_t>& max_memory, const std::optional<double>& time_limit, const std::optional<py::function>& progress, double progress_interval) {
+  auto result = pyquboc::compile_options{};
+
+  if (max_terms) {
+    result.max_terms = *max_terms;
+  }
+
+  if (max_memory) {
+    result.max_memory = *max_memory;
+  }
+
+  result.time_limit = time_limit;
+
+  if (progress) {
+    // GILを持たないスレッドでコピーされたり破棄されたりしても大丈夫なように、std::shared_ptrで包んで、最後に破棄するときにGILを取ります。
+    const auto function = std::shared_ptr<py::function>(new py::function(*progress), [](py::function* function) {
+      py::gil_scoped_acquire acquire;
+
+      delete function;
+    });
+
+    result.progress = [function](const pyquboc::compile_progress& state) {
+      py::gil_scoped_acquire acquire;
+
+      (*function)(py::dict("phase"_a = pyquboc::to_string(state.phase), "fraction"_a = state.fraction, "terms"_a = state.term_count, "variables"_a = state.variable_count, "elapsed"_a = state.elapsed));
+    };
+
+    result.progress_interval = progress_interval;
+  }
+
+  return result;
+}
+
+// Ctrl-Cでコンパイルを止められるように、ときどきGILを取ってシグナルを調べます。KeyboardInterruptは、そのまま投げ直されます。
+
+auto check_signals() {
+  py::gil_scoped_acquire acquire;
+
+  if (PyErr_CheckSignals() != 0) {
+    throw py::error_already_set();
+  }
+}
+
+// compile_asyncの戻り値です。concurrent.futures.Futureと同じように、result()で結果を待ちます。
+// cancel()すると、コンパイルは次のチェックポイントで止まって、result()はCompileCancelledErrorを投げます。
+
+class compile_future final {
+  std::shared_future<pyquboc::model> _future;
+  std::shared_ptr<std::atomic<bool>> _cancelled;
+
+public:
+  compile_future(std::shared_future<pyquboc::model> future, std::shared_ptr<std::atomic<bool>> cancelled) noexcept : _future(std::move(future)), _cancelled(std::move(cancelled)) {
+    ;
+  }
+
+  auto done() const noexcept {
+    return _future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  // 終わる前に止められた場合は、Trueを返します。
+
+  auto cancel() noexcept {
+    *_cancelled = true;
+
+    return !done();
+  }
+
+  auto result(const std::optional<double>& timeout) {
+    const auto deadline = timeout ? std::optional(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(*timeout))) : std::nullopt;
+
+    for (;;) {
+      // 待っている間にワーカーがGILを取れるように、GILを解放して待ちます。Ctrl-Cを調べられるように、少しずつ待ちます。
+      const auto ready = without_gil([&] {
+        const auto slice = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+
+        return _future.wait_until(deadline ? std::min(*deadline, slice) : slice) == std::future_status::ready;
+      });
+
+      if (ready) {
+        break;
+      }
+
+      if (PyErr_CheckSignals() != 0) { // Ctrl-Cで待つのをやめたら、コンパイルも止めます。
+        cancel();
+        throw py::error_already_set();
+      }
+
+      if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+        PyErr_SetString(PyExc_TimeoutError, "compile did not finish in time.");
+        throw py::error_already_set();
+      }
+    }
+
+    return _future.get(); // コンパイルで発生した例外は、ここで投げ直されます。
+  }
+};
+
+// サンプルの型を例外を使わずに判定して、型に合わせた形でfunctionを呼び出します。
+// numpyの配列やリストは、変数のインデックス順のサンプルとして扱います。int8とint32の連続した配列は、コピーせずにそのまま参照します。
+// dictは、キーが文字列なら変数の名前、整数なら変数のインデックスとして扱います。
+
+template <typename T, typename Function>
+auto visit_dense_sample(const py::handle& sample, Function&& function) {
+  const auto array = py::array_t<T, py::array::c_style | py::array::forcecast>::ensure(sample); // 型と並びが合っていれば、コピーしません。
+
+  if (!array || array.ndim() != 1) {
+    throw std::runtime_error("invalid sample");
+  }
+
+  return function(pyquboc::dense_sample<T>(array.data(), array.size()));
+}
+
+template <typename Function>
+auto visit_sample(const py::object& sample, Function&& function) {
+  if (py::isinstance<py::array>(sample)) {
+    if (py::reinterpret_borrow<py::array>(sample).dtype().is(py::dtype::of<std::int8_t>())) {
+      return visit_dense_sample<std::int8_t>(sample, function);
+    }
+
+    return visit_dense_sample<std::int32_t>(sample, function);
+  }
+
+  if (py::isinstance<py::dict>(sample) || py::hasattr(sample, "items")) { // dimodのSampleViewのようなMappingも、dictにして受け付けます。
+    const auto dict = py::isinstance<py::dict>(sample) ? py::reinterpret_borrow<py::dict>(sample) : py::dict(sample);
+
+    if (std::empty(dict) || py::isinstance<py::str>((*std::begin(dict)).first)) {
+      return function(dict.cast<std::unordered_map<std::string, int>>());
+    }
+
+    return function(dict.cast<std::unordered_map<int, int>>());
+  }
+
+  if (py::isinstance<py::sequence>(sample) && !py::isinstance<py::str>(sample)) {
+    return visit_dense_sample<std::int32_t>(sample, function);
+  }
+
+  throw std::runtime_error("invalid sample");
+}
+
+// dimodのSampleSetを、エネルギー順のサンプルのリストに変換します。ラベルの型が合わない場合は、例外になります。
+
+template <typename T>
+auto to_samples(const py::object& sampleset) {
+  sampleset.attr("record").attr("sort")("order"_a = "energy");
+
+  const auto array = sampleset.attr("record")["sample"].cast<py::array_t<std::int8_t>>();
+  const auto info = array.request();
+
+  if (info.format != py::format_descriptor<int8_t>::format() || info.ndim != 2) {
+    throw std::runtime_error("Incompatible buffer format!");
+  }
+
+  const auto variables = sampleset.attr("variables").cast<std::vector<T>>(); // presolveしたモデルでは、インデックスが0から連続しているとは限りません。
+
+  auto result = std::vector<std::unordered_map<T, int>>(info.shape[0]);
+
+  for (auto i = 0; i < info.shape[0]; ++i) {
+    for (auto j = 0; j < info.shape[1]; ++j) {
+      result[i].emplace(variables[j], *array.data(i, j));
+    }
+  }
+
+  return result;
+}
+
 PYBIND11_MODULE(cpp_pyquboc, m) {
   m.doc() = "pyquboc C++ binding";
+  m.attr("__version__") = version;
+
+  py::register_exception<pyquboc::term_limit_error>(m, "CompileLimitError", PyExc_MemoryError); // max_termsやmax_memoryを超えた場合の例外です。MemoryErrorのサブクラスにします。
+  py::register_exception<pyquboc::compile_timeout_error>(m, "CompileTimeoutError", PyExc_TimeoutError); // time_limitを過ぎた場合の例外です。
+  py::register_exception<pyquboc::compile_cancelled_error>(m, "CompileCancelledError", PyExc_RuntimeError); // CompileFuture.cancel()で止めた場合の例外です。
+  py::register_exception<pyquboc::parse_error>(m, "ModelParseError", PyExc_ValueError); // parse_modelで、モデルのテキストが不正な場合の例外です。
+
+  // スレッド・プールはstaticなので、何もしないとPy_Finalizeの後で止まります。終了時にまだタスクがあると、放置されたcompile_asyncの終わりを待たされたり、タスクが持つPythonのオブジェクトを破棄するときに終了したインタープリターのGILを取ろうとしてしまったりします。
+  // なので、インタープリターが終わる前にプールを止めます。実行中のタスクがGILを取れるように、GILを解放して待ちます。
+
+  py::module_::import("atexit").attr("register")(py::cpp_function([] {
+    without_gil([] {
+      pyquboc::thread_pool::instance().stop();
+    });
+  }));
 
   py::class_<pyquboc::expression, std::shared_ptr<pyquboc::expression>>(m, "Base")
       .def("__add__", [](const std::shared_ptr<const pyquboc::expression>& expression, const std::shared_ptr<const pyquboc::expression>& other) {
@@ -59,22 +284,55 @@ PYBIND11_MODULE(cpp_pyquboc, m) {
           throw std::runtime_error("`exponent` should be positive.");
         }
 
-        auto result = expression;
-
-        for (auto i = 1; i < expotent; ++i) {
-          result = result * expression;
-        }
-
-        return result;
+        return pyquboc::pow(expression, expotent);
       })
       .def("__neg__", [](const std::shared_ptr<const pyquboc::expression>& expression) {
         return std::make_shared<const pyquboc::numeric_literal>(-1) * expression;
       })
       .def(
-          "compile", [](const std::shared_ptr<const pyquboc::expression>& expression, double strength) {
-            return pyquboc::compile(expression, strength);
+          "compile", [](const std::shared_ptr<const pyquboc::expression>& expression, double strength, const std::string& quadratization, bool compact, bool quadratize, const std::string& domain, const std::optional<std::string>& cache_dir, const std::optional<std::size_t>& max_terms, const std::optional<std::size_t>& max_memory, const std::optional<double>& time_limit, const std::optional<py::function>& progress, double progress_interval) {
+            const auto result_quadratization = pyquboc::to_quadratization(quadratization);
+            const auto result_domain = pyquboc::to_domain(domain);
+
+            auto options = to_compile_options(max_terms, max_memory, time_limit, progress, progress_interval);
+
+            options.interrupt = check_signals;
+
+            return without_gil([&] { return compile_expression(expression, strength, result_quadratization, compact, quadratize, result_domain, cache_dir, options); });
+          },
+          py::arg("strength") = 5, py::arg("quadratization") = "greedy", py::arg("compact") = false, py::arg("quadratize") = true, py::arg("domain") = "BINARY", py::arg("cache_dir") = py::none(), py::arg("max_terms") = py::none(), py::arg("max_memory") = py::none(), py::arg("time_limit") = py::none(), py::arg("progress") = py::none(), py::arg("progress_interval") = 0.1)
+      .def(
+          "compile_async", [](const std::shared_ptr<const pyquboc::expression>& expression, double strength, const std::string& quadratization, bool compact, bool quadratize, const std::string& domain, const std::optional<std::string>& cache_dir, const std::optional<std::size_t>& max_terms, const std::optional<std::size_t>& max_memory, const std::optional<double>& time_limit, const std::optional<py::function>& progress, double progress_interval) {
+            const auto result_quadratization = pyquboc::to_quadratization(quadratization);
+            const auto result_domain = pyquboc::to_domain(domain);
+            const auto cancelled = std::make_shared<std::atomic<bool>>(false);
+
+            auto options = to_compile_options(max_terms, max_memory, time_limit, progress, progress_interval);
+
+            options.cancelled = cancelled; // ワーカーのスレッドではシグナルを調べられないので、Ctrl-Cは待っている側（result()）で調べます。
+            options.interrupt = [] { // インタープリターの終了でプールが止められたら、実行中のコンパイルも止めます。
+              if (pyquboc::thread_pool::instance().stopped()) {
+                throw pyquboc::compile_cancelled_error("compile was cancelled because the interpreter is exiting.");
+              }
+            };
+
+            return compile_future(pyquboc::thread_pool::instance().submit([=] { return compile_expression(expression, strength, result_quadratization, compact, quadratize, result_domain, cache_dir, options); }).share(), cancelled);
+          },
+          py::arg("strength") = 5, py::arg("quadratization") = "greedy", py::arg("compact") = false, py::arg("quadratize") = true, py::arg("domain") = "BINARY", py::arg("cache_dir") = py::none(), py::arg("max_terms") = py::none(), py::arg("max_memory") = py::none(), py::arg("time_limit") = py::none(), py::arg("progress") = py::none(), py::arg("progress_interval") = 0.1)
+      .def(
+          "estimate_compile", [](const std::shared_ptr<const pyquboc::expression>& expression, double, const std::string& quadratization, bool quadratize, const std::string& domain) {
+            pyquboc::to_quadratization(quadratization); // 見積もりには影響しませんが、compileと同じ引数を受け付けて、同じようにチェックします。
+
+            const auto result_domain = pyquboc::to_domain(domain);
+            const auto estimate = without_gil([&] { return pyquboc::estimate_compile(expression, quadratize, result_domain); });
+
+            const auto to_int = [](const std::optional<double>& value) -> py::object { // 上限が大きすぎてdoubleで表せない場合は、math.infにします。
+              return value ? py::object(py::int_(py::float_(std::ceil(*value)))) : py::module_::import("math").attr("inf");
+            };
+
+            return py::dict("terms"_a = to_int(estimate.term_count), "degree"_a = estimate.degree, "variables"_a = estimate.variable_count, "auxiliary_variables"_a = to_int(estimate.auxiliary_variable_count), "memory"_a = to_int(estimate.memory));
           },
-          py::arg("strength") = 5)
+          py::arg("strength") = 5, py::arg("quadratization") = "greedy", py::arg("quadratize") = true, py::arg("domain") = "BINARY")
       .def("__hash__", [](const pyquboc::expression& expression) { // 必要？
         return std::hash<pyquboc::expression>()(expression);
       })
@@ -118,6 +376,186 @@ PYBIND11_MODULE(cpp_pyquboc, m) {
   py::class_<pyquboc::numeric_literal, std::shared_ptr<pyquboc::numeric_literal>, pyquboc::expression>(m, "Num")
       .def(py::init<double>());
 
+  py::class_<pyquboc::quadratic_form, std::shared_ptr<pyquboc::quadratic_form>, pyquboc::expression>(m, "QuadraticForm")
+      .def(py::init([](const py::object& q, const std::vector<std::shared_ptr<const pyquboc::expression>>& variables, const py::object& linear, double offset) {
+             const auto to_vector = [](const py::object& object, auto value) {
+               using value_type = decltype(value);
+
+               const auto array = py::array_t<value_type, py::array::c_style | py::array::forcecast>::ensure(object);
+
+               if (!array || array.ndim() != 1) {
+                 throw std::runtime_error("invalid array.");
+               }
+
+               return std::vector<value_type>(array.data(), array.data() + array.size());
+             };
+
+             auto rows = std::vector<int>{};
+             auto columns = std::vector<int>{};
+             auto coefficients = std::vector<double>{};
+
+             // scipy.sparseの行列なら、COO形式に変換して非ゼロ要素だけを使います。
+             const auto coo = py::hasattr(q, "tocoo") ? q.attr("tocoo")() : q;
+
+             if (py::hasattr(coo, "row") && py::hasattr(coo, "col") && py::hasattr(coo, "data")) {
+               rows = to_vector(coo.attr("row"), 0);
+               columns = to_vector(coo.attr("col"), 0);
+               coefficients = to_vector(coo.attr("data"), 0.0);
+             } else {
+               const auto array = py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(coo);
+
+               if (!array || array.ndim() != 2 || array.shape(0) != static_cast<py::ssize_t>(std::size(variables)) || array.shape(1) != static_cast<py::ssize_t>(std::size(variables))) {
+                 throw std::runtime_error("`Q` should be a square matrix of the same size as `variables`.");
+               }
+
+               for (auto i = 0; i < array.shape(0); ++i) {
+                 for (auto j = 0; j < array.shape(1); ++j) {
+                   if (*array.data(i, j) == 0) {
+                     continue;
+                   }
+
+                   rows.emplace_back(i);
+                   columns.emplace_back(j);
+                   coefficients.emplace_back(*array.data(i, j));
+                 }
+               }
+             }
+
+             if (std::size(rows) != std::size(coefficients) || std::size(columns) != std::size(coefficients)) {
+               throw std::runtime_error("`row`, `col` and `data` of `Q` should have the same size.");
+             }
+
+             if (std::any_of(std::begin(rows), std::end(rows), [&](const auto& row) { return row < 0 || row >= static_cast<int>(std::size(variables)); }) ||
+                 std::any_of(std::begin(columns), std::end(columns), [&](const auto& column) { return column < 0 || column >= static_cast<int>(std::size(variables)); })) {
+               throw std::runtime_error("index of `Q` is out of range.");
+             }
+
+             const auto linear_coefficients = linear.is_none() ? std::vector<double>{} : to_vector(linear, 0.0);
+
+             if (!linear.is_none() && std::size(linear_coefficients) != std::size(variables)) {
+               throw std::runtime_error("`linear` should have the same size as `variables`.");
+             }
+
+             return std::make_shared<pyquboc::quadratic_form>(variables, rows, columns, coefficients, linear_coefficients, offset);
+           }),
+           py::arg("Q"), py::arg("variables"), py::arg("linear") = py::none(), py::arg("offset") = 0);
+
+  py::class_<pyquboc::coo_polynomial, std::shared_ptr<pyquboc::coo_polynomial>, pyquboc::expression>(m, "Polynomial")
+      .def_static(
+          "from_coo", [](const std::vector<std::shared_ptr<const pyquboc::expression>>& variables, const py::object& index_arrays, const py::object& coefficients, double offset) {
+            // index_arraysは(次数, 項の数)の形で、index_arrays[d][i]がi番目の項のd番目の変数です。次数が小さい項は、-1で埋めてください。
+            const auto indexes = py::array_t<int, py::array::c_style | py::array::forcecast>::ensure(index_arrays);
+            const auto values = py::array_t<double, py::array::c_style | py::array::forcecast>::ensure(coefficients);
+
+            if (!indexes || indexes.ndim() != 2) {
+              throw std::runtime_error("`index_arrays` should be a sequence of index arrays.");
+            }
+
+            if (!values || values.ndim() != 1 || values.shape(0) != indexes.shape(1)) {
+              throw std::runtime_error("`coefficients` should have the same size as each array of `index_arrays`.");
+            }
+
+            const auto degree = indexes.shape(0);
+            const auto size = indexes.shape(1);
+            const auto data = indexes.unchecked<2>();
+
+            auto indptr = std::vector<std::int64_t>{0};
+            auto flat_indexes = std::vector<int>{};
+
+            indptr.reserve(size + 1);
+            flat_indexes.reserve(degree * size);
+
+            for (auto i = py::ssize_t{0}; i < size; ++i) {
+              for (auto d = py::ssize_t{0}; d < degree; ++d) {
+                const auto index = data(d, i);
+
+                if (index == -1) {
+                  continue;
+                }
+
+                if (index < 0 || index >= static_cast<int>(std::size(variables))) {
+                  throw std::runtime_error("index of `index_arrays` is out of range.");
+                }
+
+                flat_indexes.emplace_back(index);
+              }
+
+              indptr.emplace_back(std::size(flat_indexes));
+            }
+
+            return std::make_shared<pyquboc::coo_polynomial>(variables, std::move(indptr), std::move(flat_indexes), std::vector<double>(values.data(), values.data() + values.size()), offset);
+          },
+          py::arg("variables"), py::arg("index_arrays"), py::arg("coefficients"), py::arg("offset") = 0);
+
+  py::class_<pyquboc::logic_gate, std::shared_ptr<pyquboc::logic_gate>, pyquboc::expression>(m, "LogicGate")
+      .def(py::init([](const std::string& gate, const std::vector<std::shared_ptr<const pyquboc::expression>>& operands) {
+             const auto result_gate = pyquboc::to_gate(gate);
+
+             if (static_cast<int>(std::size(operands)) != pyquboc::logic_gate::arity(result_gate)) {
+               throw std::runtime_error("'" + gate + "' gate takes " + std::to_string(pyquboc::logic_gate::arity(result_gate)) + " operands.");
+             }
+
+             return std::make_shared<pyquboc::logic_gate>(result_gate, operands);
+           }),
+           py::arg("gate"), py::arg("operands"));
+
+  py::class_<pyquboc::encoded_integer, std::shared_ptr<pyquboc::encoded_integer>, pyquboc::expression>(m, "EncodedInteger")
+      .def(py::init([](const std::string& encoding, const std::vector<std::shared_ptr<const pyquboc::expression>>& variables, const std::pair<int, int>& value_range) {
+             const auto result_encoding = pyquboc::to_encoding(encoding);
+             const auto& [lower, upper] = value_range;
+
+             if (upper <= lower) {
+               throw std::runtime_error("upper value should be larger than lower value.");
+             }
+
+             if (static_cast<int>(std::size(variables)) != pyquboc::encoded_integer::variable_count(result_encoding, lower, upper)) {
+               throw std::runtime_error("'" + encoding + "' encoding of the range needs " + std::to_string(pyquboc::encoded_integer::variable_count(result_encoding, lower, upper)) + " variables.");
+             }
+
+             return std::make_shared<pyquboc::encoded_integer>(result_encoding, variables, lower, upper);
+           }),
+           py::arg("encoding"), py::arg("variables"), py::arg("value_range"));
+
+  py::class_<pyquboc::linear_equality, std::shared_ptr<pyquboc::linear_equality>, pyquboc::expression>(m, "LinearEquality")
+      .def(py::init([](const std::vector<double>& coefficients, const std::vector<std::shared_ptr<const pyquboc::expression>>& variables, double rhs, const std::string& label, double tolerance) {
+             if (std::size(coefficients) != std::size(variables)) {
+               throw std::runtime_error("`coefficients` should have the same size as `variables`.");
+             }
+
+             if (tolerance < 0) {
+               throw std::runtime_error("`tolerance` should be non-negative.");
+             }
+
+             return std::make_shared<pyquboc::linear_equality>(coefficients, variables, rhs, label, tolerance);
+           }),
+           py::arg("coefficients"), py::arg("variables"), py::arg("rhs"), py::arg("label"), py::arg("tolerance") = 1e-9);
+
+  py::class_<compile_future>(m, "CompileFuture")
+      .def("done", &compile_future::done)
+      .def("cancel", &compile_future::cancel)
+      .def("result", &compile_future::result, py::arg("timeout") = py::none());
+
+  m.def(
+      "compile_many", [](const std::vector<std::shared_ptr<const pyquboc::expression>>& expressions, double strength, const std::string& quadratization, bool compact, bool quadratize, const std::string& domain, int num_threads) {
+        const auto result_quadratization = pyquboc::to_quadratization(quadratization);
+        const auto result_domain = pyquboc::to_domain(domain);
+
+        return without_gil([&] { return pyquboc::compile_many(expressions, strength, result_quadratization, compact, quadratize, result_domain, num_threads); });
+      },
+      py::arg("expressions"), py::arg("strength") = 5, py::arg("quadratization") = "greedy", py::arg("compact") = false, py::arg("quadratize") = true, py::arg("domain") = "BINARY", py::arg("num_threads") = 0);
+
+  // pyquboc_compileコマンドと同じテキスト形式のモデルを読み込みます。形式は、parser.hppを参照してください。
+
+  m.def(
+      "parse_model", [](const std::string& text) {
+        return without_gil([&] {
+          auto stream = std::istringstream(text);
+
+          return pyquboc::parse_model(stream);
+        });
+      },
+      py::arg("text"));
+
   py::class_<pyquboc::solution>(m, "DecodedSample")
       .def_property_readonly("sample", &pyquboc::solution::sample)
       .def_property_readonly("energy", &pyquboc::solution::energy)
@@ -171,139 +609,365 @@ PYBIND11_MODULE(cpp_pyquboc, m) {
 
         return solution.sample().at(name_and_indexes);
       });
+  py::class_<pyquboc::constraint_tracker>(m, "ConstraintTracker")
+      .def_property_readonly("num_broken", &pyquboc::constraint_tracker::broken_count)
+      .def_property_readonly("state", [](const pyquboc::constraint_tracker& tracker) {
+        auto result = py::array_t<std::int8_t>(static_cast<py::ssize_t>(tracker.size()));
+        std::copy(std::begin(tracker.values()), std::end(tracker.values()), result.mutable_data());
+
+        return result;
+      })
+      .def(
+          "flip", [](pyquboc::constraint_tracker& tracker, int index) {
+            if (index < 0 || index >= static_cast<int>(tracker.size())) {
+              throw py::index_error("index out of range");
+            }
+
+            return tracker.flip(index);
+          },
+          py::arg("index"))
+      .def(
+          "broken_delta", [](const pyquboc::constraint_tracker& tracker, int index) {
+            if (index < 0 || index >= static_cast<int>(tracker.size())) {
+              throw py::index_error("index out of range");
+            }
+
+            return tracker.broken_count_delta(index);
+          },
+          py::arg("index"))
+      .def("broken", &pyquboc::constraint_tracker::broken)
+      .def("recompute", &pyquboc::constraint_tracker::recompute)
+      .def("constraints", &pyquboc::constraint_tracker::constraints, py::arg("only_broken") = false);
+
+  py::class_<pyquboc::evaluator>(m, "Evaluator")
+      .def_property_readonly("energy", &pyquboc::evaluator::energy)
+      .def_property_readonly("num_broken", [](pyquboc::evaluator& evaluator) {
+        return evaluator.broken_count();
+      })
+      .def_property_readonly("state", [](const pyquboc::evaluator& evaluator) {
+        auto result = py::array_t<std::int8_t>(static_cast<py::ssize_t>(evaluator.size()));
+        std::copy(std::begin(evaluator.values()), std::end(evaluator.values()), result.mutable_data());
+
+        return result;
+      })
+      .def(
+          "delta", [](const pyquboc::evaluator& evaluator, int index) {
+            if (index < 0 || index >= static_cast<int>(evaluator.size())) {
+              throw py::index_error("index out of range");
+            }
+
+            return evaluator.delta(index);
+          },
+          py::arg("index"))
+      .def("deltas", [](const py::object& self) {
+        const auto& evaluator = self.cast<const pyquboc::evaluator&>();
+
+        // コピーしないで、flipすると値が変わる読み取り専用のビューを返します。
+        auto result = py::array_t<double>(static_cast<py::ssize_t>(evaluator.size()), evaluator.deltas().data(), self);
+        result.attr("flags").attr("writeable") = false;
+
+        return result;
+      })
+      .def(
+          "flip", [](pyquboc::evaluator& evaluator, int index) {
+            if (index < 0 || index >= static_cast<int>(evaluator.size())) {
+              throw py::index_error("index out of range");
+            }
+
+            return evaluator.flip(index);
+          },
+          py::arg("index"))
+      .def("recompute", &pyquboc::evaluator::recompute)
+      .def("constraints", &pyquboc::evaluator::constraints, py::arg("only_broken") = false);
+
   py::class_<pyquboc::model>(m, "Model")
       .def_property_readonly("variables", &pyquboc::model::variable_names)
+      .def_property_readonly("num_auxiliary_variables", &pyquboc::model::auxiliary_variable_count)
+      .def_property_readonly("degree", &pyquboc::model::degree)
+      .def_property_readonly("fixed_variables", &pyquboc::model::fixed_variables)
+      .def_property_readonly("vartype", [](const pyquboc::model& model) {
+        return model.domain() == pyquboc::domain::binary ? "BINARY" : "SPIN";
+      })
       .def(
           "to_bqm", [](const pyquboc::model& model, bool index_label, const std::unordered_map<std::string, double>& feed_dict) {
             const auto binary_quadratic_model = py::module::import("dimod").attr("BinaryQuadraticModel"); // dimodのPythonのBinaryQuadraticModelを作成します。cimodのPythonのBinaryQuadraticModelだと、dwave-nealで通らなかった……。
-            const auto binary = py::module::import("dimod").attr("Vartype").attr("BINARY");
+            const auto vartype = py::module::import("dimod").attr("Vartype").attr(model.domain() == pyquboc::domain::binary ? "BINARY" : "SPIN"); // domain='SPIN'でコンパイルした場合は、SPINのモデルになります。
 
             if (!index_label) {
-              const auto [linear, quadratic, offset] = model.to_bqm_parameters<std::string>(feed_dict);
-              return binary_quadratic_model(linear, quadratic, offset, binary);
+              const auto [linear, quadratic, offset] = without_gil([&] { return model.to_bqm_parameters<std::string>(feed_dict); });
+              return binary_quadratic_model(linear, quadratic, offset, vartype);
             } else {
-              const auto [linear, quadratic, offset] = model.to_bqm_parameters<int>(feed_dict);
-              return binary_quadratic_model(linear, quadratic, offset, binary);
+              const auto [linear, quadratic, offset] = without_gil([&] { return model.to_bqm_parameters<int>(feed_dict); });
+              return binary_quadratic_model(linear, quadratic, offset, vartype);
             }
           },
           py::arg("index_label") = false, py::arg("feed_dict") = std::unordered_map<std::string, double>{})
       .def(
           "to_qubo", [](const pyquboc::model& model, bool index_label, const std::unordered_map<std::string, double>& feed_dict) {
             if (!index_label) {
-              return py::cast(model.to_bqm<std::string>(feed_dict, cimod::Vartype::BINARY).to_qubo());
+              return py::cast(without_gil([&] { return model.to_bqm<std::string>(feed_dict, model.vartype()).to_qubo(); }));
             } else {
-              return py::cast(model.to_bqm<int>(feed_dict, cimod::Vartype::BINARY).to_qubo());
+              return py::cast(without_gil([&] { return model.to_bqm<int>(feed_dict, model.vartype()).to_qubo(); }));
             }
           },
           py::arg("index_label") = false, py::arg("feed_dict") = std::unordered_map<std::string, double>{})
       .def(
           "to_ising", [](const pyquboc::model& model, bool index_label, const std::unordered_map<std::string, double>& feed_dict) {
             if (!index_label) {
-              return py::cast(model.to_bqm<std::string>(feed_dict, cimod::Vartype::BINARY).to_ising());
+              return py::cast(without_gil([&] { return model.to_bqm<std::string>(feed_dict, model.vartype()).to_ising(); }));
             } else {
-              return py::cast(model.to_bqm<int>(feed_dict, cimod::Vartype::BINARY).to_ising());
+              return py::cast(without_gil([&] { return model.to_bqm<int>(feed_dict, model.vartype()).to_ising(); }));
+            }
+          },
+          py::arg("index_label") = false, py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "to_coo_batch", [](const pyquboc::model& model, const std::vector<std::unordered_map<std::string, double>>& feed_dicts) {
+            const auto [rows, columns, values, offsets] = without_gil([&] { return model.to_coo_batch(feed_dicts); });
+
+            return py::make_tuple(py::array_t<std::int32_t>(std::size(rows), std::data(rows)), py::array_t<std::int32_t>(std::size(columns), std::data(columns)), values, offsets);
+          },
+          py::arg("feed_dicts"))
+      .def(
+          "to_hubo", [](const pyquboc::model& model, bool index_label, const std::unordered_map<std::string, double>& feed_dict) {
+            const auto [indptr, indexes, coefficients, offset] = without_gil([&] { return model.to_hubo_arrays(feed_dict); });
+            const auto names = model.variable_names();
+
+            auto result = py::dict();
+
+            for (auto i = 0; i < static_cast<int>(std::size(coefficients)); ++i) {
+              auto key = py::tuple(indptr[i + 1] - indptr[i]);
+
+              for (auto j = indptr[i]; j < indptr[i + 1]; ++j) {
+                key[j - indptr[i]] = index_label ? py::cast(indexes[j]) : py::cast(names[indexes[j]]);
+              }
+
+              result[key] = coefficients[i];
             }
+
+            return py::make_tuple(result, offset);
           },
           py::arg("index_label") = false, py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "to_hubo_arrays", [](const pyquboc::model& model, const std::unordered_map<std::string, double>& feed_dict) {
+            const auto [indptr, indexes, coefficients, offset] = without_gil([&] { return model.to_hubo_arrays(feed_dict); });
+
+            return py::make_tuple(py::array_t<std::int64_t>(std::size(indptr), std::data(indptr)), py::array_t<std::int32_t>(std::size(indexes), std::data(indexes)), py::array_t<double>(std::size(coefficients), std::data(coefficients)), offset);
+          },
+          py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "reorder", [](const pyquboc::model& model, const std::string& method) {
+            const auto ordering = pyquboc::to_ordering(method);
+
+            auto [reordered_model, permutation] = without_gil([&] { return model.reorder(ordering); });
+
+            return py::make_tuple(std::move(reordered_model), py::array_t<std::int32_t>(std::size(permutation), std::data(permutation)));
+          },
+          py::arg("method") = "rcm")
+      .def("components", [](const pyquboc::model& model) {
+        return without_gil([&] { return model.components(); });
+      })
+      .def(
+          "presolve", [](const pyquboc::model& model, const std::unordered_map<std::string, double>& feed_dict) {
+            auto reduced_model = without_gil([&] { return model.presolve(feed_dict); });
+            auto fixed_variables = reduced_model.fixed_variables();
+
+            return py::make_tuple(std::move(reduced_model), std::move(fixed_variables));
+          },
+          py::arg("feed_dict") = std::unordered_map<std::string, double>{})
       .def(
           "energy", [](const pyquboc::model& model, const py::object& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) {
+            return visit_sample(sample, [&](const auto& typed_sample) {
+              return without_gil([&] { return model.energy(typed_sample, vartype, feed_dict); });
+            });
+          },
+          py::arg("sample"), py::arg("vartype"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "decode_sample", [](const pyquboc::model& model, const py::object& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) {
+            return visit_sample(sample, [&](const auto& typed_sample) {
+              return without_gil([&] { return model.decode_sample(typed_sample, vartype, feed_dict); });
+            });
+          },
+          py::arg("sample"), py::arg("vartype"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "evaluator", [](const pyquboc::model& model, const py::object& state, const std::unordered_map<std::string, double>& feed_dict) {
+            return visit_sample(state, [&](const auto& typed_state) {
+              return without_gil([&] { return pyquboc::evaluator(model, model.sample_values(typed_state, model.domain() == pyquboc::domain::binary ? "BINARY" : "SPIN"), feed_dict); });
+            });
+          },
+          py::arg("state"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "constraint_tracker", [](const pyquboc::model& model, const py::object& state, const std::unordered_map<std::string, double>& feed_dict) {
+            return visit_sample(state, [&](const auto& typed_state) {
+              return without_gil([&] { return pyquboc::constraint_tracker(model, model.sample_values(typed_state, model.domain() == pyquboc::domain::binary ? "BINARY" : "SPIN"), feed_dict); });
+            });
+          },
+          py::arg("state"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+      .def(
+          "decode_sampleset", [](const pyquboc::model& model, const py::object& sampleset, const std::unordered_map<std::string, double>& feed_dict) {
+            const auto vartype = sampleset.attr("vartype").attr("name").cast<std::string>();
+
             try {
-              return model.energy(sample.cast<std::unordered_map<std::string, int>>(), vartype, feed_dict);
+              const auto samples = to_samples<std::string>(sampleset);
+              return without_gil([&] { return model.decode_samples(samples, vartype, feed_dict); });
             } catch (...) {
               ;
             }
 
             try {
-              return model.energy(sample.cast<std::unordered_map<int, int>>(), vartype, feed_dict);
+              const auto samples = to_samples<int>(sampleset);
+              return without_gil([&] { return model.decode_samples(samples, vartype, feed_dict); });
             } catch (...) {
               ;
             }
 
             throw std::runtime_error("invalid sample");
           },
-          py::arg("sample"), py::arg("vartype"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+          py::arg("sampleset"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
       .def(
-          "decode_sample", [](const pyquboc::model& model, const py::object& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) {
-            try {
-              return model.decode_sample(sample.cast<std::unordered_map<std::string, int>>(), vartype, feed_dict);
-            } catch (...) {
-              ;
+          "decode_samplesets", [](const pyquboc::model& model, const std::vector<py::object>& samplesets, const std::unordered_map<std::string, double>& feed_dict) { // componentsごとに解いたSampleSetを、エネルギー順に組み合わせてデコードします。
+            if (std::empty(samplesets)) {
+              throw std::runtime_error("`samplesets` should not be empty.");
             }
 
+            const auto vartype = samplesets[0].attr("vartype").attr("name").cast<std::string>();
+
             try {
-              return model.decode_sample(sample.cast<std::unordered_map<int, int>>(), vartype, feed_dict);
+              auto samples = std::vector<std::vector<std::unordered_map<std::string, int>>>{};
+
+              for (const auto& sampleset : samplesets) {
+                samples.emplace_back(to_samples<std::string>(sampleset));
+              }
+
+              return without_gil([&] { return model.decode_samples(pyquboc::merge_samples(samples), vartype, feed_dict); });
             } catch (...) {
               ;
             }
 
             try {
-              return model.decode_sample([&] {
-                auto result = std::unordered_map<int, int>{};
+              auto samples = std::vector<std::vector<std::unordered_map<int, int>>>{};
 
-                const auto v = sample.cast<std::vector<int>>();
-                for (auto i = 0; i < static_cast<int>(std::size(v)); ++i) {
-                  result.emplace(i, v[i]);
-                }
+              for (const auto& sampleset : samplesets) {
+                samples.emplace_back(to_samples<int>(sampleset));
+              }
 
-                return result;
-              }(), vartype, feed_dict);
+              return without_gil([&] { return model.decode_samples(pyquboc::merge_samples(samples), vartype, feed_dict); });
             } catch (...) {
               ;
             }
 
             throw std::runtime_error("invalid sample");
           },
-          py::arg("sample"), py::arg("vartype"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
+          py::arg("samplesets"), py::arg("feed_dict") = std::unordered_map<std::string, double>{})
       .def(
-          "decode_sampleset", [](const pyquboc::model& model, const py::object& sampleset, const std::unordered_map<std::string, double>& feed_dict) {
-            sampleset.attr("record").attr("sort")("order"_a = "energy");
+          "decode_file", [](const pyquboc::model& model, const std::string& path, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict, py::ssize_t chunk_rows, const std::optional<std::string>& out, int num_threads) {
+            // サンプルの.npyファイルはメモリ・マップして、chunk_rows行ずつデコードします。int8とint32のC形式の配列なら、チャンクもコピーしません。
+            // outを指定した場合は、結果もそのディレクトリの.npyファイルにメモリ・マップして書き込むので、メモリの使用量はサンプルの数によりません。
+            const auto numpy = py::module_::import("numpy");
+            const auto os = py::module_::import("os");
+
+            if (chunk_rows <= 0) {
+              throw std::runtime_error("`chunk_rows` should be positive.");
+            }
 
-            const auto array = sampleset.attr("record")["sample"].cast<py::array_t<std::int8_t>>();
-            const auto info = array.request();
+            const auto samples = numpy.attr("load")(path, "mmap_mode"_a = "r");
+            const auto shape = samples.attr("shape").cast<std::vector<py::ssize_t>>();
 
-            if (info.format != py::format_descriptor<int8_t>::format() || info.ndim != 2) {
-              throw std::runtime_error("Incompatible buffer format!");
+            if (std::size(shape) != 2 || shape[1] != static_cast<py::ssize_t>(std::size(model.variable_names()))) {
+              throw std::runtime_error("samples should be a matrix whose columns are the variables of the model.");
             }
 
-            try {
-              const auto variables = sampleset.attr("variables").cast<std::vector<std::string>>();
+            const auto row_count = shape[0];
+            const auto sub_hamiltonian_names = model.sub_hamiltonian_names();
+            const auto constraint_names = model.constraint_names();
 
-              const auto samples = [&] {
-                auto result = std::vector<std::unordered_map<std::string, int>>(info.shape[0]);
+            if (out) {
+              os.attr("makedirs")(*out, "exist_ok"_a = true);
 
-                for (auto i = 0; i < info.shape[0]; ++i) {
-                  for (auto j = 0; j < info.shape[1]; ++j) {
-                    result[i].emplace(variables[j], *array.data(i, j));
-                  }
+              const auto columns_path = os.attr("path").attr("join")(*out, "columns.json").cast<std::string>();
+
+              auto stream = std::ofstream(columns_path);
+
+              stream << py::module_::import("json").attr("dumps")(py::dict("subh"_a = sub_hamiltonian_names, "constraints"_a = constraint_names)).cast<std::string>();
+              stream.close(); // ディスクが一杯の場合などは、書き出すときに失敗するかもしれないので、閉じてから調べます。
+
+              if (!stream) {
+                throw std::runtime_error("failed to write '" + columns_path + "'.");
+              }
+            }
+
+            // 列ごとの配列は、(列の数, サンプルの数)の形にして、列ごとに連続させます。
+            const auto column_array = [&](const std::string& name, const py::object& dtype, const py::tuple& array_shape) -> py::object {
+              if (out) {
+                return py::module_::import("numpy.lib.format").attr("open_memmap")(os.attr("path").attr("join")(*out, name + ".npy"), "mode"_a = "w+", "dtype"_a = dtype, "shape"_a = array_shape);
+              }
+
+              return numpy.attr("empty")(array_shape, "dtype"_a = dtype);
+            };
+
+            const auto data = [](const py::object& array) { // numpy.memmapでも、基底クラスのndarrayに変換したビューは同じメモリを指します。
+              return py::array(array).mutable_data();
+            };
+
+            const auto energies = column_array("energy", numpy.attr("float64"), py::make_tuple(row_count));
+            const auto sub_hamiltonians = column_array("subh", numpy.attr("float64"), py::make_tuple(std::size(sub_hamiltonian_names), row_count));
+            const auto constraint_energies = column_array("constraint_energy", numpy.attr("float64"), py::make_tuple(std::size(constraint_names), row_count));
+            const auto constraint_satisfactions = column_array("constraint_satisfied", numpy.attr("bool_"), py::make_tuple(std::size(constraint_names), row_count));
+
+            for (auto begin = py::ssize_t{0}; begin < row_count; begin += chunk_rows) {
+              const auto end = std::min(begin + chunk_rows, row_count);
+
+              // 他の型（Fortran形式を含みます）は、チャンクごとにint32に変換します。
+              const auto chunk = [&]() -> py::array {
+                const auto result = numpy.attr("ascontiguousarray")(samples[py::slice(begin, end, 1)]);
+
+                if (py::isinstance<py::array_t<std::int8_t>>(result) || py::isinstance<py::array_t<std::int32_t>>(result)) {
+                  return result;
                 }
 
-                return result;
+                return numpy.attr("ascontiguousarray")(result, "dtype"_a = numpy.attr("int32"));
               }();
 
-              return model.decode_samples(samples, sampleset.attr("vartype").attr("name").cast<std::string>(), feed_dict);
-            } catch (...) {
-              ;
-            }
+              const auto columns = [&] {
+                auto result = pyquboc::decoded_columns{static_cast<double*>(data(energies)) + begin, {}, {}, {}};
 
-            try {
-              const auto samples = [&] {
-                auto result = std::vector<std::unordered_map<int, int>>(info.shape[0]);
+                for (auto i = 0; i < static_cast<int>(std::size(sub_hamiltonian_names)); ++i) {
+                  result.sub_hamiltonians.emplace_back(static_cast<double*>(data(sub_hamiltonians)) + i * row_count + begin);
+                }
 
-                for (auto i = 0; i < info.shape[0]; ++i) {
-                  for (auto j = 0; j < info.shape[1]; ++j) {
-                    result[i].emplace(j, *array.data(i, j));
-                  }
+                for (auto i = 0; i < static_cast<int>(std::size(constraint_names)); ++i) {
+                  result.constraint_energies.emplace_back(static_cast<double*>(data(constraint_energies)) + i * row_count + begin);
+                  result.constraint_satisfactions.emplace_back(static_cast<bool*>(data(constraint_satisfactions)) + i * row_count + begin);
                 }
 
                 return result;
               }();
 
-              return model.decode_samples(samples, sampleset.attr("vartype").attr("name").cast<std::string>(), feed_dict);
-            } catch (...) {
-              ;
+              if (py::isinstance<py::array_t<std::int8_t>>(chunk)) {
+                without_gil([&] { model.decode_rows(static_cast<const std::int8_t*>(chunk.data()), end - begin, shape[1], vartype, feed_dict, columns, num_threads); });
+              } else {
+                without_gil([&] { model.decode_rows(static_cast<const std::int32_t*>(chunk.data()), end - begin, shape[1], vartype, feed_dict, columns, num_threads); });
+              }
             }
 
-            throw std::runtime_error("invalid sample");
+            for (const auto& array : {energies, sub_hamiltonians, constraint_energies, constraint_satisfactions}) {
+              if (py::hasattr(array, "flush")) {
+                array.attr("flush")();
+              }
+            }
+
+            auto subh = py::dict();
+
+            for (auto i = 0; i < static_cast<int>(std::size(sub_hamiltonian_names)); ++i) {
+              subh[py::str(sub_hamiltonian_names[i])] = py::object(sub_hamiltonians[py::int_(i)]);
+            }
+
+            auto constraints = py::dict();
+
+            for (auto i = 0; i < static_cast<int>(std::size(constraint_names)); ++i) {
+              constraints[py::str(constraint_names[i])] = py::make_tuple(py::object(constraint_satisfactions[py::int_(i)]), py::object(constraint_energies[py::int_(i)]));
+            }
+
+            return py::dict("energy"_a = energies, "subh"_a = subh, "constraints"_a = constraints);
           },
-          py::arg("sampleset"), py::arg("feed_dict") = std::unordered_map<std::string, double>{});
+          py::arg("path"), py::arg("vartype"), py::arg("feed_dict") = std::unordered_map<std::string, double>{}, py::arg("chunk_rows") = 65536, py::arg("out") = py::none(), py::arg("num_threads") = 0);
 }
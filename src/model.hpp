@@ -1,54 +1,99 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
+#include <limits>
 #include <map>
+#include <numeric>
 #include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <Eigen/Core>
 #include <binary_quadratic_model.hpp>
 #include <boost/container/small_vector.hpp>
 #include <boost/functional/hash.hpp>
 #include <robin_hood.h>
 
 #include "abstract_syntax_tree.hpp"
+#include "presolve.hpp"
+#include "thread_pool.hpp"
 
 namespace pyquboc {
   class variables final {
-    robin_hood::unordered_map<std::string, int> _indexes;
-    robin_hood::unordered_map<int, std::string> _names;
+    robin_hood::unordered_map<int, int> _indexes; // シンボル・テーブルのIDから、モデル内のインデックスへ。
+    std::vector<int> _ids;                        // モデル内のインデックスから、シンボル・テーブルのIDへ。
 
   public:
-    variables() noexcept : _indexes{}, _names{} {
+    variables() noexcept : _indexes{}, _ids{} {
       ;
     }
 
-    auto index(const std::string& variable_name) noexcept {
-      const auto [it, emplaced] = _indexes.emplace(variable_name, std::size(_indexes));
+    auto index(int id) noexcept {
+      const auto [it, emplaced] = _indexes.emplace(id, static_cast<int>(std::size(_ids)));
 
       if (emplaced) {
-        _names.emplace(it->second, variable_name);
+        _ids.emplace_back(id);
       }
 
       return it->second;
     }
 
-    const auto& name(int index) const noexcept {
-      return _names.find(index)->second;
+    auto index(const std::string& variable_name) noexcept {
+      return index(symbol_table::instance().id(variable_name));
     }
 
-    auto names() const noexcept {
-      auto result = std::vector<std::string>(std::size(_names));
+    std::optional<int> find(const std::string& variable_name) const noexcept { // 名前からインデックスを探します。知らない名前はシンボル・テーブルに登録しません。
+      const auto id = symbol_table::instance().find(variable_name);
+
+      if (!id) {
+        return std::nullopt;
+      }
+
+      const auto it = _indexes.find(*id);
 
-      for (const auto& [index, name] : _names) {
-        result[index] = name;
+      if (it == std::end(_indexes)) {
+        return std::nullopt;
       }
 
+      return it->second;
+    }
+
+    auto id(int index) const noexcept {
+      return _ids[index];
+    }
+
+    auto name(int index) const noexcept {
+      return std::string(symbol_table::instance().name(_ids[index]));
+    }
+
+    auto size() const noexcept {
+      return std::size(_ids);
+    }
+
+    auto compact() noexcept {
+      _indexes.rehash(0);
+      _ids.shrink_to_fit();
+    }
+
+    auto names() const noexcept {
+      auto result = std::vector<std::string>{};
+
+      result.reserve(std::size(_ids));
+
+      std::transform(std::begin(_ids), std::end(_ids), std::back_inserter(result), [](const auto& id) {
+        return std::string(symbol_table::instance().name(id));
+      });
+
       return result;
     }
   };
@@ -87,6 +132,41 @@ namespace pyquboc {
     }());
   }
 
+  // 変数の定義域。binaryではx * x = x、spinではs * s = 1として展開します。
+
+  enum class domain {
+    binary,
+    spin
+  };
+
+  inline auto to_domain(const std::string& name) {
+    if (name == "BINARY") {
+      return domain::binary;
+    }
+
+    if (name == "SPIN") {
+      return domain::spin;
+    }
+
+    throw std::runtime_error("`domain` should be 'BINARY' or 'SPIN'.");
+  }
+
+  inline auto multiply(const product& product_1, const product& product_2, pyquboc::domain domain) noexcept {
+    if (domain == domain::binary) {
+      return product_1 * product_2;
+    }
+
+    return product([&] {
+      auto result = indexes{};
+
+      std::set_symmetric_difference(std::begin(product_1.indexes()), std::end(product_1.indexes()),
+                                    std::begin(product_2.indexes()), std::end(product_2.indexes()),
+                                    std::back_inserter(result)); // s * s = 1なので、両方にある変数は消えます。
+
+      return result;
+    }());
+  }
+
   inline bool operator==(const product& product_1, const product& product_2) noexcept {
     return product_1.indexes() == product_2.indexes();
   }
@@ -107,71 +187,266 @@ namespace pyquboc {
 
   using polynomial = robin_hood::unordered_map<product, std::shared_ptr<const expression>>;
 
-  inline auto operator+(const polynomial& polynomial_1, const polynomial& polynomial_2) noexcept {
-    auto result = polynomial_1;
+  // 多項式に項を足し込みます。展開ではコピーを作らないように、結果の多項式に直接足し込んでいきます。
 
-    for (const auto& [product, coefficient] : polynomial_2) {
-      const auto [it, emplaced] = result.emplace(product, coefficient);
+  inline auto add_term(polynomial& polynomial, const product& product, const std::shared_ptr<const expression>& coefficient) noexcept {
+    const auto [it, emplaced] = polynomial.emplace(product, coefficient);
 
-      if (!emplaced) {
-        it->second = it->second + coefficient;
-      }
+    if (!emplaced) {
+      it->second = it->second + coefficient;
+    }
+  }
+
+  inline auto add_terms(polynomial& polynomial, const pyquboc::polynomial& other, const std::shared_ptr<const expression>& scale) noexcept {
+    for (const auto& [product, coefficient] : other) {
+      add_term(polynomial, product, coefficient * scale);
     }
+  }
 
-    return result;
+  inline auto operator+(polynomial polynomial_1, const polynomial& polynomial_2) noexcept {
+    for (const auto& [product, coefficient] : polynomial_2) {
+      add_term(polynomial_1, product, coefficient);
+    }
+
+    return polynomial_1;
+  }
+
+  // 多項式の項の数が上限を超えたときの例外です。メモリを使い果たす前に、展開を止めるために使います。
+
+  class term_limit_error final : public std::length_error {
+  public:
+    using std::length_error::length_error;
+  };
+
+  inline auto check_term_count(std::size_t term_count, std::size_t max_term_count) {
+    if (term_count > max_term_count) {
+      throw term_limit_error("the expanded polynomial has more than " + std::to_string(max_term_count) + " terms");
+    }
   }
 
-  inline auto operator*(const polynomial& polynomial_1, const polynomial& polynomial_2) noexcept {
+  // 長い掛け算の途中で、多項式の大きさを調べたり中断したりするための関数です。checkpoint_interval項ごとに、途中の多項式を引数にして呼び出します。止めたいときは、例外を投げてください。
+
+  constexpr auto checkpoint_interval = 1024;
+
+  struct no_checkpoint final {
+    auto operator()(const polynomial&) const noexcept {
+      ;
+    }
+  };
+
+  template <typename Checkpoint = no_checkpoint>
+  inline auto multiply(const polynomial& polynomial_1, const polynomial& polynomial_2, pyquboc::domain domain, Checkpoint&& checkpoint = Checkpoint{}) {
     auto result = polynomial{};
+    auto count = 0;
 
     for (const auto& [product_1, coefficient_1] : polynomial_1) {
       for (const auto& [product_2, coefficient_2] : polynomial_2) {
-        const auto [it, emplaced] = result.emplace(product_1 * product_2, coefficient_1 * coefficient_2);
+        add_term(result, multiply(product_1, product_2, domain), coefficient_1 * coefficient_2);
 
-        if (!emplaced) {
-          it->second = it->second + coefficient_1 * coefficient_2;
+        if (++count == checkpoint_interval) { // 行が長いと、1行ごとでは間に合いません。
+          count = 0;
+          checkpoint(result);
         }
       }
     }
 
+    checkpoint(result);
+
     return result;
   }
 
+  inline auto operator*(const polynomial& polynomial_1, const polynomial& polynomial_2) {
+    return multiply(polynomial_1, polynomial_2, domain::binary);
+  }
+
+  // 繰り返し二乗法で累乗します。バイナリ変数はx * x = xなので、途中で冪等（p * p = p）になったら、それ以上掛け算する必要はありません。
+
+  template <typename Checkpoint = no_checkpoint>
+  inline auto pow(const polynomial& polynomial, int exponent, pyquboc::domain domain = domain::binary, Checkpoint&& checkpoint = Checkpoint{}) {
+    // 打ち消しあって係数が数値の0になった項を削除します。支配される項の削除まではしません（係数はPlaceholderを含む式かもしれないので、大小を比べられません）。
+
+    const auto erase_zero_terms = [](pyquboc::polynomial& polynomial) {
+      for (auto it = std::begin(polynomial); it != std::end(polynomial);) {
+        it = it->second->expression_type() == expression_type::numeric_literal && std::static_pointer_cast<const numeric_literal>(it->second)->value() == 0 ? polynomial.erase(it) : std::next(it);
+      }
+    };
+
+    const auto equals = [](const pyquboc::polynomial& polynomial_1, const pyquboc::polynomial& polynomial_2) {
+      return std::size(polynomial_1) == std::size(polynomial_2) && std::all_of(std::begin(polynomial_1), std::end(polynomial_1), [&](const auto& term) {
+               const auto it = polynomial_2.find(term.first);
+
+               return it != std::end(polynomial_2) && term.second->equals(it->second);
+             });
+    };
+
+    // 単項式の場合は、係数を累乗するだけ。spinの場合は、偶数乗すると変数が消えます（s * s = 1）。
+
+    if (std::size(polynomial) == 1) {
+      const auto& [product, coefficient] = *std::begin(polynomial);
+
+      return pyquboc::polynomial{{domain == domain::spin && exponent % 2 == 0 ? pyquboc::product{} : product, coefficient->expression_type() == expression_type::numeric_literal ? pyquboc::pow(coefficient, exponent) : std::make_shared<const pow_operator>(coefficient, exponent)}};
+    }
+
+    auto result = std::optional<pyquboc::polynomial>{};
+    auto base = polynomial;
+
+    for (;;) {
+      if (exponent & 1) {
+        result = result ? multiply(*result, base, domain, checkpoint) : base;
+      }
+
+      exponent >>= 1;
+
+      if (exponent == 0) {
+        break;
+      }
+
+      auto square = multiply(base, base, domain, checkpoint);
+
+      erase_zero_terms(square); // 係数が0の項は、以降の掛け算を無駄に増やすだけなので。
+
+      if (equals(square, base)) {
+        return result ? multiply(*result, base, domain, checkpoint) : base;
+      }
+
+      base = std::move(square);
+    }
+
+    return *result;
+  }
+
+  // Placeholderの値をfeed_dictから引きます。ない場合は、どのPlaceholderかわかるようにして例外を投げます。
+
+  inline auto placeholder_value(const std::unordered_map<std::string, double>& feed_dict, const std::string& name) {
+    const auto it = feed_dict.find(name);
+
+    if (it == std::end(feed_dict)) {
+      throw std::runtime_error("placeholder '" + name + "' is not in feed_dict.");
+    }
+
+    return it->second;
+  }
+
+  // feed_dictはコピーせずに参照します。evaluateは、feed_dictより長生きしないように関数内でだけ使ってください。
+
   class evaluate final {
-    std::unordered_map<std::string, double> _feed_dict;
+    const std::unordered_map<std::string, double>& _feed_dict;
 
   public:
     evaluate(const std::unordered_map<std::string, double>& feed_dict) noexcept : _feed_dict(feed_dict) {
       ;
     }
 
-    auto operator()(const std::shared_ptr<const expression>& expression) const noexcept {
+    auto operator()(const std::shared_ptr<const expression>& expression) const {
       return visit<double>(*this, expression);
     }
 
-    auto operator()(const std::shared_ptr<const add_operator>& add_operator) const noexcept {
+    auto operator()(const std::shared_ptr<const add_operator>& add_operator) const {
       return std::accumulate(std::begin(add_operator->children()), std::end(add_operator->children()), 0.0, [&](const auto& acc, const auto& child) {
         return acc + visit<double>(*this, child);
       });
     }
 
-    auto operator()(const std::shared_ptr<const mul_operator>& mul_operator) const noexcept {
+    auto operator()(const std::shared_ptr<const mul_operator>& mul_operator) const {
       return visit<double>(*this, mul_operator->lhs()) * visit<double>(*this, mul_operator->rhs());
     }
 
-    auto operator()(const std::shared_ptr<const placeholder_variable>& place_holder_variable) const noexcept {
-      return _feed_dict.at(place_holder_variable->name());
+    auto operator()(const std::shared_ptr<const pow_operator>& pow_operator) const {
+      return std::pow(visit<double>(*this, pow_operator->base()), pow_operator->exponent());
+    }
+
+    auto operator()(const std::shared_ptr<const placeholder_variable>& place_holder_variable) const {
+      return placeholder_value(_feed_dict, place_holder_variable->name());
     }
 
-    auto operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) const noexcept {
+    auto operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) const {
       return visit<double>(*this, user_defined_expression->expression());
     }
 
-    auto operator()(const std::shared_ptr<const numeric_literal>& numeric_literal) const noexcept {
+    auto operator()(const std::shared_ptr<const numeric_literal>& numeric_literal) const {
       return numeric_literal->value();
     }
   };
 
+  // feed_dictの組ごとの係数を、まとめて計算します。Placeholderを組の数の長さの配列にして、Eigenでベクトル化して評価します。
+
+  class evaluate_batch final {
+    const std::vector<std::unordered_map<std::string, double>>& _feed_dicts;
+    mutable robin_hood::unordered_map<int, Eigen::ArrayXd> _placeholder_values; // Placeholderの値の配列は、一度だけ作ります。
+
+  public:
+    evaluate_batch(const std::vector<std::unordered_map<std::string, double>>& feed_dicts) noexcept : _feed_dicts(feed_dicts), _placeholder_values{} {
+      ;
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const expression>& expression) const {
+      return visit<Eigen::ArrayXd>(*this, expression);
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const add_operator>& add_operator) const {
+      auto result = Eigen::ArrayXd::Zero(std::size(_feed_dicts)).eval();
+
+      for (const auto& child : add_operator->children()) {
+        result += visit<Eigen::ArrayXd>(*this, child);
+      }
+
+      return result;
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const mul_operator>& mul_operator) const {
+      return visit<Eigen::ArrayXd>(*this, mul_operator->lhs()) * visit<Eigen::ArrayXd>(*this, mul_operator->rhs());
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const pow_operator>& pow_operator) const {
+      return visit<Eigen::ArrayXd>(*this, pow_operator->base()).pow(pow_operator->exponent());
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const placeholder_variable>& place_holder_variable) const {
+      const auto [it, emplaced] = _placeholder_values.emplace(place_holder_variable->id(), Eigen::ArrayXd());
+
+      if (emplaced) {
+        const auto name = place_holder_variable->name();
+
+        it->second.resize(std::size(_feed_dicts));
+
+        for (auto i = 0; i < static_cast<int>(std::size(_feed_dicts)); ++i) {
+          it->second[i] = placeholder_value(_feed_dicts[i], name);
+        }
+      }
+
+      return it->second;
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const user_defined_expression>& user_defined_expression) const {
+      return visit<Eigen::ArrayXd>(*this, user_defined_expression->expression());
+    }
+
+    Eigen::ArrayXd operator()(const std::shared_ptr<const numeric_literal>& numeric_literal) const {
+      return Eigen::ArrayXd::Constant(std::size(_feed_dicts), numeric_literal->value());
+    }
+  };
+
+  // 変数のインデックス順に値を並べたサンプル（numpyの配列など）。コピーせずに参照するだけなので、配列より長生きさせないでください。
+
+  template <typename T>
+  class dense_sample final {
+    const T* _data;
+    std::size_t _size;
+
+  public:
+    dense_sample(const T* data, std::size_t size) noexcept : _data(data), _size(size) {
+      ;
+    }
+
+    auto operator[](std::size_t index) const noexcept {
+      return static_cast<int>(_data[index]);
+    }
+
+    auto size() const noexcept {
+      return _size;
+    }
+  };
+
   class solution final {
     std::unordered_map<std::string, int> _sample;
     double _energy;
@@ -200,106 +475,237 @@ namespace pyquboc {
     }
   };
 
-  class model final {
-    polynomial _quadratic_polynomial;
-    robin_hood::unordered_map<std::string, polynomial> _sub_hamiltonians;
-    robin_hood::unordered_map<std::string, std::pair<polynomial, std::function<bool(double)>>> _constraints;
-    variables _variables;
+  // 制約の多項式。squaredがtrueの場合は、polynomialは1次式で、エネルギーはその2乗になります（LinearEqualityの場合）。こうしておけば、O(m)で評価できます。
 
-    static auto to_cimod_vartype(const std::string vartype) noexcept {
-      return vartype == "BINARY" ? cimod::Vartype::BINARY : cimod::Vartype::SPIN;
-    }
+  class constraint_polynomial final {
+    std::shared_ptr<const pyquboc::polynomial> _polynomial; // 展開時の多項式を共有して、コピーしないようにします。
+    std::function<bool(double)> _condition;
+    bool _squared;
 
   public:
-    model(const polynomial& quadratic_polynomial, const robin_hood::unordered_map<std::string, polynomial>& sub_hamiltonians, const robin_hood::unordered_map<std::string, std::pair<polynomial, std::function<bool(double)>>>& constraints, const variables& variables) noexcept : _quadratic_polynomial(quadratic_polynomial), _sub_hamiltonians(sub_hamiltonians), _constraints(constraints), _variables(variables) {
+    constraint_polynomial(const std::shared_ptr<const pyquboc::polynomial>& polynomial, const std::function<bool(double)>& condition, bool squared = false) noexcept : _polynomial(polynomial), _condition(condition), _squared(squared) {
       ;
     }
 
-    std::vector<std::string> variable_names() const noexcept {
-      return _variables.names();
+    const auto& polynomial() const noexcept {
+      return *_polynomial;
     }
 
-    // TODO: std::stringじゃなくてintの方を特殊化する。
+    const auto& condition() const noexcept {
+      return _condition;
+    }
 
-    template <typename T = std::string>
-    auto to_bqm_parameters(const std::unordered_map<std::string, double>& feed_dict) const noexcept { // 不格好でごめんなさい。PythonのBinaryQuadraticModelを作成可能にするために、このメンバ関数でBinaryQuadraticModelの引数を生成します。
-      const auto evaluate = pyquboc::evaluate(feed_dict);
+    auto squared() const noexcept {
+      return _squared;
+    }
 
-      auto linear = cimod::Linear<T, double>{};
-      auto quadratic = cimod::Quadratic<T, double>{};
-      auto offset = 0.0;
+    template <typename Evaluate>
+    auto energy(Evaluate&& evaluate_polynomial) const {
+      const auto result = evaluate_polynomial(*_polynomial);
 
-      for (const auto& [product, coefficient] : _quadratic_polynomial) {
-        const auto coefficient_value = evaluate(coefficient);
+      return _squared ? result * result : result;
+    }
+  };
 
-        switch (std::size(product.indexes())) {
-        case 0: {
-          offset = coefficient_value; // 次数が0の項は1つにまとめられるので、この処理は最大で1回しか実行されません。なので、+=ではなくて=を使用しています。
-          break;
+  // 係数を評価済みの多項式。変数のインデックスを項ごとにCSR形式で並べて、大量のサンプルを評価するときにハッシュ表をたどらないようにします。
+
+  class flat_polynomial final {
+    std::vector<std::size_t> _indptr;
+    std::vector<int> _indexes;
+    std::vector<double> _coefficients;
+
+  public:
+    flat_polynomial(const polynomial& polynomial, const pyquboc::evaluate& evaluate) : _indptr{0}, _indexes{}, _coefficients{} {
+      _indptr.reserve(std::size(polynomial) + 1);
+      _coefficients.reserve(std::size(polynomial));
+
+      for (const auto& [product, coefficient] : polynomial) {
+        _indexes.insert(std::end(_indexes), std::begin(product.indexes()), std::end(product.indexes()));
+        _indptr.emplace_back(std::size(_indexes));
+        _coefficients.emplace_back(evaluate(coefficient));
+      }
+    }
+
+    auto operator()(const std::vector<int>& values) const noexcept {
+      auto result = 0.0;
+
+      for (auto i = std::size_t{0}; i < std::size(_coefficients); ++i) {
+        auto term = _coefficients[i];
+
+        for (auto j = _indptr[i]; j < _indptr[i + 1]; ++j) {
+          term *= values[_indexes[j]];
         }
-        case 1: {
-          linear.emplace(_variables.name(product.indexes()[0]), coefficient_value);
-          break;
+
+        result += term;
+      }
+
+      return result;
+    }
+  };
+
+  // decode_rowsの出力先。i番目のサンプルの結果を、それぞれの配列のi番目に書き込みます。
+  // sub_hamiltoniansはsub_hamiltonian_names()の順、constraint_energiesとconstraint_satisfactionsはconstraint_names()の順です。
+
+  struct decoded_columns final {
+    double* energies;
+    std::vector<double*> sub_hamiltonians;
+    std::vector<double*> constraint_energies;
+    std::vector<bool*> constraint_satisfactions;
+  };
+
+  // modelは、構築した後は変更しません（compactはcompileの中でだけ呼び出します）。多項式は共有していますが読み出すだけで、シンボル・テーブルはロックしています。
+  // なので、constなメンバ関数（to_bqm_parametersやenergy、decode_sampleなど）は、複数のスレッドから同時に呼び出しても大丈夫です。
+  // ただし、Constraintのconditionに指定したPythonの関数は、呼び出すたびにGILを取得します。
+
+  // 変数の並べ替え方。rcmは逆Cuthill-McKee、bfsは幅優先探索の順序です。
+
+  enum class ordering {
+    rcm,
+    bfs
+  };
+
+  inline auto to_ordering(const std::string& name) {
+    if (name == "rcm") {
+      return ordering::rcm;
+    }
+
+    if (name == "bfs") {
+      return ordering::bfs;
+    }
+
+    throw std::runtime_error("`method` should be 'rcm' or 'bfs'.");
+  }
+
+  class model final {
+    polynomial _polynomial;
+    robin_hood::unordered_map<std::string, std::shared_ptr<const polynomial>> _sub_hamiltonians;
+    robin_hood::unordered_map<std::string, constraint_polynomial> _constraints;
+    variables _variables;
+    int _auxiliary_variable_count;
+    pyquboc::domain _domain;
+    std::vector<std::pair<int, int>> _fixed_values; // presolveで固定した変数のインデックスと、モデルの定義域での値。
+    std::vector<std::size_t> _constraint_indptr; // 変数ごとの、その変数を含むConstraint（constraint_namesでのインデックス）のリスト（CSR形式）。
+    std::vector<int> _variable_constraints;
+
+    static constexpr auto missing_value = std::numeric_limits<int>::min();
+
+    // サンプルを、モデル内のインデックスで引けるstd::vectorに変換します。値はモデルの定義域に揃えて、サンプルにない変数はmissing_valueにしておきます。
+    // こうしておけば、多項式を評価するときに文字列のハッシュを計算しなくて済みます。
+
+    template <typename T>
+    auto to_values(const std::unordered_map<T, int>& sample, const std::string& vartype) const noexcept {
+      auto result = std::vector<int>(std::size(_variables), missing_value);
+
+      for (const auto& [key, value] : sample) {
+        const auto index = [&]() -> std::optional<int> {
+          if constexpr (std::is_same_v<T, std::string>) {
+            return _variables.find(key);
+          } else {
+            return key >= 0 && key < static_cast<int>(std::size(result)) ? std::optional<int>(key) : std::nullopt;
+          }
+        }();
+
+        if (index) {
+          if (_domain == domain::binary) {
+            result[*index] = vartype == "BINARY" ? value : (value + 1) / 2;
+          } else {
+            result[*index] = vartype == "BINARY" ? value * 2 - 1 : value;
+          }
         }
-        case 2: {
-          quadratic.emplace(std::pair{_variables.name(product.indexes()[0]), _variables.name(product.indexes()[1])}, coefficient_value);
-          break;
+      }
+
+      return result;
+    }
+
+    // 配列のサンプルは、ハッシュを使わずにそのまま変換します。presolveで固定した変数は、固定した値で上書きします。
+
+    template <typename T>
+    auto to_values(const dense_sample<T>& sample, const std::string& vartype) const noexcept {
+      auto result = std::vector<int>(std::size(_variables), missing_value);
+
+      to_values(sample, vartype == "BINARY", result);
+
+      return result;
+    }
+
+    // 大量のサンプルを変換するときは、resultを使い回します。resultの長さは変数の数で、サンプルにない変数はそのままです。
+
+    template <typename T>
+    auto to_values(const dense_sample<T>& sample, bool binary, std::vector<int>& result) const noexcept {
+      const auto size = std::min(std::size(sample), std::size(result));
+
+      if (_domain == domain::binary) {
+        for (auto i = std::size_t{0}; i < size; ++i) {
+          result[i] = binary ? sample[i] : (sample[i] + 1) / 2;
         }
-        default:
-          throw std::runtime_error("invalid term."); // ここには絶対にこないはず。
+      } else {
+        for (auto i = std::size_t{0}; i < size; ++i) {
+          result[i] = binary ? sample[i] * 2 - 1 : sample[i];
         }
       }
 
-      return std::tuple{linear, quadratic, offset};
+      for (const auto& [index, value] : _fixed_values) {
+        result[index] = value;
+      }
     }
 
-    template <typename T = std::string>
-    auto to_bqm(const std::unordered_map<std::string, double>& feed_dict, cimod::Vartype vartype) const noexcept {
-      const auto [linear, quadratic, offset] = to_bqm_parameters<T>(feed_dict);
+    static auto check_values(std::vector<int> values) {
+      if (std::find(std::begin(values), std::end(values), missing_value) != std::end(values)) {
+        throw std::out_of_range("variable is not found in sample.");
+      }
 
-      return cimod::BinaryQuadraticModel<T, double, cimod::Dense>(linear, quadratic, offset, vartype);
+      return values;
     }
 
-    template <typename T = std::string>
-    auto energy(const std::unordered_map<T, int>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const noexcept {
-      return to_bqm<T>(feed_dict, to_cimod_vartype(vartype)).energy([&] {
-        // BinaryQuadraticModelの引数でvartypeを設定しても、energyでは使われないみたい。。。Determine the energy of the specified sample of a binary quadratic modelって書いてある。
-        // しょうがないので、spinからbinaryに変換します。
+    // presolveで固定した変数を、サンプルに追加します。値は、サンプルのvartypeに合わせます。
 
-        auto result = sample;
+    template <typename T>
+    auto complete_sample(const std::unordered_map<T, int>& sample, const std::string& vartype) const noexcept {
+      auto result = sample;
 
-        if (vartype == "SPIN") {
-          for (const auto& [name, value] : sample) {
-            result[name] = (value + 1) / 2;
+      for (const auto& [index, value] : _fixed_values) {
+        const auto key = [&, index = index] {
+          if constexpr (std::is_same_v<T, std::string>) {
+            return _variables.name(index);
+          } else {
+            return index;
           }
+        }();
+
+        if (_domain == domain::binary) {
+          result.emplace(key, vartype == "BINARY" ? value : value * 2 - 1);
+        } else {
+          result.emplace(key, vartype == "BINARY" ? (value + 1) / 2 : value);
         }
+      }
 
-        return result;
-      }());
+      return result;
     }
 
-    template <typename T = std::string>
-    auto decode_sample(const std::unordered_map<T, int>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const noexcept {
-      const auto evaluate = pyquboc::evaluate(feed_dict);
-      const auto evaluate_polynomial = [&](const auto& polynomial, const auto& sample) {
-        return std::accumulate(std::begin(polynomial), std::end(polynomial), 0.0, [&](const auto acc, const auto& term) {
-          return acc +
-                 std::accumulate(std::begin(term.first.indexes()), std::end(term.first.indexes()), 1, [&](const auto acc, const auto& index) {
-                   const auto value = sample.at(_variables.name(index));
-
-                   return acc * (vartype == "BINARY" ? value : (value + 1) / 2);
-                 }) * evaluate(term.second);
-        });
-      };
+    static auto evaluate_polynomial(const polynomial& polynomial, const std::vector<int>& values, const pyquboc::evaluate& evaluate) {
+      return std::accumulate(std::begin(polynomial), std::end(polynomial), 0.0, [&](const auto acc, const auto& term) {
+        return acc +
+               std::accumulate(std::begin(term.first.indexes()), std::end(term.first.indexes()), 1, [&](const auto acc, const auto& index) {
+                 const auto value = values[index];
+
+                 if (value == missing_value) {
+                   throw std::out_of_range("variable is not found in sample.");
+                 }
+
+                 return acc * value;
+               }) * evaluate(term.second);
+      });
+    }
 
+    auto decode(std::unordered_map<std::string, int> sample, const std::vector<int>& values, const pyquboc::evaluate& evaluate) const {
       return solution(
-          sample,
-          energy<T>(sample, vartype, feed_dict),
+          std::move(sample),
+          evaluate_polynomial(_polynomial, values, evaluate),
           [&] {
             auto result = std::unordered_map<std::string, double>{};
 
             for (const auto& [name, polynomial] : _sub_hamiltonians) {
-              result.emplace(name, evaluate_polynomial(polynomial, sample));
+              result.emplace(name, evaluate_polynomial(*polynomial, values, evaluate));
             }
 
             return result;
@@ -307,39 +713,701 @@ namespace pyquboc {
           [&] {
             auto result = std::unordered_map<std::string, std::pair<bool, double>>{};
 
-            for (const auto& [name, pair] : _constraints) {
-              const auto& [polynomial, condition] = pair;
-              const auto energy = evaluate_polynomial(polynomial, sample);
+            for (const auto& [name, constraint] : _constraints) {
+              const auto energy = constraint.energy([&](const auto& polynomial) {
+                return evaluate_polynomial(polynomial, values, evaluate);
+              });
 
-              result.emplace(name, std::pair{condition(energy), energy});
+              result.emplace(name, std::pair{constraint.condition()(energy), energy});
             }
 
             return result;
           }());
     }
 
-    template <typename T = std::string>
-    auto decode_samples(const std::vector<std::unordered_map<T, int>>& samples, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const noexcept {
-      auto result = std::vector<solution>{};
+    // 変数が変わったときに評価しなおすConstraintがすぐにわかるように、変数からConstraintへの転置インデックスを作ります。
 
-      std::transform(std::begin(samples), std::end(samples), std::back_inserter(result), [&](const auto& sample) {
-        return decode_sample(sample, vartype, feed_dict);
-      });
+    auto index_constraints() noexcept {
+      const auto names = [&] { // constraint_namesは後で定義しているので、まだ使えません。
+        auto result = std::vector<std::string>{};
 
-      return result;
-    }
-  };
+        for (const auto& [name, constraint] : _constraints) {
+          result.emplace_back(name);
+        }
 
-  template <>
-  inline auto model::to_bqm_parameters<int>(const std::unordered_map<std::string, double>& feed_dict) const noexcept { // メンバ関数を特殊化するときは、クラスの外に書かなければなりません。。。
-    const auto evaluate = pyquboc::evaluate(feed_dict);
+        std::sort(std::begin(result), std::end(result));
 
-    auto linear = cimod::Linear<int, double>{};
-    auto quadratic = cimod::Quadratic<int, double>{};
-    auto offset = 0.0;
+        return result;
+      }();
 
-    for (const auto& [product, coefficient] : _quadratic_polynomial) {
-      const auto coefficient_value = evaluate(coefficient);
+      auto constraints = std::vector<std::vector<int>>(std::size(_variables));
+
+      for (auto i = 0; i < static_cast<int>(std::size(names)); ++i) {
+        for (const auto& [product, coefficient] : _constraints.at(names[i]).polynomial()) {
+          for (const auto& index : product.indexes()) {
+            if (std::empty(constraints[index]) || constraints[index].back() != i) { // Constraintの順に見ていくので、重複は直前の要素だけを調べれば取り除けます。
+              constraints[index].emplace_back(i);
+            }
+          }
+        }
+      }
+
+      _constraint_indptr = std::vector<std::size_t>{0};
+      _constraint_indptr.reserve(std::size(constraints) + 1);
+
+      for (const auto& variable_constraints : constraints) {
+        _variable_constraints.insert(std::end(_variable_constraints), std::begin(variable_constraints), std::end(variable_constraints));
+        _constraint_indptr.emplace_back(std::size(_variable_constraints));
+      }
+    }
+
+  public:
+    model(pyquboc::polynomial polynomial, robin_hood::unordered_map<std::string, std::shared_ptr<const pyquboc::polynomial>> sub_hamiltonians, robin_hood::unordered_map<std::string, constraint_polynomial> constraints, pyquboc::variables variables, int auxiliary_variable_count = 0, pyquboc::domain domain = domain::binary, std::vector<std::pair<int, int>> fixed_values = {}) noexcept : _polynomial(std::move(polynomial)), _sub_hamiltonians(std::move(sub_hamiltonians)), _constraints(std::move(constraints)), _variables(std::move(variables)), _auxiliary_variable_count(auxiliary_variable_count), _domain(domain), _fixed_values(std::move(fixed_values)), _constraint_indptr{}, _variable_constraints{} {
+      index_constraints();
+    }
+
+    // コンテナを要素数に合わせて縮めて、メモリを節約します。
+
+    auto compact() noexcept {
+      _polynomial.rehash(0);
+      _sub_hamiltonians.rehash(0);
+      _constraints.rehash(0);
+      _variables.compact();
+    }
+
+    const auto& terms() const noexcept {
+      return _polynomial;
+    }
+
+    const auto& sub_hamiltonian_polynomials() const noexcept {
+      return _sub_hamiltonians;
+    }
+
+    const auto& constraint_polynomials() const noexcept {
+      return _constraints;
+    }
+
+    std::vector<std::string> variable_names() const noexcept {
+      return _variables.names();
+    }
+
+    auto auxiliary_variable_count() const noexcept {
+      return _auxiliary_variable_count;
+    }
+
+    auto domain() const noexcept {
+      return _domain;
+    }
+
+    const auto& fixed_values() const noexcept {
+      return _fixed_values;
+    }
+
+    auto fixed_variables() const noexcept {
+      auto result = std::unordered_map<std::string, int>{};
+
+      for (const auto& [index, value] : _fixed_values) {
+        result.emplace(_variables.name(index), value);
+      }
+
+      return result;
+    }
+
+    auto vartype() const noexcept {
+      return _domain == domain::binary ? cimod::Vartype::BINARY : cimod::Vartype::SPIN;
+    }
+
+    auto degree() const noexcept {
+      return std::accumulate(std::begin(_polynomial), std::end(_polynomial), 0, [](const auto& acc, const auto& term) {
+        return std::max(acc, static_cast<int>(std::size(term.first.indexes())));
+      });
+    }
+
+    // TODO: std::stringじゃなくてintの方を特殊化する。
+
+    template <typename T = std::string>
+    auto to_bqm_parameters(const std::unordered_map<std::string, double>& feed_dict) const { // 不格好でごめんなさい。PythonのBinaryQuadraticModelを作成可能にするために、このメンバ関数でBinaryQuadraticModelの引数を生成します。
+      const auto evaluate = pyquboc::evaluate(feed_dict);
+
+      const auto names = _variables.names(); // 名前の文字列は、変数ごとに一度だけ作ります。
+
+      auto linear = cimod::Linear<T, double>{};
+      auto quadratic = cimod::Quadratic<T, double>{};
+      auto offset = 0.0;
+
+      for (const auto& [product, coefficient] : _polynomial) {
+        const auto coefficient_value = evaluate(coefficient);
+
+        switch (std::size(product.indexes())) {
+        case 0: {
+          offset = coefficient_value; // 次数が0の項は1つにまとめられるので、この処理は最大で1回しか実行されません。なので、+=ではなくて=を使用しています。
+          break;
+        }
+        case 1: {
+          linear.emplace(names[product.indexes()[0]], coefficient_value);
+          break;
+        }
+        case 2: {
+          quadratic.emplace(std::pair{names[product.indexes()[0]], names[product.indexes()[1]]}, coefficient_value);
+          break;
+        }
+        default:
+          throw std::runtime_error("model is not quadratic. compile it with quadratize=True."); // quadratize=falseでコンパイルした場合は、3次以上の項があるかもしれません。
+        }
+      }
+
+      return std::tuple{linear, quadratic, offset};
+    }
+
+    template <typename T = std::string>
+    auto to_bqm(const std::unordered_map<std::string, double>& feed_dict, cimod::Vartype vartype) const {
+      const auto [linear, quadratic, offset] = to_bqm_parameters<T>(feed_dict);
+
+      return cimod::BinaryQuadraticModel<T, double, cimod::Dense>(linear, quadratic, offset, vartype);
+    }
+
+    // 2次に変換していない（quadratize=falseでコンパイルした）モデルも扱えるように、BinaryQuadraticModelを作らずに多項式を直接評価します。
+
+    template <typename T = std::string>
+    auto energy(const std::unordered_map<T, int>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const {
+      return evaluate_polynomial(_polynomial, to_values(sample, vartype), pyquboc::evaluate(feed_dict));
+    }
+
+    template <typename T>
+    auto energy(const dense_sample<T>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const {
+      return evaluate_polynomial(_polynomial, to_values(sample, vartype), pyquboc::evaluate(feed_dict));
+    }
+
+    // サンプルを、モデルの定義域の値のインデックス順の配列にします（evaluatorの初期状態など）。presolveで固定した変数は、固定した値にします。
+
+    template <typename T>
+    auto sample_values(const std::unordered_map<T, int>& sample, const std::string& vartype) const {
+      return check_values(to_values(complete_sample(sample, vartype), vartype));
+    }
+
+    template <typename T>
+    auto sample_values(const dense_sample<T>& sample, const std::string& vartype) const {
+      return check_values(to_values(sample, vartype));
+    }
+
+    // 複数のfeed_dictで、まとめて2次の係数を出力します。項の並び（rowsとcolumns）は共通で、valuesは(feed_dictの数, 項の数)の行列です。
+    // 1次の項は、rowとcolumnが同じ項として出力します。
+
+    auto to_coo_batch(const std::vector<std::unordered_map<std::string, double>>& feed_dicts) const {
+      const auto evaluate = pyquboc::evaluate_batch(feed_dicts);
+      const auto term_count = static_cast<int>(std::size(_polynomial)) - (_polynomial.find(product{}) != std::end(_polynomial) ? 1 : 0);
+
+      auto rows = std::vector<std::int32_t>{};
+      auto columns = std::vector<std::int32_t>{};
+      auto values = Eigen::MatrixXd(std::size(feed_dicts), term_count); // 列優先なので、項ごとの列は連続したメモリになります。
+      auto offsets = Eigen::VectorXd::Zero(std::size(feed_dicts)).eval();
+
+      rows.reserve(term_count);
+      columns.reserve(term_count);
+
+      for (const auto& [product, coefficient] : _polynomial) {
+        const auto& indexes = product.indexes();
+
+        if (std::size(indexes) > 2) {
+          throw std::runtime_error("model is not quadratic. compile it with quadratize=True.");
+        }
+
+        if (std::size(indexes) == 0) {
+          offsets = evaluate(coefficient).matrix();
+          continue;
+        }
+
+        values.col(std::size(rows)) = evaluate(coefficient).matrix();
+        rows.emplace_back(indexes[0]);
+        columns.emplace_back(indexes[std::size(indexes) - 1]);
+      }
+
+      return std::tuple{rows, columns, values, offsets};
+    }
+
+    // 任意の次数の多項式を出力します。i番目の項は、indexes[indptr[i]]からindexes[indptr[i + 1] - 1]までの変数の積になります（scipyのCSRと同じ形式）。
+
+    auto to_hubo_arrays(const std::unordered_map<std::string, double>& feed_dict) const {
+      const auto evaluate = pyquboc::evaluate(feed_dict);
+
+      auto indptr = std::vector<std::int64_t>{0};
+      auto indexes = std::vector<std::int32_t>{};
+      auto coefficients = std::vector<double>{};
+      auto offset = 0.0;
+
+      indptr.reserve(std::size(_polynomial) + 1);
+      coefficients.reserve(std::size(_polynomial));
+
+      for (const auto& [product, coefficient] : _polynomial) {
+        const auto coefficient_value = evaluate(coefficient);
+
+        if (std::size(product.indexes()) == 0) {
+          offset += coefficient_value;
+          continue;
+        }
+
+        indexes.insert(std::end(indexes), std::begin(product.indexes()), std::end(product.indexes()));
+        indptr.emplace_back(std::size(indexes));
+        coefficients.emplace_back(coefficient_value);
+      }
+
+      return std::tuple{indptr, indexes, coefficients, offset};
+    }
+
+    // 最適解を失わずに値を決められる変数を固定して、小さくしたモデルを返します。固定の判断には係数の値が必要なので、返すモデルの係数はfeed_dictで評価した数値になります。
+    // sub_hamiltonianと制約は元のままにしておいて、decode_sampleで固定した変数をサンプルに補ってから評価します。
+
+    auto presolve(const std::unordered_map<std::string, double>& feed_dict) const {
+      const auto evaluate = pyquboc::evaluate(feed_dict);
+      const auto variable_count = static_cast<int>(std::size(_variables));
+
+      auto presolver = pyquboc::presolver(variable_count);
+
+      for (const auto& [index, value] : _fixed_values) {
+        presolver.fixed(index, _domain == domain::binary ? value : (value + 1) / 2);
+      }
+
+      auto coefficient_values = std::vector<std::pair<const product*, double>>{};
+
+      coefficient_values.reserve(std::size(_polynomial));
+
+      for (const auto& [product, coefficient] : _polynomial) {
+        const auto& indexes = product.indexes();
+        const auto coefficient_value = evaluate(coefficient);
+
+        coefficient_values.emplace_back(&product, coefficient_value);
+
+        switch (std::size(indexes)) { // 固定はbinaryで考えるので、spinの場合はs = 2x - 1で変換します。
+        case 0: {
+          break;
+        }
+        case 1: {
+          presolver.add_linear(indexes[0], _domain == domain::binary ? coefficient_value : coefficient_value * 2);
+          break;
+        }
+        case 2: {
+          if (_domain == domain::binary) {
+            presolver.add_quadratic(indexes[0], indexes[1], coefficient_value);
+          } else {
+            presolver.add_quadratic(indexes[0], indexes[1], coefficient_value * 4);
+            presolver.add_linear(indexes[0], coefficient_value * -2);
+            presolver.add_linear(indexes[1], coefficient_value * -2);
+          }
+          break;
+        }
+        default:
+          throw std::runtime_error("model is not quadratic. compile it with quadratize=True.");
+        }
+      }
+
+      const auto binary_values = presolver.solve();
+
+      auto values = std::vector<int>(variable_count, missing_value);
+      auto fixed_values = std::vector<std::pair<int, int>>{};
+
+      for (auto i = 0; i < variable_count; ++i) {
+        if (binary_values[i] >= 0) {
+          values[i] = _domain == domain::binary ? binary_values[i] : binary_values[i] * 2 - 1;
+          fixed_values.emplace_back(i, values[i]);
+        }
+      }
+
+      auto reduced_coefficients = robin_hood::unordered_map<product, double>{};
+
+      for (const auto& [product, coefficient_value] : coefficient_values) {
+        auto indexes = pyquboc::indexes{};
+        auto scale = coefficient_value;
+
+        for (const auto& index : product->indexes()) {
+          if (values[index] == missing_value) {
+            indexes.emplace_back(index);
+          } else {
+            scale *= values[index];
+          }
+        }
+
+        reduced_coefficients[pyquboc::product(indexes)] += scale;
+      }
+
+      auto polynomial = pyquboc::polynomial{};
+
+      for (const auto& [product, coefficient_value] : reduced_coefficients) {
+        if (coefficient_value != 0 || std::empty(product.indexes())) {
+          polynomial.emplace(product, std::make_shared<const numeric_literal>(coefficient_value));
+        }
+      }
+
+      return model(std::move(polynomial), _sub_hamiltonians, _constraints, _variables, _auxiliary_variable_count, _domain, std::move(fixed_values));
+    }
+
+    // 相互作用グラフで近い変数が近いインデックスになるように、変数を並べ替えたモデルを返します。QUBO行列の帯幅が小さくなって、隣接リストをなめるサンプラーのメモリ・アクセスが局所的になります。
+    // 戻り値の2つ目は、新しいインデックスから元のインデックスへの対応です。項に出てこない変数は、元の順序のまま最後に置きます。
+
+    auto reorder(pyquboc::ordering ordering) const noexcept {
+      const auto variable_count = static_cast<int>(std::size(_variables));
+
+      auto neighbors = std::vector<std::vector<int>>(variable_count);
+      auto used = std::vector<bool>(variable_count, false);
+
+      for (const auto& [product, _] : _polynomial) {
+        const auto& indexes = product.indexes();
+
+        for (auto i = 0; i < static_cast<int>(std::size(indexes)); ++i) {
+          used[indexes[i]] = true;
+
+          for (auto j = 0; j < static_cast<int>(std::size(indexes)); ++j) {
+            if (i != j) {
+              neighbors[indexes[i]].emplace_back(indexes[j]);
+            }
+          }
+        }
+      }
+
+      for (auto& variable_neighbors : neighbors) {
+        std::sort(std::begin(variable_neighbors), std::end(variable_neighbors));
+        variable_neighbors.erase(std::unique(std::begin(variable_neighbors), std::end(variable_neighbors)), std::end(variable_neighbors));
+      }
+
+      const auto degree = [&](const auto& index) {
+        return std::size(neighbors[index]);
+      };
+
+      if (ordering == ordering::rcm) { // Cuthill-McKeeでは、次数が小さい隣から訪問します。
+        for (auto& variable_neighbors : neighbors) {
+          std::stable_sort(std::begin(variable_neighbors), std::end(variable_neighbors), [&](const auto& index_1, const auto& index_2) {
+            return degree(index_1) < degree(index_2);
+          });
+        }
+      }
+
+      // 次数が小さい変数から幅優先探索を始めます。各連結成分の最初の変数は、その成分で次数が最小の変数になります。
+
+      auto starts = std::vector<int>{};
+
+      for (auto i = 0; i < variable_count; ++i) {
+        if (used[i]) {
+          starts.emplace_back(i);
+        }
+      }
+
+      std::stable_sort(std::begin(starts), std::end(starts), [&](const auto& index_1, const auto& index_2) {
+        return degree(index_1) < degree(index_2);
+      });
+
+      auto permutation = std::vector<int>{};
+      auto visited = std::vector<bool>(variable_count, false);
+
+      permutation.reserve(variable_count);
+
+      for (const auto& start : starts) {
+        if (visited[start]) {
+          continue;
+        }
+
+        auto head = std::size(permutation); // permutationを、幅優先探索のキューとして使います。
+
+        visited[start] = true;
+        permutation.emplace_back(start);
+
+        while (head < std::size(permutation)) {
+          const auto index = permutation[head++];
+
+          for (const auto& neighbor : neighbors[index]) {
+            if (!visited[neighbor]) {
+              visited[neighbor] = true;
+              permutation.emplace_back(neighbor);
+            }
+          }
+        }
+      }
+
+      if (ordering == ordering::rcm) {
+        std::reverse(std::begin(permutation), std::end(permutation));
+      }
+
+      for (auto i = 0; i < variable_count; ++i) {
+        if (!visited[i]) {
+          permutation.emplace_back(i);
+        }
+      }
+
+      // インデックスを付け替えます。
+
+      auto indexes = std::vector<int>(variable_count);
+      auto variables = pyquboc::variables();
+
+      for (auto i = 0; i < variable_count; ++i) {
+        indexes[permutation[i]] = variables.index(_variables.id(permutation[i]));
+      }
+
+      const auto reorder_polynomial = [&](const pyquboc::polynomial& polynomial) {
+        auto result = pyquboc::polynomial{};
+
+        result.reserve(std::size(polynomial));
+
+        for (const auto& [product, coefficient] : polynomial) {
+          auto product_indexes = product.indexes();
+
+          for (auto& index : product_indexes) {
+            index = indexes[index];
+          }
+
+          std::sort(std::begin(product_indexes), std::end(product_indexes));
+
+          result.emplace(pyquboc::product(product_indexes), coefficient);
+        }
+
+        return result;
+      };
+
+      auto sub_hamiltonians = robin_hood::unordered_map<std::string, std::shared_ptr<const pyquboc::polynomial>>{};
+
+      for (const auto& [name, polynomial] : _sub_hamiltonians) {
+        sub_hamiltonians.emplace(name, std::make_shared<const pyquboc::polynomial>(reorder_polynomial(*polynomial)));
+      }
+
+      auto constraints = robin_hood::unordered_map<std::string, constraint_polynomial>{};
+
+      for (const auto& [name, constraint] : _constraints) {
+        constraints.emplace(name, constraint_polynomial(std::make_shared<const pyquboc::polynomial>(reorder_polynomial(constraint.polynomial())), constraint.condition(), constraint.squared()));
+      }
+
+      auto fixed_values = _fixed_values;
+
+      for (auto& [index, value] : fixed_values) {
+        index = indexes[index];
+      }
+
+      return std::pair{model(reorder_polynomial(_polynomial), std::move(sub_hamiltonians), std::move(constraints), std::move(variables), _auxiliary_variable_count, _domain, std::move(fixed_values)), std::move(permutation)};
+    }
+
+    // 変数の相互作用グラフの連結成分ごとに、モデルを分割します。成分同士は定数項でしかつながっていないので、別々に解いて結果を組み合わせられます。
+    // 成分のモデルは変数のインデックスをそのまま使うので、index_labelで出力してもインデックスは元のモデルと同じです。定数項は、最初の成分に入れます。
+    // 成分のモデルには制約等はありませんから、デコードは元のモデルで（decode_samplesetsやmerge_samplesで組み合わせてから）実施してください。
+
+    auto components() const noexcept {
+      auto parents = std::vector<int>(std::size(_variables));
+
+      std::iota(std::begin(parents), std::end(parents), 0);
+
+      const auto find = [&](int index) {
+        while (parents[index] != index) {
+          index = parents[index] = parents[parents[index]]; // 経路を半分に縮めながら、根をたどります。
+        }
+
+        return index;
+      };
+
+      auto used = std::vector<bool>(std::size(_variables), false);
+
+      for (const auto& [product, _] : _polynomial) {
+        const auto& indexes = product.indexes();
+
+        for (const auto& index : indexes) {
+          used[index] = true;
+        }
+
+        for (auto i = 1; i < static_cast<int>(std::size(indexes)); ++i) {
+          const auto root_1 = find(indexes[0]);
+          const auto root_2 = find(indexes[i]);
+
+          parents[std::max(root_1, root_2)] = std::min(root_1, root_2); // 小さいインデックスを根にしておけば、成分の順序が決まります。
+        }
+      }
+
+      auto component_indexes = std::vector<int>(std::size(_variables), -1);
+      auto component_count = 0;
+
+      for (auto i = 0; i < static_cast<int>(std::size(_variables)); ++i) {
+        if (used[i] && find(i) == i) {
+          component_indexes[i] = component_count++;
+        }
+      }
+
+      auto polynomials = std::vector<pyquboc::polynomial>(std::max(component_count, 1));
+
+      for (const auto& [product, coefficient] : _polynomial) {
+        polynomials[std::empty(product.indexes()) ? 0 : component_indexes[find(product.indexes()[0])]].emplace(product, coefficient);
+      }
+
+      auto result = std::vector<model>{};
+
+      result.reserve(std::size(polynomials));
+
+      for (auto& polynomial : polynomials) {
+        result.emplace_back(std::move(polynomial), robin_hood::unordered_map<std::string, std::shared_ptr<const pyquboc::polynomial>>{}, robin_hood::unordered_map<std::string, constraint_polynomial>{}, _variables, 0, _domain);
+      }
+
+      return result;
+    }
+
+    template <typename T = std::string>
+    auto decode_sample(const std::unordered_map<T, int>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const {
+      const auto full_sample = complete_sample(sample, vartype);
+
+      return decode(full_sample, to_values(full_sample, vartype), pyquboc::evaluate(feed_dict));
+    }
+
+    template <typename T>
+    auto decode_sample(const dense_sample<T>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const {
+      const auto values = to_values(sample, vartype);
+
+      return decode(
+          [&] {
+            auto result = std::unordered_map<std::string, int>{};
+
+            for (auto i = 0; i < static_cast<int>(std::size(values)); ++i) {
+              if (values[i] == missing_value) {
+                continue;
+              }
+
+              if (_domain == domain::binary) { // 固定した変数の値も入れるので、定義域の値からサンプルのvartypeに戻します。
+                result.emplace(_variables.name(i), vartype == "BINARY" ? values[i] : values[i] * 2 - 1);
+              } else {
+                result.emplace(_variables.name(i), vartype == "BINARY" ? (values[i] + 1) / 2 : values[i]);
+              }
+            }
+
+            return result;
+          }(),
+          values,
+          pyquboc::evaluate(feed_dict));
+    }
+
+    auto sub_hamiltonian_names() const noexcept {
+      auto result = std::vector<std::string>{};
+
+      std::transform(std::begin(_sub_hamiltonians), std::end(_sub_hamiltonians), std::back_inserter(result), [](const auto& pair) {
+        return pair.first;
+      });
+
+      std::sort(std::begin(result), std::end(result));
+
+      return result;
+    }
+
+    // 変数を含むConstraintの、constraint_namesでのインデックスの範囲を返します。
+
+    auto variable_constraints(int index) const noexcept {
+      return std::pair{std::data(_variable_constraints) + _constraint_indptr[index], std::data(_variable_constraints) + _constraint_indptr[index + 1]};
+    }
+
+    auto constraint_names() const noexcept {
+      auto result = std::vector<std::string>{};
+
+      std::transform(std::begin(_constraints), std::end(_constraints), std::back_inserter(result), [](const auto& pair) {
+        return pair.first;
+      });
+
+      std::sort(std::begin(result), std::end(result));
+
+      return result;
+    }
+
+    // 行がサンプル、列が変数（インデックス順）の行列を、サンプルごとのsolutionを作らずに列ごとの配列にデコードします。
+    // 係数は最初に一度だけ評価して、行はブロックに分けてthread_count個のスレッドで並列に処理します。PythonのConstraintのconditionは、呼び出すたびにGILを取得するので遅くなります。
+
+    template <typename T>
+    auto decode_rows(const T* samples, std::size_t row_count, std::size_t column_count, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict, const decoded_columns& columns, int thread_count = 0) const {
+      constexpr auto block_size = std::size_t{1024};
+
+      if (column_count != std::size(_variables)) {
+        throw std::runtime_error("the number of columns of samples should be the number of variables.");
+      }
+
+      const auto evaluate = pyquboc::evaluate(feed_dict);
+      const auto polynomial = flat_polynomial(_polynomial, evaluate);
+
+      const auto sub_hamiltonians = [&] {
+        auto result = std::vector<flat_polynomial>{};
+
+        for (const auto& name : sub_hamiltonian_names()) {
+          result.emplace_back(*_sub_hamiltonians.at(name), evaluate);
+        }
+
+        return result;
+      }();
+
+      const auto constraints = [&] {
+        auto result = std::vector<std::pair<const constraint_polynomial*, flat_polynomial>>{};
+
+        for (const auto& name : constraint_names()) {
+          const auto& constraint = _constraints.at(name);
+
+          result.emplace_back(&constraint, flat_polynomial(constraint.polynomial(), evaluate));
+        }
+
+        return result;
+      }();
+
+      parallel_for(static_cast<int>((row_count + block_size - 1) / block_size), thread_count, [&](int block) {
+        auto values = std::vector<int>(std::size(_variables), missing_value);
+
+        for (auto i = block * block_size; i < std::min((block + 1) * block_size, row_count); ++i) {
+          to_values(dense_sample<T>(samples + i * column_count, column_count), vartype == "BINARY", values);
+
+          columns.energies[i] = polynomial(values);
+
+          for (auto j = std::size_t{0}; j < std::size(sub_hamiltonians); ++j) {
+            columns.sub_hamiltonians[j][i] = sub_hamiltonians[j](values);
+          }
+
+          for (auto j = std::size_t{0}; j < std::size(constraints); ++j) {
+            const auto& [constraint, constraint_polynomial] = constraints[j];
+
+            const auto energy = constraint->energy([&](const auto&) {
+              return constraint_polynomial(values);
+            });
+
+            columns.constraint_energies[j][i] = energy;
+            columns.constraint_satisfactions[j][i] = constraint->condition()(energy);
+          }
+        }
+      });
+    }
+
+    template <typename T = std::string>
+    auto decode_samples(const std::vector<std::unordered_map<T, int>>& samples, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const {
+      auto result = std::vector<solution>{};
+
+      std::transform(std::begin(samples), std::end(samples), std::back_inserter(result), [&](const auto& sample) {
+        return decode_sample(sample, vartype, feed_dict);
+      });
+
+      return result;
+    }
+  };
+
+  // componentsごとのサンプルを組み合わせて、元のモデルのサンプルにします。i番目のサンプルは、各成分のi番目のサンプルを合わせたものです（数は、一番少ない成分に合わせます）。
+  // 成分ごとにエネルギー順に並べておけば、最初のサンプルが全体の最良になります。
+
+  template <typename T>
+  inline auto merge_samples(const std::vector<std::vector<std::unordered_map<T, int>>>& samples) noexcept {
+    const auto size = std::accumulate(std::begin(samples), std::end(samples), std::empty(samples) ? std::size_t{0} : std::numeric_limits<std::size_t>::max(), [](const auto& acc, const auto& component_samples) {
+      return std::min(acc, std::size(component_samples));
+    });
+
+    auto result = std::vector<std::unordered_map<T, int>>(size);
+
+    for (const auto& component_samples : samples) {
+      for (auto i = std::size_t{0}; i < size; ++i) {
+        result[i].insert(std::begin(component_samples[i]), std::end(component_samples[i]));
+      }
+    }
+
+    return result;
+  }
+
+  template <>
+  inline auto model::to_bqm_parameters<int>(const std::unordered_map<std::string, double>& feed_dict) const { // メンバ関数を特殊化するときは、クラスの外に書かなければなりません。。。
+    const auto evaluate = pyquboc::evaluate(feed_dict);
+
+    auto linear = cimod::Linear<int, double>{};
+    auto quadratic = cimod::Quadratic<int, double>{};
+    auto offset = 0.0;
+
+    for (const auto& [product, coefficient] : _polynomial) {
+      const auto coefficient_value = evaluate(coefficient);
 
       switch (std::size(product.indexes())) {
       case 0: {
@@ -355,7 +1423,7 @@ namespace pyquboc {
         break;
       }
       default:
-        throw std::runtime_error("invalid term."); // ここには絶対にこないはず。
+        throw std::runtime_error("model is not quadratic. compile it with quadratize=True."); // quadratize=falseでコンパイルした場合は、3次以上の項があるかもしれません。
       }
     }
 
@@ -363,50 +1431,20 @@ namespace pyquboc {
   }
 
   template <>
-  inline auto model::decode_sample<int>(const std::unordered_map<int, int>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const noexcept {
-    const auto evaluate = pyquboc::evaluate(feed_dict);
-    const auto evaluate_polynomial = [&](const auto& polynomial, const auto& sample) {
-      return std::accumulate(std::begin(polynomial), std::end(polynomial), 0.0, [&](const auto acc, const auto& term) {
-        return acc +
-               std::accumulate(std::begin(term.first.indexes()), std::end(term.first.indexes()), 1, [&](const auto acc, const auto& index) {
-                 const auto value = sample.at(index);
+  inline auto model::decode_sample<int>(const std::unordered_map<int, int>& sample, const std::string& vartype, const std::unordered_map<std::string, double>& feed_dict) const {
+    const auto full_sample = complete_sample(sample, vartype);
 
-                 return acc * (vartype == "BINARY" ? value : (value + 1) / 2);
-               }) * evaluate(term.second);
-      });
-    };
-
-    return solution(
+    return decode(
         [&] {
           auto result = std::unordered_map<std::string, int>{};
 
-          std::transform(std::begin(sample), std::end(sample), std::inserter(result, std::begin(result)), [&](const auto& index_and_value) {
+          std::transform(std::begin(full_sample), std::end(full_sample), std::inserter(result, std::begin(result)), [&](const auto& index_and_value) {
             return std::pair{_variables.name(index_and_value.first), index_and_value.second};
           });
 
           return result;
         }(),
-        energy<int>(sample, vartype, feed_dict),
-        [&] {
-          auto result = std::unordered_map<std::string, double>{};
-
-          for (const auto& [name, polynomial] : _sub_hamiltonians) {
-            result.emplace(name, evaluate_polynomial(polynomial, sample));
-          }
-
-          return result;
-        }(),
-        [&] {
-          auto result = std::unordered_map<std::string, std::pair<bool, double>>{};
-
-          for (const auto& [name, pair] : _constraints) {
-            const auto& [polynomial, condition] = pair;
-            const auto energy = evaluate_polynomial(polynomial, sample);
-
-            result.emplace(name, std::pair{condition(energy), energy});
-          }
-
-          return result;
-        }());
+        to_values(full_sample, vartype),
+        pyquboc::evaluate(feed_dict));
   }
 }
@@ -0,0 +1,633 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <robin_hood.h>
+
+#include "abstract_syntax_tree.hpp"
+
+namespace pyquboc {
+  // Parse model.
+
+  // Pythonを使わずにモデルを作れるように、テキスト形式のモデルを読み込んでexpressionにします。文法は以下の通り。改行は空白と同じ扱いなので、式を何行に分けて書いても大丈夫です。
+  //
+  //   # コメント。行末まで。
+  //   binary x y z[0..9]        変数の宣言。spinとplaceholderも同様です。[a..b]は、z[0]からz[9]までの宣言になります（多次元でも可）。
+  //   minimize 2 * x * y - x    目的関数に足し込みます。何回書いても構いません。
+  //   subh cost: x + y          SubH(x + y, "cost")。
+  //   constraint c: x + y <= 1  Constraint(x + y, "c", x <= 1)。比較（==、!=、<=、>=、<、>）を省略した場合は== 0です。
+  //   penalty p: (x - y)^2      WithPenalty(0, (x - y)^2, "p")。「penalty p: x + y, (x - y)^2」のように、値の式を先に書くこともできます。
+  //
+  // 式には、数値と宣言した変数、+、-、*、/（数値で割る場合のみ）、^か**（正の整数乗）、括弧が使えます。
+  // subhとconstraintとpenaltyのラベルは、後の式の中で名前として使えます（「minimize obj + 5 * c」など）。一度も使われなかったものは、そのまま目的関数に足し込みます。
+  // 文の区切りは予約語（binary、spin、placeholder、minimize、subh、constraint、penalty）で判断するので、これらは変数の名前には使えません。「;」で区切っても構いません。
+
+  class parse_error final : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  // Lexer.
+
+  enum class token_type {
+    identifier,
+    number,
+    symbol, // 演算子や括弧など。
+    end
+  };
+
+  struct token final {
+    token_type type;
+    std::string text;
+    double value;
+    int line;
+  };
+
+  // 大きなファイルでも全体をメモリに読み込まないように、streambufから1文字ずつ読みます（istream::getよりずっと速い）。
+
+  class lexer final {
+    std::streambuf* _buffer;
+    int _line;
+
+    static auto is_identifier_head(int c) noexcept {
+      return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+    }
+
+    static auto is_identifier_tail(int c) noexcept {
+      return is_identifier_head(c) || (c >= '0' && c <= '9') || c == '.' || c == '[' || c == ']'; // x[0][1]やx.yのような名前を使えるように。
+    }
+
+    static auto is_digit(int c) noexcept {
+      return c >= '0' && c <= '9';
+    }
+
+    auto peek() noexcept {
+      return _buffer->sgetc();
+    }
+
+    auto get() noexcept {
+      return _buffer->sbumpc();
+    }
+
+    auto skip_spaces() noexcept {
+      for (;;) {
+        const auto c = peek();
+
+        if (c == '\n') {
+          ++_line;
+        } else if (c == '#') {
+          while (peek() != '\n' && peek() != std::char_traits<char>::eof()) {
+            get();
+          }
+
+          continue;
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\f' && c != '\v') {
+          return;
+        }
+
+        get();
+      }
+    }
+
+    auto read_digits(std::string& text) noexcept {
+      while (is_digit(peek())) {
+        text.push_back(static_cast<char>(get()));
+      }
+    }
+
+  public:
+    lexer(std::istream& stream) noexcept : _buffer(stream.rdbuf()), _line(1) {
+      ;
+    }
+
+    auto line() const noexcept {
+      return _line;
+    }
+
+    auto next(token& result) {
+      skip_spaces();
+
+      const auto c = peek();
+
+      result.text.clear();
+      result.value = 0;
+      result.line = _line;
+
+      if (c == std::char_traits<char>::eof()) {
+        result.type = token_type::end;
+        return;
+      }
+
+      if (is_identifier_head(c)) {
+        while (is_identifier_tail(peek())) {
+          result.text.push_back(static_cast<char>(get()));
+        }
+
+        result.type = token_type::identifier;
+        return;
+      }
+
+      if (is_digit(c) || c == '.') {
+        read_digits(result.text);
+
+        if (peek() == '.') {
+          result.text.push_back(static_cast<char>(get()));
+          read_digits(result.text);
+        }
+
+        if (peek() == 'e' || peek() == 'E') {
+          result.text.push_back(static_cast<char>(get()));
+
+          if (peek() == '+' || peek() == '-') {
+            result.text.push_back(static_cast<char>(get()));
+          }
+
+          read_digits(result.text);
+        }
+
+        auto end = static_cast<char*>(nullptr);
+
+        result.value = std::strtod(result.text.c_str(), &end);
+
+        if (end != result.text.c_str() + std::size(result.text)) {
+          throw parse_error("line " + std::to_string(_line) + ": invalid number '" + result.text + "'.");
+        }
+
+        result.type = token_type::number;
+        return;
+      }
+
+      result.text.push_back(static_cast<char>(get()));
+
+      if ((c == '*' && peek() == '*') || ((c == '<' || c == '>' || c == '=' || c == '!') && peek() == '=')) {
+        result.text.push_back(static_cast<char>(get()));
+      }
+
+      if (result.text == "=" || result.text == "!") {
+        throw parse_error("line " + std::to_string(_line) + ": unexpected '" + result.text + "'.");
+      }
+
+      result.type = token_type::symbol;
+    }
+  };
+
+  // Parser.
+
+  class parser final {
+    struct symbol final {
+      std::shared_ptr<const pyquboc::expression> expression;
+      int term_index; // subhなどのラベルの場合は、_termsでの位置です。変数の場合は-1。
+    };
+
+    lexer _lexer;
+    token _token;
+    robin_hood::unordered_map<std::string, symbol> _symbols;
+    std::vector<std::pair<std::shared_ptr<const pyquboc::expression>, bool>> _terms; // 目的関数に足し込む式と、足し込むかどうか。
+    std::vector<std::string> _placeholder_names;
+
+    static auto is_keyword(const std::string& text) noexcept {
+      return text == "binary" || text == "spin" || text == "placeholder" || text == "minimize" || text == "subh" || text == "constraint" || text == "penalty";
+    }
+
+    [[noreturn]] auto error(const std::string& message) const {
+      throw parse_error("line " + std::to_string(_token.line) + ": " + message);
+    }
+
+    auto describe() const {
+      return _token.type == token_type::end ? std::string("end of file") : "'" + _token.text + "'";
+    }
+
+    auto next() {
+      _lexer.next(_token);
+    }
+
+    auto is_symbol(const char* text) const noexcept {
+      return _token.type == token_type::symbol && _token.text == text;
+    }
+
+    auto expect(const char* text) {
+      if (!is_symbol(text)) {
+        error("expected '" + std::string(text) + "' but found " + describe() + ".");
+      }
+
+      next();
+    }
+
+    auto name() {
+      if (_token.type != token_type::identifier || is_keyword(_token.text)) {
+        error("expected a name but found " + describe() + ".");
+      }
+
+      auto result = _token.text;
+
+      next();
+
+      return result;
+    }
+
+    auto number() {
+      auto sign = 1.0;
+
+      while (is_symbol("-") || is_symbol("+")) {
+        sign *= is_symbol("-") ? -1 : 1;
+        next();
+      }
+
+      if (_token.type != token_type::number) {
+        error("expected a number but found " + describe() + ".");
+      }
+
+      const auto result = sign * _token.value;
+
+      next();
+
+      return result;
+    }
+
+    auto define(const std::string& name, const std::shared_ptr<const expression>& expression, int term_index, int line) {
+      if (!_symbols.emplace(name, symbol{expression, term_index}).second) {
+        throw parse_error("line " + std::to_string(line) + ": '" + name + "' is already defined.");
+      }
+    }
+
+    // Expression.
+
+    // 和は、Pythonの+=と同じように1つのadd_operatorにまとめます。入れ子にしないので、長い和でも展開が速いです。数値は畳み込んで最後に足します。
+
+    std::shared_ptr<const expression> sum() {
+      auto children = std::vector<std::shared_ptr<const expression>>{};
+      auto constant = 0.0;
+
+      const auto add = [&](const std::shared_ptr<const expression>& expression) {
+        if (expression->expression_type() == expression_type::numeric_literal) {
+          constant += std::static_pointer_cast<const numeric_literal>(expression)->value();
+          return;
+        }
+
+        children.emplace_back(expression);
+      };
+
+      add(product());
+
+      while (is_symbol("+") || is_symbol("-")) {
+        const auto negative = is_symbol("-");
+
+        next();
+
+        const auto operand = product();
+
+        add(negative ? std::make_shared<const numeric_literal>(-1) * operand : operand);
+      }
+
+      if (constant != 0 || std::empty(children)) {
+        children.emplace_back(std::make_shared<const numeric_literal>(constant));
+      }
+
+      if (std::size(children) == 1) {
+        return children.front();
+      }
+
+      const auto result = std::make_shared<add_operator>(children[0], children[1]);
+
+      for (auto it = std::next(std::begin(children), 2); it != std::end(children); ++it) {
+        result->add_child(*it);
+      }
+
+      return result;
+    }
+
+    std::shared_ptr<const expression> product() {
+      auto result = unary();
+
+      while (is_symbol("*") || is_symbol("/")) {
+        if (is_symbol("*")) {
+          next();
+          result = result * unary();
+          continue;
+        }
+
+        next();
+
+        const auto divisor = unary();
+
+        if (divisor->expression_type() != expression_type::numeric_literal) {
+          error("only division by a number is supported.");
+        }
+
+        if (std::static_pointer_cast<const numeric_literal>(divisor)->value() == 0) {
+          error("zero divide error.");
+        }
+
+        result = result * std::make_shared<const numeric_literal>(1 / std::static_pointer_cast<const numeric_literal>(divisor)->value());
+      }
+
+      return result;
+    }
+
+    std::shared_ptr<const expression> unary() {
+      if (is_symbol("-")) {
+        next();
+        return std::make_shared<const numeric_literal>(-1) * unary();
+      }
+
+      if (is_symbol("+")) {
+        next();
+        return unary();
+      }
+
+      return power();
+    }
+
+    std::shared_ptr<const expression> power() {
+      const auto base = primary();
+
+      if (!is_symbol("^") && !is_symbol("**")) {
+        return base;
+      }
+
+      next();
+
+      if (_token.type != token_type::number || _token.value != static_cast<int>(_token.value) || _token.value <= 0) {
+        error("`exponent` should be a positive integer but found " + describe() + ".");
+      }
+
+      const auto exponent = static_cast<int>(_token.value);
+
+      next();
+
+      return pyquboc::pow(base, exponent);
+    }
+
+    std::shared_ptr<const expression> primary() {
+      if (_token.type == token_type::number) {
+        const auto result = std::make_shared<const numeric_literal>(_token.value);
+
+        next();
+
+        return result;
+      }
+
+      if (is_symbol("(")) {
+        next();
+
+        const auto result = sum();
+
+        expect(")");
+
+        return result;
+      }
+
+      if (_token.type == token_type::identifier && !is_keyword(_token.text)) {
+        const auto it = _symbols.find(_token.text);
+
+        if (it == std::end(_symbols)) {
+          error("'" + _token.text + "' is not declared.");
+        }
+
+        if (it->second.term_index >= 0) {
+          _terms[it->second.term_index].second = false; // 式の中で使われたラベルは、目的関数には足し込みません。
+        }
+
+        next();
+
+        return it->second.expression;
+      }
+
+      error("expected an expression but found " + describe() + ".");
+    }
+
+    // Statement.
+
+    auto declare(const std::function<std::shared_ptr<const expression>(const std::string&)>& make_variable) {
+      do {
+        const auto line = _token.line;
+        const auto text = name();
+
+        // x[0..2][1..3]のような範囲を展開します。
+
+        auto names = std::vector<std::string>{""};
+
+        for (auto i = std::size_t{0}; i < std::size(text);) {
+          const auto range = text.find("..", i);
+          const auto open = range == std::string::npos ? std::string::npos : text.rfind('[', range);
+          const auto close = range == std::string::npos ? std::string::npos : text.find(']', range);
+
+          if (range == std::string::npos || open == std::string::npos || open < i || close == std::string::npos) {
+            if (range != std::string::npos) {
+              throw parse_error("line " + std::to_string(line) + ": invalid range in '" + text + "'.");
+            }
+
+            for (auto& name : names) {
+              name += text.substr(i);
+            }
+
+            break;
+          }
+
+          const auto parse_bound = [&](std::size_t begin, std::size_t end) {
+            auto bound_end = static_cast<char*>(nullptr);
+            const auto bound = text.substr(begin, end - begin);
+            const auto result = std::strtol(bound.c_str(), &bound_end, 10);
+
+            if (std::empty(bound) || bound_end != bound.c_str() + std::size(bound)) {
+              throw parse_error("line " + std::to_string(line) + ": invalid range in '" + text + "'.");
+            }
+
+            return result;
+          };
+
+          const auto lower = parse_bound(open + 1, range);
+          const auto upper = parse_bound(range + 2, close);
+
+          if (lower > upper) {
+            throw parse_error("line " + std::to_string(line) + ": invalid range in '" + text + "'.");
+          }
+
+          auto expanded_names = std::vector<std::string>{};
+
+          expanded_names.reserve(std::size(names) * (upper - lower + 1));
+
+          for (const auto& name : names) {
+            for (auto j = lower; j <= upper; ++j) {
+              expanded_names.emplace_back(name + text.substr(i, open + 1 - i) + std::to_string(j) + "]");
+            }
+          }
+
+          names = std::move(expanded_names);
+          i = close + 1;
+        }
+
+        for (const auto& name : names) {
+          const auto variable = make_variable(name);
+
+          if (!_symbols.emplace(name, symbol{variable, -1}).second) {
+            throw parse_error("line " + std::to_string(line) + ": '" + name + "' is already defined.");
+          }
+
+          if (variable->expression_type() == expression_type::place_holder_variable) {
+            _placeholder_names.emplace_back(name);
+          }
+        }
+      } while (_token.type == token_type::identifier && !is_keyword(_token.text));
+    }
+
+    auto condition() -> std::function<bool(double)> {
+      if (_token.type != token_type::symbol || !(_token.text == "==" || _token.text == "!=" || _token.text == "<=" || _token.text == ">=" || _token.text == "<" || _token.text == ">")) {
+        return [](double x) { return x == 0; };
+      }
+
+      const auto comparison = _token.text;
+
+      next();
+
+      const auto rhs = number();
+
+      if (comparison == "==") {
+        return [=](double x) { return x == rhs; };
+      }
+
+      if (comparison == "!=") {
+        return [=](double x) { return x != rhs; };
+      }
+
+      if (comparison == "<=") {
+        return [=](double x) { return x <= rhs; };
+      }
+
+      if (comparison == ">=") {
+        return [=](double x) { return x >= rhs; };
+      }
+
+      if (comparison == "<") {
+        return [=](double x) { return x < rhs; };
+      }
+
+      return [=](double x) { return x > rhs; };
+    }
+
+    auto statement() {
+      if (is_symbol(";")) {
+        next();
+        return;
+      }
+
+      if (_token.type != token_type::identifier || !is_keyword(_token.text)) {
+        error("expected a statement but found " + describe() + ".");
+      }
+
+      const auto keyword = _token.text;
+
+      next();
+
+      if (keyword == "binary") {
+        declare([](const auto& name) { return std::make_shared<const binary_variable>(name); });
+        return;
+      }
+
+      if (keyword == "spin") {
+        declare([](const auto& name) { return std::make_shared<const spin_variable>(name); });
+        return;
+      }
+
+      if (keyword == "placeholder") {
+        declare([](const auto& name) { return std::make_shared<const placeholder_variable>(name); });
+        return;
+      }
+
+      if (keyword == "minimize") {
+        _terms.emplace_back(sum(), true);
+        return;
+      }
+
+      const auto line = _token.line;
+      const auto label = name();
+
+      expect(":");
+
+      const auto expression = [&]() -> std::shared_ptr<const pyquboc::expression> {
+        const auto body = sum();
+
+        if (keyword == "subh") {
+          return std::make_shared<const sub_hamiltonian>(body, label);
+        }
+
+        if (keyword == "constraint") {
+          return std::make_shared<const constraint>(body, label, condition());
+        }
+
+        if (is_symbol(",")) {
+          next();
+          return std::make_shared<const with_penalty>(body, sum(), label);
+        }
+
+        return std::make_shared<const with_penalty>(std::make_shared<const numeric_literal>(0), body, label);
+      }();
+
+      define(label, expression, static_cast<int>(std::size(_terms)), line);
+      _terms.emplace_back(expression, true);
+    }
+
+  public:
+    parser(std::istream& stream) : _lexer(stream), _token{token_type::end, "", 0, 1}, _symbols(), _terms(), _placeholder_names() {
+      next();
+    }
+
+    // 宣言されたプレースホルダーの名前です。feed_dictに値が揃っているかを調べるのに使ってください（evaluateは、値がないと異常終了します）。
+
+    const auto& placeholder_names() const noexcept {
+      return _placeholder_names;
+    }
+
+    auto parse() {
+      while (_token.type != token_type::end) {
+        statement();
+      }
+
+      auto result = std::shared_ptr<add_operator>();
+      auto first = std::shared_ptr<const expression>();
+
+      for (const auto& [expression, included] : _terms) {
+        if (!included) {
+          continue;
+        }
+
+        if (!first) {
+          first = expression;
+        } else if (!result) {
+          result = std::make_shared<add_operator>(first, expression);
+        } else {
+          result->add_child(expression);
+        }
+      }
+
+      if (!first) {
+        throw parse_error("model has no expression. write `minimize`, `subh`, `constraint` or `penalty`.");
+      }
+
+      return result ? std::static_pointer_cast<const expression>(result) : first;
+    }
+  };
+
+  inline auto parse_model(std::istream& stream) {
+    return parser(stream).parse();
+  }
+
+  inline auto parse_model_file(const std::string& path) {
+    auto stream = std::ifstream(path, std::ios::binary);
+
+    if (!stream) {
+      throw std::runtime_error("failed to open model file '" + path + "'.");
+    }
+
+    return parse_model(stream);
+  }
+}
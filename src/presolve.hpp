@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <robin_hood.h>
+
+namespace pyquboc {
+  // Max flow.
+
+  // Dinic法で、最大流を求めます。容量はdoubleなので、epsilon以下の残余容量は0とみなします。
+
+  class max_flow final {
+    struct edge final {
+      int to;
+      double capacity;
+    };
+
+    std::vector<edge> _edges; // 辺iの逆辺は、i ^ 1です。
+    std::vector<double> _capacities;
+    std::vector<std::vector<int>> _graph;
+    std::vector<int> _levels;
+    std::vector<std::size_t> _iterators;
+    double _epsilon;
+
+    auto build_levels(int source, int sink) noexcept {
+      std::fill(std::begin(_levels), std::end(_levels), -1);
+
+      auto queue = std::queue<int>{};
+
+      _levels[source] = 0;
+      queue.emplace(source);
+
+      while (!std::empty(queue)) {
+        const auto node = queue.front();
+        queue.pop();
+
+        for (const auto& edge_index : _graph[node]) {
+          const auto& edge = _edges[edge_index];
+
+          if (edge.capacity > _epsilon && _levels[edge.to] < 0) {
+            _levels[edge.to] = _levels[node] + 1;
+            queue.emplace(edge.to);
+          }
+        }
+      }
+
+      return _levels[sink] >= 0;
+    }
+
+    // 再帰すると長い鎖でスタックが溢れるので、経路をstd::vectorで管理します。
+
+    auto augment(int source, int sink) noexcept {
+      auto path = std::vector<int>{};
+      auto node = source;
+
+      for (;;) {
+        if (node == sink) {
+          const auto result = std::accumulate(std::begin(path), std::end(path), std::numeric_limits<double>::max(), [&](const auto& acc, const auto& edge_index) {
+            return std::min(acc, _edges[edge_index].capacity);
+          });
+
+          for (const auto& edge_index : path) {
+            _edges[edge_index].capacity -= result;
+            _edges[edge_index ^ 1].capacity += result;
+          }
+
+          return result;
+        }
+
+        auto& i = _iterators[node];
+
+        while (i < std::size(_graph[node]) && (_edges[_graph[node][i]].capacity <= _epsilon || _levels[_edges[_graph[node][i]].to] != _levels[node] + 1)) {
+          ++i;
+        }
+
+        if (i == std::size(_graph[node])) { // 行き止まりなので、1つ戻ります。
+          if (std::empty(path)) {
+            return 0.0;
+          }
+
+          node = _edges[path.back() ^ 1].to;
+          path.pop_back();
+          ++_iterators[node];
+
+          continue;
+        }
+
+        path.emplace_back(_graph[node][i]);
+        node = _edges[_graph[node][i]].to;
+      }
+    }
+
+  public:
+    max_flow(int node_count) noexcept : _edges{}, _capacities{}, _graph(node_count), _levels(node_count), _iterators(node_count), _epsilon(0) {
+      ;
+    }
+
+    auto add_edge(int from, int to, double capacity) noexcept {
+      const auto result = static_cast<int>(std::size(_edges));
+
+      _edges.emplace_back(edge{to, capacity});
+      _edges.emplace_back(edge{from, 0});
+      _capacities.emplace_back(capacity);
+
+      _graph[from].emplace_back(result);
+      _graph[to].emplace_back(result + 1);
+
+      _epsilon = std::max(_epsilon, capacity * 1e-12);
+
+      return result;
+    }
+
+    auto solve(int source, int sink) noexcept {
+      auto result = 0.0;
+
+      while (build_levels(source, sink)) {
+        std::fill(std::begin(_iterators), std::end(_iterators), 0);
+
+        for (auto flow = augment(source, sink); flow > 0; flow = augment(source, sink)) {
+          result += flow;
+        }
+      }
+
+      return result;
+    }
+
+    auto original_edge(int edge_index) const noexcept { // 辺の始点と終点と、元の容量を返します。
+      return std::tuple{_edges[edge_index ^ 1].to, _edges[edge_index].to, _capacities[edge_index / 2]};
+    }
+
+    auto flow(int edge_index) const noexcept {
+      return _edges[edge_index ^ 1].capacity;
+    }
+
+    auto epsilon() const noexcept {
+      return _epsilon;
+    }
+  };
+
+  // Presolve.
+
+  // 0-1変数の2次の擬似ブール関数で、最適解を失わずに値を固定できる変数を探します。
+  // 局所場の上下限で固定できる変数（孤立した変数を含みます）を固定して、その後にroof dualityで持続性（persistency）がある変数を固定します。これを、固定できる変数がなくなるまで繰り返します。
+
+  class presolver final {
+    std::vector<double> _linear;
+    std::vector<robin_hood::unordered_map<int, double>> _quadratic; // 隣接リスト。固定した変数の辺は、削除していきます。
+    std::vector<int> _values;                                       // 固定していない変数は-1。
+
+    auto fix(int index, int value) noexcept {
+      for (const auto& [other, coefficient] : _quadratic[index]) {
+        if (value == 1) {
+          _linear[other] += coefficient;
+        }
+
+        _quadratic[other].erase(index);
+      }
+
+      _quadratic[index] = {};
+      _linear[index] = 0;
+      _values[index] = value;
+    }
+
+    // 変数を1にしたときのエネルギーの変化量が、他の変数の値によらず0以上（0以下）なら、0（1）に固定します。
+
+    auto fix_by_bounds() noexcept {
+      auto result = 0;
+
+      auto queue = std::queue<int>{};
+      auto queued = std::vector<bool>(std::size(_values), false);
+
+      for (auto i = 0; i < static_cast<int>(std::size(_values)); ++i) {
+        if (_values[i] < 0) {
+          queue.emplace(i);
+          queued[i] = true;
+        }
+      }
+
+      while (!std::empty(queue)) {
+        const auto index = queue.front();
+        queue.pop();
+        queued[index] = false;
+
+        if (_values[index] >= 0) {
+          continue;
+        }
+
+        auto lower = _linear[index];
+        auto upper = _linear[index];
+
+        for (const auto& [other, coefficient] : _quadratic[index]) {
+          (coefficient < 0 ? lower : upper) += coefficient;
+        }
+
+        if (lower < 0 && upper > 0) {
+          continue;
+        }
+
+        for (const auto& [other, coefficient] : _quadratic[index]) { // 隣の変数の局所場が変わるので、もう一度調べます。
+          if (!queued[other]) {
+            queue.emplace(other);
+            queued[other] = true;
+          }
+        }
+
+        fix(index, lower >= 0 ? 0 : 1);
+        ++result;
+      }
+
+      return result;
+    }
+
+    // Boros and Hammerのimplication networkで最大流を求めて、残余ネットワークでソースから到達できるリテラルを1に固定します。
+    // ノード0がソース（定数1）、ノード1がシンク（定数0）、ノード2 + 2iがx_i、ノード3 + 2iがx_iの否定です。否定は、ノード番号 ^ 1で求められます。
+
+    auto fix_by_roof_duality() noexcept {
+      const auto variable_count = static_cast<int>(std::size(_values));
+
+      auto flow = max_flow(2 * variable_count + 2);
+      auto edges = std::vector<std::pair<int, int>>{}; // 対称な辺の組。
+
+      const auto literal = [](int index, bool negated) {
+        return 2 + 2 * index + (negated ? 1 : 0);
+      };
+
+      const auto add_term = [&](int literal_1, int literal_2, double coefficient) { // coefficient * literal_1 * literal_2（coefficient > 0）を、2本の辺にします。
+        edges.emplace_back(flow.add_edge(literal_1, literal_2 ^ 1, coefficient), flow.add_edge(literal_2, literal_1 ^ 1, coefficient));
+      };
+
+      auto linear = _linear;
+
+      for (auto i = 0; i < variable_count; ++i) {
+        for (const auto& [j, coefficient] : _quadratic[i]) {
+          if (i > j || coefficient == 0) {
+            continue;
+          }
+
+          if (coefficient > 0) {
+            add_term(literal(i, false), literal(j, false), coefficient);
+          } else {
+            linear[i] += coefficient; // b * x_i * x_j = b * x_i + |b| * x_i * (1 - x_j)
+            add_term(literal(i, false), literal(j, true), -coefficient);
+          }
+        }
+      }
+
+      for (auto i = 0; i < variable_count; ++i) {
+        if (_values[i] >= 0 || linear[i] == 0) {
+          continue;
+        }
+
+        if (linear[i] > 0) {
+          add_term(0, literal(i, false), linear[i]); // 1次の項は、定数1のリテラルとの積とみなします。
+        } else {
+          add_term(0, literal(i, true), -linear[i]); // a * x_i = a + |a| * (1 - x_i)
+        }
+      }
+
+      flow.solve(0, 1);
+
+      // 最大流を対称にしてから、残余ネットワークでソースから到達できるノードを探します。
+
+      auto residual = std::vector<std::vector<int>>(2 * variable_count + 2);
+
+      for (const auto& [edge_1, edge_2] : edges) {
+        const auto symmetric_flow = (flow.flow(edge_1) + flow.flow(edge_2)) / 2;
+
+        for (const auto& edge : {edge_1, edge_2}) {
+          const auto& [from, to, capacity] = flow.original_edge(edge);
+
+          if (capacity - symmetric_flow > flow.epsilon()) {
+            residual[from].emplace_back(to);
+          }
+
+          if (symmetric_flow > flow.epsilon()) {
+            residual[to].emplace_back(from);
+          }
+        }
+      }
+
+      auto reached = std::vector<bool>(2 * variable_count + 2, false);
+      auto queue = std::queue<int>{};
+
+      reached[0] = true;
+      queue.emplace(0);
+
+      while (!std::empty(queue)) {
+        const auto node = queue.front();
+        queue.pop();
+
+        for (const auto& other : residual[node]) {
+          if (!reached[other]) {
+            reached[other] = true;
+            queue.emplace(other);
+          }
+        }
+      }
+
+      auto result = 0;
+
+      for (auto i = 0; i < variable_count; ++i) {
+        if (_values[i] >= 0 || reached[literal(i, false)] == reached[literal(i, true)]) {
+          continue;
+        }
+
+        fix(i, reached[literal(i, false)] ? 1 : 0);
+        ++result;
+      }
+
+      return result;
+    }
+
+  public:
+    presolver(int variable_count) noexcept : _linear(variable_count, 0), _quadratic(variable_count), _values(variable_count, -1) {
+      ;
+    }
+
+    auto add_linear(int index, double coefficient) noexcept {
+      _linear[index] += coefficient;
+    }
+
+    auto add_quadratic(int index_1, int index_2, double coefficient) noexcept {
+      _quadratic[index_1][index_2] += coefficient;
+      _quadratic[index_2][index_1] += coefficient;
+    }
+
+    auto fixed(int index, int value) noexcept { // すでに値が決まっている変数を指定します。
+      fix(index, value);
+    }
+
+    auto solve() noexcept {
+      while (fix_by_bounds() + fix_by_roof_duality() > 0) {
+        ;
+      }
+
+      return _values;
+    }
+  };
+}
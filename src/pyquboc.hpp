@@ -0,0 +1,27 @@
+#pragma once
+
+// PythonなしでC++から使う場合は、このヘッダーをインクルードしてください（CMakeならtarget_link_libraries(... pyquboc::pyquboc)）。ヘッダーだけのライブラリです。
+//
+//   // 式を作ります。演算子は、abstract_syntax_tree.hppのoperator+、operator*、powです。テキスト形式のモデルはparse_model（parser.hpp）で読み込めます。
+//   const auto x = std::make_shared<const pyquboc::binary_variable>("x");
+//   const auto y = std::make_shared<const pyquboc::binary_variable>("y");
+//   const auto a = std::make_shared<const pyquboc::placeholder_variable>("a");
+//   const auto h = x * y + a * pyquboc::pow(x + y + std::make_shared<const pyquboc::numeric_literal>(-1), 2);
+//
+//   // コンパイルします（compiler.hpp）。引数はPythonのModel.compileと同じで、制限時間などはcompile_optionsで指定します。
+//   const auto model = pyquboc::compile(h, 5.0);
+//
+//   // プレースホルダーに値を入れて、係数を取り出します（model.hpp）。
+//   const auto [indptr, indexes, coefficients, offset] = model.to_hubo_arrays({{"a", 2.0}});
+//
+//   // ファイルに保存する場合は、serialization.hppのsave_coo（係数だけ）かsave_model（モデル全体）を使います。
+//
+// エラーは例外で通知します（parse_error、term_limit_error、compile_timeout_errorなど。term_limit_errorだけはstd::length_errorの、他はstd::runtime_errorの派生クラスです）。
+
+#include "abstract_syntax_tree.hpp"
+#include "cache.hpp"
+#include "compiler.hpp"
+#include "evaluator.hpp"
+#include "model.hpp"
+#include "parser.hpp"
+#include "serialization.hpp"
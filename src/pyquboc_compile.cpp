@@ -0,0 +1,292 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "pyquboc.hpp"
+
+#define STRINGIFY(x) #x
+#define MACRO_STRINGIFY(x) STRINGIFY(x)
+
+#ifdef VERSION_INFO
+constexpr auto version = MACRO_STRINGIFY(VERSION_INFO);
+#else
+constexpr auto version = "dev";
+#endif
+
+// Pythonなしでモデルのファイル（parser.hppの形式）をコンパイルして、QUBOを出力するコマンドです。
+
+namespace {
+  constexpr auto usage = R"(usage: pyquboc_compile [options] <model file | ->
+
+Compile a model file to a QUBO. The input "-" reads the model from stdin.
+
+options:
+  -o, --output PATH             write to PATH instead of stdout
+  -f, --format FORMAT           coo (binary COO, default), text or model
+  -s, --strength VALUE          strength of the quadratization penalty (default: 5)
+  -q, --quadratization NAME     greedy (default), negative_term or pair_cover
+  -d, --domain DOMAIN           BINARY (default) or SPIN
+  -p, --param NAME=VALUE        value of a placeholder (repeatable)
+      --no-quadratize           keep terms of degree 3 or more (text and model formats)
+      --compact                 shrink the model's containers to save memory
+      --max-terms N             abort when the polynomial grows beyond N terms
+      --max-memory BYTES        abort when the polynomial would need more memory
+      --time-limit SECONDS      abort when the compile takes longer
+      --progress                report the progress to stderr
+  -v, --version                 print the version
+  -h, --help                    print this help
+)";
+
+  class usage_error final : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  struct arguments final {
+    std::string input;
+    std::optional<std::string> output;
+    std::string format = "coo";
+    double strength = 5;
+    std::string quadratization = "greedy";
+    std::string domain = "BINARY";
+    std::unordered_map<std::string, double> feed_dict;
+    bool quadratize = true;
+    bool compact = false;
+    pyquboc::compile_options options;
+    bool progress = false;
+  };
+
+  auto to_number(const std::string& option, const std::string& text) {
+    auto end = static_cast<char*>(nullptr);
+    const auto result = std::strtod(text.c_str(), &end);
+
+    if (std::empty(text) || end != text.c_str() + std::size(text)) {
+      throw usage_error("invalid value for " + option + ": '" + text + "'.");
+    }
+
+    return result;
+  }
+
+  auto to_size(const std::string& option, const std::string& text) {
+    const auto result = to_number(option, text);
+
+    if (result < 0 || result != static_cast<double>(static_cast<std::size_t>(result))) {
+      throw usage_error("invalid value for " + option + ": '" + text + "'.");
+    }
+
+    return static_cast<std::size_t>(result);
+  }
+
+  // 引数が不正な場合はusage_errorを投げます。--helpと--versionは、表示してstd::nulloptを返します。
+
+  auto parse_arguments(int argc, char** argv) -> std::optional<arguments> {
+    auto result = arguments{};
+    auto inputs = std::vector<std::string>{};
+
+    for (auto i = 1; i < argc; ++i) {
+      const auto argument = std::string(argv[i]);
+
+      const auto value = [&]() {
+        if (i + 1 >= argc) {
+          throw usage_error(argument + " requires a value.");
+        }
+
+        return std::string(argv[++i]);
+      };
+
+      if (argument == "-h" || argument == "--help") {
+        std::cout << usage;
+        return std::nullopt;
+      } else if (argument == "-v" || argument == "--version") {
+        std::cout << "pyquboc_compile " << version << std::endl;
+        return std::nullopt;
+      } else if (argument == "-o" || argument == "--output") {
+        result.output = value();
+      } else if (argument == "-f" || argument == "--format") {
+        result.format = value();
+
+        if (result.format != "coo" && result.format != "text" && result.format != "model") {
+          throw usage_error("`format` should be 'coo', 'text' or 'model'.");
+        }
+      } else if (argument == "-s" || argument == "--strength") {
+        result.strength = to_number(argument, value());
+      } else if (argument == "-q" || argument == "--quadratization") {
+        result.quadratization = value();
+      } else if (argument == "-d" || argument == "--domain") {
+        result.domain = value();
+      } else if (argument == "-p" || argument == "--param") {
+        const auto parameter = value();
+        const auto equal = parameter.find('=');
+
+        if (equal == std::string::npos) {
+          throw usage_error(argument + " should be NAME=VALUE.");
+        }
+
+        result.feed_dict[parameter.substr(0, equal)] = to_number(argument, parameter.substr(equal + 1));
+      } else if (argument == "--no-quadratize") {
+        result.quadratize = false;
+      } else if (argument == "--compact") {
+        result.compact = true;
+      } else if (argument == "--max-terms") {
+        result.options.max_terms = to_size(argument, value());
+      } else if (argument == "--max-memory") {
+        result.options.max_memory = to_size(argument, value());
+      } else if (argument == "--time-limit") {
+        result.options.time_limit = to_number(argument, value());
+      } else if (argument == "--progress") {
+        result.progress = true;
+      } else if (std::size(argument) > 1 && argument[0] == '-') {
+        throw usage_error("unknown option '" + argument + "'.");
+      } else {
+        inputs.emplace_back(argument);
+      }
+    }
+
+    if (std::size(inputs) != 1) {
+      throw usage_error("specify one model file.");
+    }
+
+    result.input = inputs.front();
+
+    return result;
+  }
+
+  auto write_text(const pyquboc::model& model, const std::unordered_map<std::string, double>& feed_dict, std::ostream& stream) {
+    const auto [indptr, indexes, coefficients, offset] = model.to_hubo_arrays(feed_dict);
+    const auto variable_names = model.variable_names();
+
+    stream << std::setprecision(std::numeric_limits<double>::max_digits10);
+
+    // 補助変数の名前には空白が入るので、名前は1行に1つ書いて、項では変数のインデックスを使います。
+
+    stream << "variables " << std::size(variable_names) << '\n';
+
+    for (const auto& variable_name : variable_names) {
+      stream << variable_name << '\n';
+    }
+
+    stream << "terms " << std::size(coefficients) << '\n';
+
+    for (auto i = std::size_t{0}; i < std::size(coefficients); ++i) {
+      for (auto j = indptr[i]; j < indptr[i + 1]; ++j) {
+        stream << indexes[j] << ' ';
+      }
+
+      if (indptr[i + 1] - indptr[i] == 1) {
+        stream << indexes[indptr[i]] << ' '; // 1次の項は、COOと同じようにrowとcolumnを同じにします。
+      }
+
+      stream << coefficients[i] << '\n';
+    }
+
+    stream << "offset " << offset << '\n';
+
+    stream.flush(); // バッファに残っている分の書き込みの失敗も、ここで検出します。
+
+    if (!stream) {
+      throw std::runtime_error("failed to write QUBO file.");
+    }
+  }
+
+  auto run(const arguments& arguments) {
+    auto file = std::ifstream();
+
+    if (arguments.input != "-") {
+      file.open(arguments.input, std::ios::binary);
+
+      if (!file) {
+        throw std::runtime_error("failed to open model file '" + arguments.input + "'.");
+      }
+    }
+
+    auto parser = pyquboc::parser(arguments.input != "-" ? static_cast<std::istream&>(file) : std::cin);
+    const auto expression = parser.parse();
+
+    for (const auto& placeholder_name : parser.placeholder_names()) { // コンパイルする前に調べて、時間を無駄にしないようにします。
+      if (arguments.feed_dict.find(placeholder_name) == std::end(arguments.feed_dict)) {
+        throw std::runtime_error("placeholder '" + placeholder_name + "' needs a value. pass it with -p " + placeholder_name + "=VALUE.");
+      }
+    }
+
+    auto options = arguments.options;
+
+    if (arguments.progress) {
+      options.progress = [](const pyquboc::compile_progress& progress) {
+        std::cerr << std::fixed << std::setprecision(2) << "\r" << pyquboc::to_string(progress.phase) << " " << std::setw(6) << progress.fraction * 100 << "% " << progress.term_count << " terms " << progress.variable_count << " variables " << progress.elapsed << "s\x1b[K" << std::flush;
+      };
+    }
+
+    const auto model = pyquboc::compile(expression, arguments.strength, pyquboc::to_quadratization(arguments.quadratization), arguments.compact, arguments.quadratize, pyquboc::to_domain(arguments.domain), options);
+
+    if (arguments.progress) {
+      std::cerr << std::endl;
+    }
+
+    auto output_file = std::ofstream();
+
+    if (arguments.output) {
+      output_file.open(*arguments.output, std::ios::binary);
+
+      if (!output_file) {
+        throw std::runtime_error("failed to open '" + *arguments.output + "'.");
+      }
+    } else if (arguments.format != "text") {
+#ifdef _WIN32
+      _setmode(_fileno(stdout), _O_BINARY); // 改行を変換されると、バイナリが壊れてしまいますから。
+#endif
+    }
+
+    auto& stream = arguments.output ? static_cast<std::ostream&>(output_file) : std::cout;
+
+    if (arguments.format == "coo") {
+      pyquboc::save_coo(model, arguments.feed_dict, stream);
+    } else if (arguments.format == "text") {
+      write_text(model, arguments.feed_dict, stream);
+    } else {
+      pyquboc::save_model(model, stream);
+    }
+
+    if (arguments.output) {
+      output_file.close(); // 閉じるときの書き込みの失敗を見逃すと、壊れたファイルを残したまま正常終了してしまいます。
+
+      if (!output_file) {
+        throw std::runtime_error("failed to write '" + *arguments.output + "'.");
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  std::ios::sync_with_stdio(false);
+
+  try {
+    const auto arguments = parse_arguments(argc, argv);
+
+    if (!arguments) {
+      return EXIT_SUCCESS;
+    }
+
+    run(*arguments);
+  } catch (const usage_error& error) {
+    std::cerr << "pyquboc_compile: " << error.what() << "\n\n" << usage;
+    return 2;
+  } catch (const std::exception& error) {
+    std::cerr << "pyquboc_compile: " << error.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
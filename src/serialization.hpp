@@ -0,0 +1,401 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <robin_hood.h>
+
+#include "abstract_syntax_tree.hpp"
+#include "model.hpp"
+
+namespace pyquboc {
+  // Serialize model.
+
+  // コンパイル済みのモデルを、バイナリ形式で保存したり読み込んだりします。形式が変わったら、format_versionを上げてください。
+  // Constraintのconditionは関数なので保存できません。読み込むときに、ラベルから引けるようにして渡してもらいます。
+
+  constexpr char serialization_magic[8] = {'P', 'Y', 'Q', 'U', 'B', 'O', 'C', '\0'};
+  constexpr std::uint32_t serialization_format_version = 2;
+
+  class binary_writer final {
+    std::ostream& _stream;
+
+  public:
+    binary_writer(std::ostream& stream) noexcept : _stream(stream) {
+      ;
+    }
+
+    template <typename T>
+    auto write(const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+
+      _stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    auto write(const std::string& value) {
+      write(static_cast<std::uint64_t>(std::size(value)));
+      _stream.write(std::data(value), std::size(value));
+    }
+
+    auto write(const std::shared_ptr<const expression>& expression) -> void {
+      write(static_cast<std::uint8_t>(expression->expression_type()));
+
+      switch (expression->expression_type()) {
+      case expression_type::add_operator: {
+        const auto& children = std::static_pointer_cast<const add_operator>(expression)->children();
+
+        write(static_cast<std::uint64_t>(std::size(children)));
+
+        for (const auto& child : children) {
+          write(child);
+        }
+
+        break;
+      }
+      case expression_type::mul_operator: {
+        write(std::static_pointer_cast<const mul_operator>(expression)->lhs());
+        write(std::static_pointer_cast<const mul_operator>(expression)->rhs());
+        break;
+      }
+      case expression_type::pow_operator: {
+        write(std::static_pointer_cast<const pow_operator>(expression)->base());
+        write(static_cast<std::int32_t>(std::static_pointer_cast<const pow_operator>(expression)->exponent()));
+        break;
+      }
+      case expression_type::place_holder_variable: {
+        write(std::static_pointer_cast<const placeholder_variable>(expression)->name());
+        break;
+      }
+      case expression_type::numeric_literal: {
+        write(std::static_pointer_cast<const numeric_literal>(expression)->value());
+        break;
+      }
+      default:
+        throw std::runtime_error("invalid coefficient."); // 係数には、数値とPlaceholderとその演算しか出てこないはず。
+      }
+    }
+
+    auto write(const polynomial& polynomial) {
+      write(static_cast<std::uint64_t>(std::size(polynomial)));
+
+      for (const auto& [product, coefficient] : polynomial) {
+        write(static_cast<std::uint32_t>(std::size(product.indexes())));
+
+        for (const auto& index : product.indexes()) {
+          write(static_cast<std::int32_t>(index));
+        }
+
+        write(coefficient);
+      }
+    }
+  };
+
+  class binary_reader final {
+    std::istream& _stream;
+
+  public:
+    binary_reader(std::istream& stream) noexcept : _stream(stream) {
+      ;
+    }
+
+    template <typename T>
+    auto read() {
+      static_assert(std::is_trivially_copyable_v<T>);
+
+      auto result = T{};
+
+      if (!_stream.read(reinterpret_cast<char*>(&result), sizeof(T))) {
+        throw std::runtime_error("unexpected end of model file.");
+      }
+
+      return result;
+    }
+
+    auto read_string() {
+      const auto size = read<std::uint64_t>();
+
+      auto result = std::string();
+
+      while (std::size(result) < size) { // 長さが壊れていても巨大な領域を確保しないように、少しずつ読みます。
+        const auto offset = std::size(result);
+
+        result.resize(offset + static_cast<std::size_t>(std::min<std::uint64_t>(size - offset, 64 * 1024)));
+
+        if (!_stream.read(std::data(result) + offset, std::size(result) - offset)) {
+          throw std::runtime_error("unexpected end of model file.");
+        }
+      }
+
+      return result;
+    }
+
+    std::shared_ptr<const expression> read_expression() {
+      switch (static_cast<expression_type>(read<std::uint8_t>())) {
+      case expression_type::add_operator: {
+        const auto size = read<std::uint64_t>();
+
+        if (size < 2) {
+          throw std::runtime_error("invalid coefficient in model file.");
+        }
+
+        const auto lhs = read_expression();
+        const auto rhs = read_expression();
+        const auto result = std::make_shared<add_operator>(lhs, rhs);
+
+        for (auto i = std::uint64_t{2}; i < size; ++i) {
+          result->add_child(read_expression());
+        }
+
+        return result;
+      }
+      case expression_type::mul_operator: {
+        const auto lhs = read_expression();
+        const auto rhs = read_expression();
+
+        return std::make_shared<const mul_operator>(lhs, rhs);
+      }
+      case expression_type::pow_operator: {
+        const auto base = read_expression();
+        const auto exponent = read<std::int32_t>();
+
+        return std::make_shared<const pow_operator>(base, exponent);
+      }
+      case expression_type::place_holder_variable: {
+        return std::make_shared<const placeholder_variable>(read_string());
+      }
+      case expression_type::numeric_literal: {
+        return std::make_shared<const numeric_literal>(read<double>());
+      }
+      default:
+        throw std::runtime_error("invalid coefficient in model file.");
+      }
+    }
+
+    // 壊れたファイルでモデルが範囲外を読まないように、変数のインデックスは0以上variable_count未満で、昇順かつ重複なしであることを確かめます。
+
+    auto read_polynomial(std::size_t variable_count) {
+      auto result = polynomial{};
+      const auto size = read<std::uint64_t>();
+
+      result.reserve(std::min(size, std::uint64_t{1} << 20)); // 項の数も壊れているかもしれないので、大きすぎる予約はしません。
+
+      for (auto i = std::uint64_t{0}; i < size; ++i) {
+        const auto index_count = read<std::uint32_t>();
+
+        if (index_count > variable_count) {
+          throw std::runtime_error("invalid term in model file.");
+        }
+
+        auto indexes = pyquboc::indexes(index_count);
+
+        for (auto j = std::size_t{0}; j < std::size(indexes); ++j) {
+          indexes[j] = read<std::int32_t>();
+
+          if (indexes[j] < 0 || static_cast<std::size_t>(indexes[j]) >= variable_count || (j > 0 && indexes[j] <= indexes[j - 1])) {
+            throw std::runtime_error("invalid term in model file.");
+          }
+        }
+
+        const auto coefficient = read_expression();
+
+        result.emplace(product(indexes), coefficient);
+      }
+
+      return result;
+    }
+  };
+
+  inline auto save_model(const model& model, std::ostream& stream) {
+    auto writer = binary_writer(stream);
+
+    stream.write(serialization_magic, sizeof(serialization_magic));
+    writer.write(serialization_format_version);
+
+    writer.write(static_cast<std::uint8_t>(model.domain()));
+    writer.write(static_cast<std::int32_t>(model.auxiliary_variable_count()));
+
+    const auto variable_names = model.variable_names();
+
+    writer.write(static_cast<std::uint64_t>(std::size(variable_names)));
+
+    for (const auto& variable_name : variable_names) {
+      writer.write(variable_name);
+    }
+
+    writer.write(model.terms());
+
+    writer.write(static_cast<std::uint64_t>(std::size(model.sub_hamiltonian_polynomials())));
+
+    for (const auto& [name, polynomial] : model.sub_hamiltonian_polynomials()) {
+      writer.write(name);
+      writer.write(*polynomial);
+    }
+
+    writer.write(static_cast<std::uint64_t>(std::size(model.constraint_polynomials())));
+
+    for (const auto& [name, constraint] : model.constraint_polynomials()) {
+      writer.write(name);
+      writer.write(static_cast<std::uint8_t>(constraint.squared()));
+      writer.write(constraint.polynomial());
+    }
+
+    writer.write(static_cast<std::uint64_t>(std::size(model.fixed_values())));
+
+    for (const auto& [index, value] : model.fixed_values()) {
+      writer.write(static_cast<std::int32_t>(index));
+      writer.write(static_cast<std::int32_t>(value));
+    }
+
+    stream.flush(); // バッファに残っている分の書き込みの失敗も、ここで検出します。
+
+    if (!stream) {
+      throw std::runtime_error("failed to write model file.");
+    }
+  }
+
+  // conditionは、ConstraintやLinearEqualityのラベルからconditionを返す関数です。
+
+  inline auto load_model(std::istream& stream, const std::function<std::function<bool(double)>(const std::string&)>& condition) {
+    auto reader = binary_reader(stream);
+
+    char magic[sizeof(serialization_magic)];
+
+    if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, serialization_magic, sizeof(magic)) != 0 || reader.read<std::uint32_t>() != serialization_format_version) {
+      throw std::runtime_error("invalid model file.");
+    }
+
+    const auto domain_value = reader.read<std::uint8_t>();
+
+    if (domain_value != static_cast<std::uint8_t>(domain::binary) && domain_value != static_cast<std::uint8_t>(domain::spin)) {
+      throw std::runtime_error("invalid domain in model file.");
+    }
+
+    const auto domain = static_cast<pyquboc::domain>(domain_value);
+    const auto auxiliary_variable_count = reader.read<std::int32_t>();
+
+    auto variables = pyquboc::variables();
+    const auto variable_count = reader.read<std::uint64_t>();
+
+    for (auto i = std::uint64_t{0}; i < variable_count; ++i) {
+      variables.index(reader.read_string());
+    }
+
+    if (std::size(variables) != variable_count || auxiliary_variable_count < 0 || static_cast<std::uint64_t>(auxiliary_variable_count) > variable_count) { // 名前が重複していると、インデックスがずれてしまいます。
+      throw std::runtime_error("invalid variables in model file.");
+    }
+
+    auto polynomial = reader.read_polynomial(variable_count);
+
+    auto sub_hamiltonians = robin_hood::unordered_map<std::string, std::shared_ptr<const pyquboc::polynomial>>{};
+    const auto sub_hamiltonian_count = reader.read<std::uint64_t>();
+
+    for (auto i = std::uint64_t{0}; i < sub_hamiltonian_count; ++i) {
+      auto name = reader.read_string();
+
+      sub_hamiltonians.emplace(std::move(name), std::make_shared<const pyquboc::polynomial>(reader.read_polynomial(variable_count)));
+    }
+
+    auto constraints = robin_hood::unordered_map<std::string, constraint_polynomial>{};
+    const auto constraint_count = reader.read<std::uint64_t>();
+
+    for (auto i = std::uint64_t{0}; i < constraint_count; ++i) {
+      auto name = reader.read_string();
+      const auto squared = reader.read<std::uint8_t>() != 0;
+
+      constraints.emplace(name, constraint_polynomial(std::make_shared<const pyquboc::polynomial>(reader.read_polynomial(variable_count)), condition(name), squared));
+    }
+
+    const auto fixed_value_count = reader.read<std::uint64_t>();
+
+    if (fixed_value_count > variable_count) {
+      throw std::runtime_error("invalid fixed values in model file.");
+    }
+
+    auto fixed_values = std::vector<std::pair<int, int>>(fixed_value_count);
+
+    for (auto& [index, value] : fixed_values) {
+      index = reader.read<std::int32_t>();
+      value = reader.read<std::int32_t>();
+
+      if (index < 0 || static_cast<std::uint64_t>(index) >= variable_count || (domain == domain::binary ? value != 0 && value != 1 : value != -1 && value != 1)) { // 値は、モデルの定義域での値です。
+        throw std::runtime_error("invalid fixed values in model file.");
+      }
+    }
+
+    return model(std::move(polynomial), std::move(sub_hamiltonians), std::move(constraints), std::move(variables), auxiliary_variable_count, domain, std::move(fixed_values));
+  }
+
+  // Serialize QUBO.
+
+  // Python（numpy）や他の言語のソルバーから読み込めるように、コンパイル済みのモデルの係数を、プレースホルダーに値を入れてCOO形式で保存します。
+  // 形式は以下の通り（リトル・エンディアンを想定しています）。1次の項は、rowとcolumnが同じ項として出力します。
+  //
+  //   char[8]   "PYQCOO\0\0"
+  //   uint32    coo_format_version
+  //   uint8     0ならBINARY、1ならSPIN
+  //   uint64    変数の数。その後に、変数の名前（uint64の長さと文字列）が変数の数だけ続きます。
+  //   uint64    項の数（nnz）
+  //   int32     rows[nnz]
+  //   int32     columns[nnz]
+  //   float64   values[nnz]
+  //   float64   offset
+
+  constexpr char coo_magic[8] = {'P', 'Y', 'Q', 'C', 'O', 'O', '\0', '\0'};
+  constexpr std::uint32_t coo_format_version = 1;
+
+  inline auto save_coo(const model& model, const std::unordered_map<std::string, double>& feed_dict, std::ostream& stream) {
+    const auto [indptr, indexes, coefficients, offset] = model.to_hubo_arrays(feed_dict);
+
+    auto rows = std::vector<std::int32_t>(std::size(coefficients));
+    auto columns = std::vector<std::int32_t>(std::size(coefficients));
+
+    for (auto i = std::size_t{0}; i < std::size(coefficients); ++i) {
+      if (indptr[i + 1] - indptr[i] > 2) {
+        throw std::runtime_error("model is not quadratic. compile it with quadratize=True.");
+      }
+
+      rows[i] = indexes[indptr[i]];
+      columns[i] = indexes[indptr[i + 1] - 1];
+    }
+
+    auto writer = binary_writer(stream);
+
+    stream.write(coo_magic, sizeof(coo_magic));
+    writer.write(coo_format_version);
+
+    writer.write(static_cast<std::uint8_t>(model.domain()));
+
+    const auto variable_names = model.variable_names();
+
+    writer.write(static_cast<std::uint64_t>(std::size(variable_names)));
+
+    for (const auto& variable_name : variable_names) {
+      writer.write(variable_name);
+    }
+
+    writer.write(static_cast<std::uint64_t>(std::size(coefficients)));
+
+    stream.write(reinterpret_cast<const char*>(std::data(rows)), std::size(rows) * sizeof(std::int32_t)); // 配列は、まとめて書き込みます。
+    stream.write(reinterpret_cast<const char*>(std::data(columns)), std::size(columns) * sizeof(std::int32_t));
+    stream.write(reinterpret_cast<const char*>(std::data(coefficients)), std::size(coefficients) * sizeof(double));
+
+    writer.write(offset);
+
+    stream.flush(); // バッファに残っている分の書き込みの失敗も、ここで検出します。
+
+    if (!stream) {
+      throw std::runtime_error("failed to write QUBO file.");
+    }
+  }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <robin_hood.h>
+
+namespace pyquboc {
+  // 変数の名前に、密な整数のIDを割り当てます。
+  // 名前は大きなメモリ・ブロック（アリーナ）にまとめて一度だけ保存して、IDからも名前からも引けるようにします。
+  // ノードを作るときにIDを割り当てておけば、コンパイルやデコードのときに文字列のハッシュを計算しなくて済みます。
+
+  class symbol_table final {
+    static constexpr std::size_t block_size = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> _blocks; // ブロックは解放も移動もしないので、名前のstd::string_viewはずっと有効です。
+    std::vector<std::unique_ptr<char[]>> _large_blocks;
+    std::size_t _block_used;
+    std::vector<std::string_view> _names;
+    robin_hood::unordered_map<std::string_view, int> _ids;
+    mutable std::shared_mutex _mutex;
+
+    symbol_table() noexcept : _blocks{}, _large_blocks{}, _block_used(block_size), _names{}, _ids{}, _mutex{} {
+      ;
+    }
+
+    auto store(std::string_view name) noexcept {
+      if (std::empty(name)) { // 最初の名前が空だと、ブロックがまだありません。
+        return std::string_view();
+      }
+
+      if (std::size(name) > block_size) { // 巨大な名前は、専用のブロックに入れます。
+        const auto& block = _large_blocks.emplace_back(std::make_unique<char[]>(std::size(name)));
+
+        std::memcpy(block.get(), std::data(name), std::size(name));
+
+        return std::string_view(block.get(), std::size(name));
+      }
+
+      if (_block_used + std::size(name) > block_size) {
+        _blocks.emplace_back(std::make_unique<char[]>(block_size));
+        _block_used = 0;
+      }
+
+      const auto result = _blocks.back().get() + _block_used;
+
+      std::memcpy(result, std::data(name), std::size(name));
+      _block_used += std::size(name);
+
+      return std::string_view(result, std::size(name));
+    }
+
+  public:
+    symbol_table(const symbol_table&) = delete;
+    symbol_table& operator=(const symbol_table&) = delete;
+
+    static auto& instance() noexcept {
+      static auto result = symbol_table();
+
+      return result;
+    }
+
+    auto id(std::string_view name) noexcept {
+      {
+        const auto lock = std::shared_lock(_mutex);
+        const auto it = _ids.find(name);
+
+        if (it != std::end(_ids)) {
+          return it->second;
+        }
+      }
+
+      const auto lock = std::unique_lock(_mutex);
+      const auto it = _ids.find(name); // ロックを取り直す間に、他のスレッドが登録したかもしれません。
+
+      if (it != std::end(_ids)) {
+        return it->second;
+      }
+
+      const auto result = static_cast<int>(std::size(_names));
+      const auto stored_name = store(name);
+
+      _names.emplace_back(stored_name);
+      _ids.emplace(stored_name, result);
+
+      return result;
+    }
+
+    std::optional<int> find(std::string_view name) const noexcept {
+      const auto lock = std::shared_lock(_mutex);
+      const auto it = _ids.find(name);
+
+      if (it == std::end(_ids)) {
+        return std::nullopt;
+      }
+
+      return it->second;
+    }
+
+    auto name(int id) const noexcept {
+      const auto lock = std::shared_lock(_mutex);
+
+      return _names[id];
+    }
+
+    auto size() const noexcept {
+      const auto lock = std::shared_lock(_mutex);
+
+      return std::size(_names);
+    }
+  };
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace pyquboc {
+  // Thread pool.
+
+  inline auto default_thread_count(int thread_count = 0) noexcept {
+    return thread_count > 0 ? thread_count : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+  }
+
+  // 非同期のコンパイル用の、固定数のスレッドのプールです。タスクの結果や例外は、std::futureで受け取ります。
+  // stop()すると、キューに残っているタスクは実行せずに捨てて（futureはstd::future_errorのbroken_promiseになります）、実行中のタスクが終わるのを待ちます。
+  // 実行中のタスクを早く終わらせたい場合は、タスクの中でstopped()を調べてください。
+
+  class thread_pool final {
+    std::vector<std::thread> _threads;
+    std::queue<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::atomic<bool> _stopped;
+
+    auto run() noexcept {
+      for (;;) {
+        auto task = [&]() -> std::function<void()> {
+          auto lock = std::unique_lock(_mutex);
+
+          _condition.wait(lock, [&] {
+            return _stopped || !std::empty(_tasks);
+          });
+
+          if (_stopped) {
+            return nullptr;
+          }
+
+          auto result = std::move(_tasks.front());
+          _tasks.pop();
+
+          return result;
+        }();
+
+        if (!task) {
+          return;
+        }
+
+        task();
+      }
+    }
+
+  public:
+    thread_pool(int thread_count) : _threads{}, _tasks{}, _mutex{}, _condition{}, _stopped(false) {
+      try {
+        for (auto i = 0; i < thread_count; ++i) {
+          _threads.emplace_back([&] { run(); });
+        }
+      } catch (...) { // スレッドを作れなかった場合は、作ったスレッドを止めてから投げ直します（デストラクタは呼ばれないので）。
+        stop();
+        throw;
+      }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool() {
+      stop();
+    }
+
+    static auto& instance() {
+      static auto result = thread_pool(default_thread_count());
+
+      return result;
+    }
+
+    auto stopped() const noexcept {
+      return _stopped.load();
+    }
+
+    // 何度呼び出しても構いません。捨てたタスクは、このスレッドで破棄します。
+
+    void stop() noexcept {
+      auto tasks = std::queue<std::function<void()>>{};
+
+      {
+        const auto lock = std::unique_lock(_mutex);
+
+        _stopped = true;
+        std::swap(tasks, _tasks);
+      }
+
+      _condition.notify_all();
+
+      tasks = {};
+
+      for (auto& thread : _threads) {
+        if (thread.joinable()) {
+          thread.join();
+        }
+      }
+    }
+
+    template <typename Function>
+    auto submit(Function&& function) {
+      // std::functionはコピーできる関数しか入れられないので、std::packaged_taskはstd::shared_ptrで包みます。
+      const auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::forward<Function>(function));
+
+      {
+        const auto lock = std::unique_lock(_mutex);
+
+        if (_stopped) {
+          throw std::runtime_error("thread pool is stopped.");
+        }
+
+        _tasks.emplace([task] { (*task)(); });
+      }
+
+      _condition.notify_one();
+
+      return task->get_future();
+    }
+  };
+
+  // Parallel for.
+
+  // function(0)からfunction(size - 1)までを、thread_count個のスレッドで分担して実行します。例外が発生した場合は、全部のスレッドが終わってから最初の例外を投げ直します。
+
+  template <typename Function>
+  inline auto parallel_for(int size, int thread_count, Function&& function) {
+    auto next = std::atomic<int>(0);
+    auto exception = std::exception_ptr{};
+    auto exception_mutex = std::mutex{};
+
+    const auto run = [&] {
+      for (auto i = next++; i < size; i = next++) {
+        try {
+          function(i);
+        } catch (...) {
+          const auto lock = std::unique_lock(exception_mutex);
+
+          if (!exception) {
+            exception = std::current_exception();
+          }
+
+          next = size; // 残りは実行しません。
+        }
+      }
+    };
+
+    auto threads = std::vector<std::thread>{};
+
+    try {
+      for (auto i = 1; i < std::min(default_thread_count(thread_count), size); ++i) {
+        threads.emplace_back(run);
+      }
+    } catch (...) { // スレッドを作れなかった場合は、joinできるスレッドを残したまま破棄するとstd::terminateになるので、作ったスレッドを止めて待ってから投げ直します。
+      next = size;
+
+      for (auto& thread : threads) {
+        thread.join();
+      }
+
+      throw;
+    }
+
+    run(); // 呼び出したスレッドも、働きます。
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+}
@@ -14,7 +14,7 @@
 
 import unittest
 
-from pyquboc import Binary, AndConst, OrConst, XorConst, NotConst
+from pyquboc import Array, Binary, Constraint, AndConst, OrConst, XorConst, NotConst, OneHot, KHot, LinearEquality, assert_qubo_equal
 
 
 class TestConstraint(unittest.TestCase):
@@ -97,6 +97,30 @@ class TestConstraint(unittest.TestCase):
         self.assertFalse(xor1 == or1)
         self.assertFalse(xor1 == xor3)
 
+    def test_linear_equality(self):
+        x = Array.create("x", shape=4, vartype="BINARY")
+
+        for exp, expected_exp in ((OneHot(x, "c"), Constraint((sum(x) - 1) ** 2, "c")),
+                                  (KHot(x, 2, "c"), Constraint((sum(x) - 2) ** 2, "c")),
+                                  (LinearEquality([1, 2, 3, -1], list(x), 3, "c"), Constraint((x[0] + 2 * x[1] + 3 * x[2] - x[3] - 3) ** 2, "c"))):
+            model = exp.compile()
+            expected_model = expected_exp.compile()
+            qubo, offset = model.to_qubo()
+            expected_qubo, expected_offset = expected_model.to_qubo()
+            assert_qubo_equal(qubo, expected_qubo)
+            self.assertEqual(offset, expected_offset)
+
+            for sample in ({"x[0]": 1, "x[1]": 0, "x[2]": 0, "x[3]": 0}, {"x[0]": 1, "x[1]": 1, "x[2]": 0, "x[3]": 0}, {"x[0]": 0, "x[1]": 0, "x[2]": 1, "x[3]": 0}):
+                decoded_sample = model.decode_sample(sample, vartype="BINARY")
+                expected_decoded_sample = expected_model.decode_sample(sample, vartype="BINARY")
+                self.assertEqual(decoded_sample.constraints(only_broken=False), expected_decoded_sample.constraints(only_broken=False))
+
+        model = LinearEquality([0.1, 0.2, 0.4], list(x[:3]), 0.3, "c").compile()
+        self.assertEqual(len(model.decode_sample({"x[0]": 1, "x[1]": 1, "x[2]": 0}, vartype="BINARY").constraints(only_broken=True)), 0)
+        self.assertEqual(len(model.decode_sample({"x[0]": 1, "x[1]": 0, "x[2]": 1}, vartype="BINARY").constraints(only_broken=True)), 1)
+        model = LinearEquality([0.1, 0.2, 0.4], list(x[:3]), 0.3, "c", tolerance=0.25).compile()
+        self.assertEqual(len(model.decode_sample({"x[0]": 1, "x[1]": 0, "x[2]": 1}, vartype="BINARY").constraints(only_broken=True)), 0)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -1,6 +1,9 @@
+import subprocess
+import sys
 import unittest
+import numpy as np
 
-from pyquboc import Binary, Spin, WithPenalty, SubH, Constraint, assert_qubo_equal, Placeholder
+from pyquboc import Binary, Spin, WithPenalty, SubH, Constraint, QuadraticForm, Polynomial, assert_qubo_equal, Placeholder
 
 
 class TestExpress(unittest.TestCase):
@@ -38,6 +41,11 @@ class TestExpress(unittest.TestCase):
         self.assertEqual(subh1, subh2)
         self.assertNotEqual(subh1, subh3)
 
+    def test_empty_label(self):
+        # 新しいプロセスで、空の名前を最初に登録します。
+        code = "from pyquboc import Binary; model = (Binary('') + 2 * Binary('a') * Binary('')).compile(); assert sorted(model.variables) == ['', 'a']"
+        subprocess.run([sys.executable, "-c", code], check=True, timeout=60)
+
     def compile_check(self, exp, expected_qubo, expected_offset, feed_dict={}):
         model = exp.compile(strength=5)
         qubo, offset = model.to_qubo(feed_dict=feed_dict)
@@ -83,6 +91,22 @@ class TestExpress(unittest.TestCase):
         q, offset = exp.compile().to_qubo()
         self.compile_check(exp, expected_qubo, expected_offset)
 
+    def test_compile_power_squaring(self):
+        a, b, c = Binary("a"), Binary("b"), Binary("c")
+        p = Placeholder("p")
+        base = a + 2 * b - p * c - 1
+        for exponent in range(1, 6):
+            exp = base ** exponent
+            expected_exp = base
+            for _ in range(exponent - 1):
+                expected_exp = expected_exp * base
+            qubo, offset = exp.compile().to_qubo(feed_dict={"p": 2})
+            expected_qubo, expected_offset = expected_exp.compile().to_qubo(feed_dict={"p": 2})
+            assert_qubo_equal(qubo, expected_qubo)
+            self.assertEqual(offset, expected_offset)
+
+        self.assertEqual(((1 - a) ** 10).compile().to_qubo(), (1 - a).compile().to_qubo())
+
     def test_compile_neg(self):
         exp = -Binary("a")
         expected_qubo = {('a', 'a'): -1.0}
@@ -130,6 +154,42 @@ class TestExpress(unittest.TestCase):
         self.compile_check(custom_penalty, expected_qubo,
                            expected_offset, feed_dict)
 
+    def test_compile_quadratic_form(self):
+        a, b, c = Binary("a"), Binary("b"), Binary("c")
+        Q = np.array([[1.0, 2.0, 0.0], [0.0, 0.0, 3.0], [0.0, 0.0, 0.0]])
+        exp = QuadraticForm(Q, [a, b, c], linear=[0.0, 1.0, -1.0], offset=2.0) + a * c
+        expected_qubo = {('a', 'a'): 1.0, ('a', 'b'): 2.0, ('b', 'c'): 3.0, ('b', 'b'): 1.0, ('c', 'c'): -1.0, ('a', 'c'): 1.0}
+        expected_offset = 2.0
+        self.compile_check(exp, expected_qubo, expected_offset)
+
+        class COO:
+            row = np.array([0, 0, 1])
+            col = np.array([0, 1, 2])
+            data = np.array([1.0, 2.0, 3.0])
+
+        exp = QuadraticForm(COO(), [a, b, c], linear=[0.0, 1.0, -1.0], offset=2.0) + a * c
+        self.compile_check(exp, expected_qubo, expected_offset)
+
+    def test_compile_polynomial_from_coo(self):
+        a, b, c = Binary("a"), Binary("b"), Binary("c")
+        # 項は(a * b, b * c, b, c)で、次数が小さい項は-1で埋めます。
+        exp = Polynomial.from_coo([a, b, c], [np.array([0, 1, 1, 2]), np.array([1, 2, -1, -1])], np.array([2.0, 3.0, 1.0, -1.0]), offset=2.0) + a * c + a
+        expected_qubo = {('a', 'a'): 1.0, ('a', 'b'): 2.0, ('b', 'c'): 3.0, ('b', 'b'): 1.0, ('c', 'c'): -1.0, ('a', 'c'): 1.0}
+        expected_offset = 2.0
+        self.compile_check(exp, expected_qubo, expected_offset)
+
+        # 3次の項も、そのまま展開します。
+        exp = Polynomial.from_coo([a, b, c], [[0], [1], [2]], [1.0])
+        self.assertEqual(exp.compile(quadratize=False).to_hubo()[0], {('a', 'b', 'c'): 1.0})
+
+        p = Placeholder("p")
+        exp = p * Polynomial.from_coo([a, b], [[0], [1]], [2.0])
+        qubo, _ = exp.compile().to_qubo(feed_dict={"p": 3.0})
+        assert_qubo_equal(qubo, {('a', 'b'): 6.0})
+
+        with self.assertRaises(RuntimeError):
+            Polynomial.from_coo([a, b], [[0], [2]], [1.0])
+
 
 if __name__ == '__main__':
     unittest.main()
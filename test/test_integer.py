@@ -12,10 +12,11 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import itertools
 import unittest
 import dimod
 
-from pyquboc import OneHotEncInteger, OrderEncInteger, Placeholder, LogEncInteger, UnaryEncInteger, assert_qubo_equal
+from pyquboc import OneHotEncInteger, OrderEncInteger, Placeholder, LogEncInteger, UnaryEncInteger, EncodedInteger, Binary, assert_qubo_equal
 
 
 class TestInteger(unittest.TestCase):
@@ -158,5 +159,20 @@ class TestInteger(unittest.TestCase):
         # assert_qubo_equal(q, expected_q)  # 上がうまく行ったなら、たぶん問題ないんじゃないかなぁと。
 
 
+    def test_encoded_integer(self):
+        # Pythonで組み立てていた式と、同じ値になります。
+        for lower, upper in [(0, 4), (-2, 5), (3, 11)]:
+            span = upper - lower
+            log_weights = [2 ** i for i in range(span.bit_length() - 1)] + [span - (2 ** (span.bit_length() - 1) - 1)]
+            for encoding, weights in [("log", log_weights), ("one_hot", list(range(span + 1))), ("order", [1] * span), ("unary", [1] * span)]:
+                x = [Binary("x[{}]".format(i)) for i in range(len(weights))]
+                model = EncodedInteger(encoding, x, (lower, upper)).compile()
+                for values in itertools.product((0, 1), repeat=len(x)):
+                    sample = {"x[{}]".format(i): value for i, value in enumerate(values)}
+                    self.assertEqual(model.energy(sample, vartype="BINARY"), lower + sum(w * v for w, v in zip(weights, values)))
+        with self.assertRaises(RuntimeError):
+            EncodedInteger("log", [Binary("x")], (0, 4))
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -12,9 +12,10 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import itertools
 import unittest
 
-from pyquboc import Binary, AndConst, OrConst, XorConst, NotConst
+from pyquboc import Binary, Spin, AndConst, OrConst, XorConst, NotConst, Not, And, Or, Xor, LogicGate
 
 
 class TestLogicalConstraint(unittest.TestCase):
@@ -97,6 +98,28 @@ class TestLogicalConstraint(unittest.TestCase):
         self.assertFalse(xor1 == or1)
         self.assertFalse(xor1 == xor3)
 
+    def test_logic_gate(self):
+        # ネイティブのゲートは、Pythonで組み立てていた式と同じエネルギーになります。Binary以外のオペランドでも同じです。
+        a, b, c, aux = Binary("a"), Spin("b"), 2 * Binary("c") - 1, Binary("aux_xor")
+        gates = [
+            (Not(a), 1 - a),
+            (And(a, b), a * b),
+            (Or(a, b), 1 - (1 - a) * (1 - b)),
+            (Xor(a, b), (1 - a * b) * (1 - (1 - a) * (1 - b))),
+            (NotConst(a, b, "not"), 2 * a * b - a - b + 1),
+            (AndConst(a, b, c, "and"), a * b - 2 * (a + b) * c + 3 * c),
+            (OrConst(a, b, c, "or"), a * b + (a + b) * (1 - 2 * c) + c),
+            (XorConst(a, b, c, "xor"), 2 * a * b - 2 * (a + b) * c - 4 * (a + b) * aux + 4 * aux * c + a + b + c + 4 * aux)]
+        for gate, expected in gates:
+            model, expected_model = (gate + a * c).compile(), (expected + a * c).compile()
+            self.assertEqual(set(model.variables), set(expected_model.variables))
+            for values in itertools.product((0, 1), repeat=len(model.variables)):
+                sample = dict(zip(model.variables, values))
+                self.assertAlmostEqual(model.energy(sample, vartype="BINARY"), expected_model.energy(sample, vartype="BINARY"))
+        self.assertEqual(str(LogicGate("and", [a, b])), "And(Binary('a'), Spin('b'))")
+        with self.assertRaises(RuntimeError):
+            LogicGate("and", [a])
+
 
 if __name__ == '__main__':
     unittest.main()
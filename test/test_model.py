@@ -12,11 +12,17 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import math
+import os
+import subprocess
+import sys
+import tempfile
 import unittest
 import numpy as np
 import dimod
+from concurrent.futures import ThreadPoolExecutor
 
-from pyquboc import Binary, Placeholder, Array, SubH, Constraint, assert_qubo_equal
+from pyquboc import Binary, Spin, Placeholder, Array, SubH, Constraint, WithPenalty, Num, CompileLimitError, CompileTimeoutError, CompileCancelledError, ModelParseError, compile_many, parse_model, assert_qubo_equal
 
 
 class TestModel(unittest.TestCase):
@@ -294,6 +300,474 @@ class TestModel(unittest.TestCase):
         e = model.energy(sample, vartype='BINARY')
         self.assertEqual(e, 10.0)
 
+    def test_quadratization(self):
+        x = Array.create('x', 4, 'BINARY')
+        exp = -2 * x[0] * x[1] * x[2] + x[1] * x[2] * x[3] + 3 * x[0] * x[1] * x[3] - x[0]
+        energies = {}
+
+        for quadratization in ('greedy', 'negative_term', 'pair_cover'):
+            model = exp.compile(strength=10, quadratization=quadratization)
+            self.assertEqual(model.num_auxiliary_variables, len(model.variables) - 4)
+            sampleset = dimod.ExactSolver().sample(model.to_bqm())
+            energies[quadratization] = min(model.decode_sampleset(sampleset), key=lambda s: s.energy).energy
+
+        self.assertEqual(energies['greedy'], -3.0)
+        self.assertEqual(energies['negative_term'], -3.0)
+        self.assertEqual(energies['pair_cover'], -3.0)
+
+        self.assertRaises(RuntimeError, lambda: exp.compile(quadratization='invalid'))
+
+    def test_shared_sub_hamiltonian(self):
+        a, b = Binary("a"), Binary("b")
+        h = SubH(a + b - 1, label="h")
+        c = Constraint(a * b, label="c")
+        exp = 2 * h * Placeholder("A") + h + 3 * (c + c)
+        model = exp.compile()
+        expected_model = (2 * (a + b - 1) * Placeholder("A") + (a + b - 1) + 6 * a * b).compile()
+        assert_qubo_equal(model.to_qubo(feed_dict={"A": 2.0})[0], expected_model.to_qubo(feed_dict={"A": 2.0})[0])
+
+        decoded_sample = model.decode_sample({"a": 1, "b": 1}, vartype="BINARY", feed_dict={"A": 2.0})
+        self.assertEqual(decoded_sample.subh, {"h": 1.0, "c": 1.0})
+        self.assertEqual(decoded_sample.constraints(only_broken=True), {"c": (False, 1.0)})
+        self.assertEqual(decoded_sample.energy, 2 * 1 * 2.0 + 1 + 6)
+
+    def test_to_hubo(self):
+        a, b, c = Binary("a"), Binary("b"), Binary("c")
+        exp = SubH(a * b * c, label="h") + 2 * a - 1
+        model = exp.compile(quadratize=False)
+        self.assertEqual(model.degree, 3)
+        self.assertEqual(model.num_auxiliary_variables, 0)
+        self.assertEqual(model.variables, ["a", "b", "c"])
+
+        hubo, offset = model.to_hubo()
+        self.assertEqual(hubo, {("a", "b", "c"): 1.0, ("a",): 2.0})
+        self.assertEqual(offset, -1.0)
+
+        hubo, offset = model.to_hubo(index_label=True)
+        self.assertEqual(hubo, {(0, 1, 2): 1.0, (0,): 2.0})
+
+        indptr, indices, coefficients, offset = model.to_hubo_arrays()
+        self.assertEqual({tuple(indices[indptr[i]:indptr[i + 1]]): coefficients[i] for i in range(len(coefficients))}, {(0, 1, 2): 1.0, (0,): 2.0})
+        self.assertEqual(offset, -1.0)
+
+        self.assertEqual(model.energy({"a": 1, "b": 1, "c": 1}, vartype="BINARY"), 2.0)
+        self.assertEqual(model.energy({"a": -1, "b": 1, "c": 1}, vartype="SPIN"), -1.0)
+        decoded_sample = model.decode_sample({"a": 1, "b": 1, "c": 1}, vartype="BINARY")
+        self.assertEqual(decoded_sample.energy, 2.0)
+        self.assertEqual(decoded_sample.subh, {"h": 1.0})
+
+        self.assertRaises(RuntimeError, lambda: model.to_qubo())
+
+    def test_missing_placeholder(self):
+        x = Array.create('x', 2, 'BINARY')
+        model = (Placeholder("a") * x[0] * x[1] + x[0]).compile()
+        sample = {"x[0]": 1, "x[1]": 0}
+
+        for export in (lambda: model.to_qubo(), lambda: model.to_hubo_arrays(), lambda: model.to_coo_batch([{}]),
+                       lambda: model.presolve(), lambda: model.evaluator(sample), lambda: model.energy(sample, vartype="BINARY")):
+            with self.assertRaisesRegex(RuntimeError, "placeholder 'a'"):
+                export()
+
+        self.assertEqual(model.energy(sample, vartype="BINARY", feed_dict={"a": 2.0}), 1.0)
+
+    def test_spin_domain(self):
+        s = Array.create('s', 3, 'SPIN')
+        exp = s[0] * s[1] - 2 * s[1] * s[2] + 0.5 * s[0] + (s[0] + s[1]) ** 2
+        model = exp.compile(domain="SPIN")
+        expected_model = exp.compile()
+        self.assertEqual(model.vartype, "SPIN")
+
+        linear, quadratic, offset = model.to_ising()
+        self.assertEqual(linear, {"s[0]": 0.5})
+        assert_qubo_equal(quadratic, {("s[0]", "s[1]"): 3.0, ("s[1]", "s[2]"): -2.0})
+        self.assertEqual(offset, 2.0)
+
+        qubo, offset = model.to_qubo()
+        expected_qubo, expected_offset = expected_model.to_qubo()
+        assert_qubo_equal(qubo, expected_qubo)
+        self.assertEqual(offset, expected_offset)
+
+        sample = {"s[0]": 1, "s[1]": -1, "s[2]": -1}
+        self.assertEqual(model.energy(sample, vartype="SPIN"), expected_model.energy(sample, vartype="SPIN"))
+
+        # 2次に変換する必要がある場合は、BINARYで展開しなおします。
+        model = (s[0] * s[1] * s[2]).compile(domain="SPIN")
+        self.assertEqual(model.vartype, "BINARY")
+        self.assertRaises(RuntimeError, lambda: exp.compile(domain="INVALID"))
+
+    def test_to_coo_batch(self):
+        x = Array.create('x', 5, 'BINARY')
+        exp = x[0] * x[1] * x[2] + Placeholder("A") * Constraint((sum(x) - 1) ** 2, label="c") + Placeholder("B") ** 2 * x[3]
+        model = exp.compile()
+        feed_dicts = [{"A": a, "B": b} for a, b in ((1.0, 0.0), (2.0, 1.0), (5.0, -3.0))]
+        row, col, values, offsets = model.to_coo_batch(feed_dicts)
+        self.assertEqual(values.shape, (3, len(row)))
+
+        for i, feed_dict in enumerate(feed_dicts):
+            qubo, offset = model.to_qubo(index_label=True, feed_dict=feed_dict)
+            assert_qubo_equal({(int(r), int(c)): v for r, c, v in zip(row, col, values[i]) if v != 0}, {k: v for k, v in qubo.items() if v != 0})
+            self.assertAlmostEqual(offsets[i], offset)
+
+    def test_concurrent(self):
+        x = Array.create('x', 10, 'BINARY')
+        exp = SubH(x[0] * x[1] * x[2], label="h") + Placeholder("A") * Constraint((sum(x) - 1) ** 2, label="c")
+        model = exp.compile()
+        expected_qubos = {a: model.to_qubo(index_label=True, feed_dict={"A": float(a)}) for a in range(8)}
+        expected_decoded_samples = {i: model.decode_sample({v: int(v == "x[{}]".format(i)) for v in model.variables}, vartype="BINARY", feed_dict={"A": 2.0}) for i in range(10)}
+
+        def work(i):
+            a, j = i % 8, i % 10
+            qubo, offset = model.to_qubo(index_label=True, feed_dict={"A": float(a)})
+            expected_qubo, expected_offset = expected_qubos[a]
+            assert_qubo_equal(qubo, expected_qubo)
+            self.assertEqual(offset, expected_offset)
+
+            decoded_sample = model.decode_sample({v: int(v == "x[{}]".format(j)) for v in model.variables}, vartype="BINARY", feed_dict={"A": 2.0})
+            self.assertEqual(decoded_sample.energy, expected_decoded_samples[j].energy)
+            self.assertEqual(decoded_sample.constraints(only_broken=False), expected_decoded_samples[j].constraints(only_broken=False))
+
+        with ThreadPoolExecutor(max_workers=8) as executor:
+            list(executor.map(work, range(400)))
+
+    def test_compact(self):
+        x = Array.create('x', 4, 'BINARY')
+        exp = SubH(x[0] * x[1] * x[2] + x[3], label="h") + Constraint((x[0] + x[3] - 1) ** 2, label="c")
+        model = exp.compile()
+        compact_model = exp.compile(compact=True)
+        qubo, offset = model.to_qubo()
+        compact_qubo, compact_offset = compact_model.to_qubo()
+        assert_qubo_equal(qubo, compact_qubo)
+        self.assertEqual(offset, compact_offset)
+        self.assertEqual(model.variables, compact_model.variables)
+
+        sample = {v: 1 for v in model.variables}
+        self.assertEqual(model.decode_sample(sample, vartype="BINARY").subh, compact_model.decode_sample(sample, vartype="BINARY").subh)
+
+    def test_compile_cache(self):
+        x = Array.create('x', 4, 'BINARY')
+        a = Placeholder("a")
+        exp = SubH(x[0] * x[1] * x[2] + a * x[3], label="h") + Constraint(x[0] + x[3], label="c", condition=lambda v: v <= 1)
+        with tempfile.TemporaryDirectory() as cache_dir:
+            model = exp.compile(cache_dir=cache_dir)
+            self.assertEqual(len(os.listdir(cache_dir)), 1)
+            cached_model = exp.compile(cache_dir=cache_dir)
+            self.assertEqual(len(os.listdir(cache_dir)), 1)
+
+            qubo, offset = model.to_qubo(feed_dict={"a": 2.0})
+            cached_qubo, cached_offset = cached_model.to_qubo(feed_dict={"a": 2.0})
+            assert_qubo_equal(qubo, cached_qubo)
+            self.assertEqual(offset, cached_offset)
+            self.assertEqual(model.variables, cached_model.variables)
+
+            sample = {v: 1 for v in model.variables}
+            decoded = cached_model.decode_sample(sample, vartype="BINARY", feed_dict={"a": 2.0})
+            self.assertEqual(decoded.constraints(only_broken=True), {"c": (False, 2.0)})
+
+            # conditionはキャッシュのキーに含まれないので、別のconditionでも同じファイルを使います。
+            other_model = (SubH(x[0] * x[1] * x[2] + a * x[3], label="h") + Constraint(x[0] + x[3], label="c", condition=lambda v: v <= 2)).compile(cache_dir=cache_dir)
+            self.assertEqual(len(os.listdir(cache_dir)), 1)
+            self.assertEqual(other_model.decode_sample(sample, vartype="BINARY", feed_dict={"a": 2.0}).constraints(only_broken=True), {})
+
+            # 壊れたファイル（ここでは定義域のバイト）は、読み込まずにコンパイルしなおします。
+            path = os.path.join(cache_dir, os.listdir(cache_dir)[0])
+            with open(path, "r+b") as f:
+                f.seek(12)
+                f.write(b"\x07")
+            recompiled_model = exp.compile(cache_dir=cache_dir)
+            assert_qubo_equal(qubo, recompiled_model.to_qubo(feed_dict={"a": 2.0})[0])
+
+    def test_presolve(self):
+        x = Array.create('x', 5, 'BINARY')
+        a = Placeholder("a")
+        exp = SubH(2 * x[0] + x[0] * x[1] - 3 * x[2] * x[3] + x[1] * x[4] - x[4], label="h") + a * Constraint((x[1] + x[2] - 1) ** 2, label="c")
+        model = exp.compile()
+        reduced_model, fixed = model.presolve(feed_dict={"a": 2.0})
+        self.assertEqual(fixed["x[0]"], 0)
+        self.assertEqual(reduced_model.fixed_variables, fixed)
+
+        best = dimod.ExactSolver().sample(model.to_bqm(feed_dict={"a": 2.0})).first
+        reduced_bqm = reduced_model.to_bqm(feed_dict={"a": 2.0})
+        self.assertTrue(set(fixed).isdisjoint(reduced_bqm.variables))
+        reduced_best = dimod.ExactSolver().sample(reduced_bqm).first
+        self.assertAlmostEqual(best.energy, reduced_best.energy)
+
+        decoded_sample = reduced_model.decode_sample(dict(reduced_best.sample), vartype="BINARY", feed_dict={"a": 2.0})
+        self.assertEqual(set(decoded_sample.sample), set(model.variables))
+        self.assertAlmostEqual(decoded_sample.energy, best.energy)
+        self.assertAlmostEqual(model.energy(decoded_sample.sample, vartype="BINARY", feed_dict={"a": 2.0}), best.energy)
+        self.assertEqual(decoded_sample.constraints(only_broken=True), {})
+
+        reduced_bqm = reduced_model.to_bqm(index_label=True, feed_dict={"a": 2.0})
+        decoded_samples = reduced_model.decode_sampleset(dimod.ExactSolver().sample(reduced_bqm), feed_dict={"a": 2.0})
+        self.assertEqual(set(decoded_samples[0].sample), set(model.variables))
+        self.assertAlmostEqual(decoded_samples[0].energy, best.energy)
+
+    def test_components(self):
+        x = Array.create('x', 6, 'BINARY')
+        exp = (x[0] * x[1] * x[2] - 2 * x[1]) + Constraint((x[3] + x[4] - 1) ** 2, label="c") + x[5] + 3
+        model = exp.compile()
+        components = model.components()
+        self.assertEqual(len(components), 3)
+
+        qubo, offset = model.to_qubo()
+        merged_qubo, merged_offset = {}, 0.0
+        for component in components:
+            component_qubo, component_offset = component.to_qubo()
+            merged_qubo.update(component_qubo)
+            merged_offset += component_offset
+        assert_qubo_equal(qubo, merged_qubo)
+        self.assertEqual(offset, merged_offset)
+
+        best = dimod.ExactSolver().sample(model.to_bqm()).first
+        samplesets = [dimod.ExactSolver().sample(component.to_bqm()) for component in components]
+        decoded_samples = model.decode_samplesets(samplesets)
+        self.assertAlmostEqual(decoded_samples[0].energy, best.energy)
+        self.assertEqual(set(decoded_samples[0].sample), set(model.variables))
+        self.assertEqual(decoded_samples[0].constraints(only_broken=True), {})
+
+        samplesets = [dimod.ExactSolver().sample(component.to_bqm(index_label=True)) for component in components]
+        self.assertAlmostEqual(model.decode_samplesets(samplesets)[0].energy, best.energy)
+
+    def test_reorder(self):
+        x = Array.create('x', 6, 'BINARY')
+        exp = x[0] * x[5] + x[5] * x[2] + x[2] * x[4] + x[4] * x[1] + x[1] * x[3] + Constraint(x[0] + x[3], label="c", condition=lambda v: v <= 1)
+        model = exp.compile()
+        for method in ("rcm", "bfs"):
+            reordered_model, permutation = model.reorder(method)
+            self.assertEqual([model.variables[i] for i in permutation], reordered_model.variables)
+
+            qubo, offset = model.to_qubo()
+            reordered_qubo, reordered_offset = reordered_model.to_qubo()
+            assert_qubo_equal(qubo, reordered_qubo)
+            self.assertEqual(offset, reordered_offset)
+
+            # 鎖状のグラフなので、並べ替えると隣り合う変数のインデックスの差は1になります。
+            reordered_qubo, _ = reordered_model.to_qubo(index_label=True)
+            self.assertEqual(max(abs(i - j) for i, j in reordered_qubo), 1)
+
+            sampleset = dimod.ExactSolver().sample(reordered_model.to_bqm(index_label=True))
+            decoded_sample = reordered_model.decode_sampleset(sampleset)[0]
+            best = dimod.ExactSolver().sample(model.to_bqm()).first
+            self.assertAlmostEqual(decoded_sample.energy, best.energy)
+            self.assertEqual(set(decoded_sample.sample), set(model.variables))
+
+        with self.assertRaises(RuntimeError):
+            model.reorder("unknown")
+
+    def test_typed_sample(self):
+        x = Array.create('x', 4, 'BINARY')
+        exp = SubH(x[0] * x[1] + 2 * x[2], label="h") + Constraint(x[0] * x[3], label="c")
+        model = exp.compile()
+        sample = {v: i % 2 for i, v in enumerate(model.variables)}
+        expected_energy = model.energy(sample, vartype="BINARY")
+        expected_decoded_sample = model.decode_sample(sample, vartype="BINARY")
+
+        for typed_sample in (np.array([i % 2 for i in range(len(model.variables))], dtype=np.int8),
+                             np.array([i % 2 for i in range(len(model.variables))], dtype=np.int32),
+                             np.array([i % 2 for i in range(len(model.variables))], dtype=np.int64),
+                             [i % 2 for i in range(len(model.variables))],
+                             {i: i % 2 for i in range(len(model.variables))}):
+            self.assertEqual(model.energy(typed_sample, vartype="BINARY"), expected_energy)
+            decoded_sample = model.decode_sample(typed_sample, vartype="BINARY")
+            self.assertEqual(decoded_sample.sample, expected_decoded_sample.sample)
+            self.assertEqual(decoded_sample.subh, expected_decoded_sample.subh)
+            self.assertEqual(decoded_sample.constraints(only_broken=False), expected_decoded_sample.constraints(only_broken=False))
+
+        spin_sample = np.array([i % 2 * 2 - 1 for i in range(len(model.variables))], dtype=np.int8)
+        self.assertEqual(model.energy(spin_sample, vartype="SPIN"), expected_energy)
+
+        with self.assertRaises(RuntimeError):
+            model.energy(1, vartype="BINARY")
+
+    def test_compile_many(self):
+        x = Array.create('x', 6, 'BINARY')
+        expressions = [SubH(k * x[0] * x[1] * x[2] + x[k % 6], label="h") + Constraint(x[3] + x[4], label="c", condition=lambda v: v <= 1) for k in range(1, 9)]
+        models = compile_many(expressions, strength=10.0, num_threads=4)
+        self.assertEqual(len(models), len(expressions))
+
+        # Pythonのスレッドで式を組み立てている間に、別のスレッドでコンパイルします。
+        futures = [expression.compile_async(strength=10.0) for expression in expressions]
+
+        for expression, model, future in zip(expressions, models, futures):
+            expected_model = expression.compile(strength=10.0)
+            async_model = future.result(timeout=60)
+            self.assertTrue(future.done())
+            for other_model in (model, async_model):
+                qubo, offset = other_model.to_qubo()
+                expected_qubo, expected_offset = expected_model.to_qubo()
+                assert_qubo_equal(qubo, expected_qubo)
+                self.assertEqual(offset, expected_offset)
+                sample = {v: 1 for v in other_model.variables}
+                self.assertEqual(other_model.decode_sample(sample, vartype="BINARY").constraints(only_broken=True), {"c": (False, 2.0)})
+
+    def test_decode_file(self):
+        x = Array.create('x', 5, 'BINARY')
+        a = Placeholder("a")
+        exp = SubH(x[0] * x[1] + a * x[2], label="h") + x[3] * x[4] + Constraint(x[0] + x[3], label="c", condition=lambda v: v <= 1)
+        model = exp.compile()
+        samples = np.random.RandomState(0).randint(0, 2, size=(1000, len(model.variables))).astype(np.int8)
+
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "samples.npy")
+            np.save(path, samples)
+
+            decoded = model.decode_file(path, vartype="BINARY", feed_dict={"a": 2.0}, chunk_rows=300)
+            out = os.path.join(directory, "out")
+            streamed = model.decode_file(path, vartype="BINARY", feed_dict={"a": 2.0}, chunk_rows=300, out=out)
+            self.assertTrue(os.path.exists(os.path.join(out, "energy.npy")))
+            np.testing.assert_array_equal(np.load(os.path.join(out, "energy.npy")), decoded["energy"])
+
+            for i in range(0, len(samples), 97):
+                expected = model.decode_sample(samples[i], vartype="BINARY", feed_dict={"a": 2.0})
+                for result in (decoded, streamed):
+                    self.assertAlmostEqual(result["energy"][i], expected.energy)
+                    self.assertAlmostEqual(result["subh"]["h"][i], expected.subh["h"])
+                    satisfied, energy = result["constraints"]["c"]
+                    self.assertEqual((bool(satisfied[i]), energy[i]), expected.constraints(only_broken=False)["c"])
+
+    def test_evaluator(self):
+        x = Array.create('x', 5, 'BINARY')
+        a = Placeholder("a")
+        exp = x[0] * x[1] * x[2] - a * x[2] * x[3] + 2 * x[4] + Constraint(x[0] + x[3], label="c", condition=lambda v: v <= 1)
+        model = exp.compile(quadratize=False)
+        rng = np.random.RandomState(0)
+        state = rng.randint(0, 2, size=len(model.variables)).astype(np.int8)
+        evaluator = model.evaluator(state, feed_dict={"a": 3.0})
+        deltas = evaluator.deltas()
+        self.assertFalse(deltas.flags.writeable)
+
+        for _ in range(50):
+            current = model.decode_sample(evaluator.state, vartype="BINARY", feed_dict={"a": 3.0})
+            self.assertAlmostEqual(evaluator.energy, current.energy)
+            self.assertEqual(evaluator.constraints(), current.constraints(only_broken=False))
+            i = rng.randint(len(model.variables))
+            flipped = evaluator.state
+            flipped[i] = 1 - flipped[i]
+            expected = model.energy(flipped, vartype="BINARY", feed_dict={"a": 3.0}) - current.energy
+            self.assertAlmostEqual(deltas[i], expected)
+            self.assertAlmostEqual(evaluator.flip(i), expected)
+
+        energy = evaluator.energy
+        evaluator.recompute()
+        self.assertAlmostEqual(evaluator.energy, energy)
+        self.assertRaises(IndexError, lambda: evaluator.delta(len(model.variables)))
+
+        # flip does not call the condition; it is evaluated when num_broken is queried.
+        calls = []
+        exp = x[0] * x[1] + Constraint(x[0] + x[3], label="c", condition=lambda v: calls.append(v) or v <= 1)
+        model = exp.compile()
+        evaluator = model.evaluator(np.zeros(len(model.variables), dtype=np.int8))
+        del calls[:]
+        for i in range(len(model.variables)):
+            evaluator.flip(i)
+        self.assertEqual(calls, [])
+        self.assertEqual(evaluator.num_broken, 1)
+        self.assertEqual(calls, [2.0])
+
+    def test_constraint_tracker(self):
+        x = Array.create('x', 6, 'BINARY')
+        exp = x[0] * x[5] + Constraint((x[0] + x[1] + x[2] - 1) ** 2, label="one_hot", condition=lambda v: v == 0.0) + Constraint(x[2] + x[3] * x[4], label="le", condition=lambda v: v <= 1)
+        model = exp.compile()
+        rng = np.random.RandomState(1)
+        state = rng.randint(0, 2, size=len(model.variables)).astype(np.int8)
+        tracker = model.constraint_tracker(state)
+
+        for _ in range(50):
+            current = model.decode_sample(tracker.state, vartype="BINARY")
+            broken = current.constraints(only_broken=True)
+            self.assertEqual(tracker.num_broken, len(broken))
+            self.assertEqual(sorted(tracker.broken()), sorted(broken))
+            self.assertEqual(tracker.constraints(), current.constraints(only_broken=False))
+            i = rng.randint(len(model.variables))
+            expected = tracker.broken_delta(i)
+            self.assertEqual(tracker.flip(i), expected)
+            self.assertEqual(tracker.num_broken, len(broken) + expected)
+
+        evaluator = model.evaluator(tracker.state)
+        self.assertEqual(evaluator.num_broken, tracker.num_broken)
+
+    def test_estimate_compile(self):
+        x = Array.create('x', 30, 'BINARY')
+        exp = sum(x) ** 3 + Constraint(x[0] + x[1], label="c")
+        estimate = exp.estimate_compile()
+        model = exp.compile(quadratize=False)
+        self.assertGreaterEqual(estimate["terms"], len(model.to_hubo()[0]))
+        self.assertEqual(estimate["degree"], 3)
+        self.assertEqual(estimate["variables"], 30)
+        self.assertGreaterEqual(estimate["auxiliary_variables"], exp.compile().num_auxiliary_variables)
+        self.assertGreater(estimate["memory"], 0)
+
+        huge = sum(Array.create('y', 2000, 'BINARY')) ** 4
+        self.assertGreater(huge.estimate_compile()["terms"], 10 ** 11)
+        unbounded = (sum(Array.create('z', 5000, 'BINARY')) ** 200).estimate_compile()
+        self.assertEqual((unbounded["terms"], unbounded["auxiliary_variables"], unbounded["memory"]), (math.inf, math.inf, math.inf))
+        self.assertRaises(CompileLimitError, lambda: huge.compile(max_terms=100000))
+        self.assertRaises(MemoryError, lambda: huge.compile(max_memory=10 ** 7))
+        self.assertEqual(exp.compile(max_terms=estimate["terms"]).to_qubo(), exp.compile().to_qubo())
+
+    def test_compile_progress(self):
+        x = Array.create('x', 20, 'BINARY')
+        exp = sum(x) ** 3 + Constraint(x[0] + x[1], label="c")
+        reports = []
+        model = exp.compile(progress=reports.append, progress_interval=0)
+        self.assertEqual([report["phase"] for report in reports][0], "expand")
+        self.assertEqual(reports[-1]["phase"], "build")
+        self.assertEqual(reports[-1]["fraction"], 1.0)
+        self.assertEqual(reports[-1]["variables"], len(model.variables))
+        for previous, report in zip(reports, reports[1:]):
+            if previous["phase"] == report["phase"]:
+                self.assertLessEqual(previous["fraction"], report["fraction"])
+            self.assertLessEqual(previous["elapsed"], report["elapsed"])
+
+        def stop(report):
+            raise ValueError(report["phase"])
+        self.assertRaises(ValueError, lambda: exp.compile(progress=stop))
+
+        huge = sum(Array.create('y', 2000, 'BINARY')) ** 4
+        self.assertRaises(CompileTimeoutError, lambda: huge.compile(time_limit=0.1))
+        self.assertRaises(TimeoutError, lambda: huge.compile(time_limit=0.1))
+
+        future = huge.compile_async()
+        self.assertTrue(future.cancel())
+        self.assertRaises(CompileCancelledError, lambda: future.result(timeout=60))
+
+        # 放置したcompile_asyncが、インタープリターの終了を止めないこと。
+        code = "from pyquboc import Array; huge = sum(Array.create('y', 2000, 'BINARY')) ** 4; futures = [huge.compile_async(progress=lambda p: None) for _ in range(64)]"
+        subprocess.run([sys.executable, "-c", code], check=True, timeout=60)
+
+    def test_parse_model(self):
+        exp = parse_model('''
+            # comment
+            binary x y z[0..2]
+            spin s
+            placeholder a
+            minimize 2 * x * y - x / 2
+              + z[0] * z[1] * z[2]
+            constraint one: (z[0] + z[1] + z[2] - 1) ^ 2
+            constraint le: x + y <= 1
+            subh cost: x + s
+            penalty p: (x - y) ** 2
+            minimize a * one; minimize -(-s)
+        ''')
+        x, y, s, a = Binary("x"), Binary("y"), Spin("s"), Placeholder("a")
+        z = Array.create('z', 3, 'BINARY')
+        one = Constraint((z[0] + z[1] + z[2] - 1) ** 2, label="one")
+        expected_exp = 2 * x * y - x / 2 + z[0] * z[1] * z[2] + a * one + Constraint(x + y, label="le") + SubH(x + s, label="cost") + WithPenalty(Num(0), (x - y) ** 2, "p") + s
+        model, expected_model = exp.compile(), expected_exp.compile()
+        feed_dict = {"a": 2.0}
+
+        assert_qubo_equal(model.to_qubo(feed_dict=feed_dict)[0], expected_model.to_qubo(feed_dict=feed_dict)[0])
+        self.assertEqual(model.to_qubo(feed_dict=feed_dict)[1], expected_model.to_qubo(feed_dict=feed_dict)[1])
+
+        sample = dict.fromkeys(model.variables, 0)
+        sample.update({"x": 1, "y": 1, "z[0]": 1})
+        self.assertEqual(list(model.decode_sample(sample, vartype="BINARY", feed_dict=feed_dict).constraints(only_broken=True)), ["le"])  # x + y <= 1が破れています。
+
+        for text in ["binary x\nminimize x + y", "binary x x", "binary x\nminimize x / x", "binary x\nminimize (x", "# empty"]:
+            self.assertRaises(ModelParseError, parse_model, text)
+
+        self.assertTrue(issubclass(ModelParseError, ValueError))
+
 
 if __name__ == '__main__':
     unittest.main()